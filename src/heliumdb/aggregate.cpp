@@ -0,0 +1,552 @@
+#include "module.h"
+#include "keyrange.h"
+#include "pool.h"
+
+#include <cmath>
+#include <limits>
+
+/*
+ * Native reductions over 'i' and 'f' values. Every key range is scanned
+ * with the GIL released, values are copied into fixed size chunks and each
+ * chunk is reduced by tight loops the compiler can vectorize. Ranges run in
+ * parallel on the process pool and their partial results are merged.
+ */
+
+using namespace std;
+
+/* values reduced per chunk */
+#define AGG_CHUNK 1024
+
+/* largest histogram accepted */
+#define AGG_MAX_BINS 65536
+
+enum aggFn
+{
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_MEAN,
+    AGG_HISTOGRAM
+};
+
+/* decoded values of one chunk, typed by the datastore's val_type */
+typedef union
+{
+    int64_t mInts[AGG_CHUNK];
+    double  mFloats[AGG_CHUNK];
+} aggChunk;
+
+struct aggPart
+{
+    uint64_t            mCount;
+    /* int sums are split so a chunk's partial sums cannot overflow */
+    __int128            mIntSum;
+    double              mSum;
+    int64_t             mIntMin;
+    int64_t             mIntMax;
+    double              mMin;
+    double              mMax;
+    /* values that took part in min and max, nan is skipped */
+    uint64_t            mOrdered;
+    vector<uint64_t>    mBins;
+    bool                mFailed;
+
+    aggPart ()
+        : mCount (0),
+          mIntSum (0),
+          mSum (0),
+          mIntMin (numeric_limits<int64_t>::max ()),
+          mIntMax (numeric_limits<int64_t>::min ()),
+          mMin (numeric_limits<double>::infinity ()),
+          mMax (-numeric_limits<double>::infinity ()),
+          mOrdered (0),
+          mFailed (false)
+    {
+    }
+};
+
+struct aggJob
+{
+    heliumdbBackend*    mDatastore;
+    char                mType;
+    aggFn               mFn;
+    string              mPrefix;
+    string              mStart;
+    string              mStop;
+    bool                mHasStart;
+    bool                mHasStop;
+    vector<string>      mBounds;
+    size_t              mBinCount;
+    double              mLow;
+    double              mHigh;
+    vector<aggPart>     mParts;
+};
+
+static inline void
+binValue (aggPart& p, const aggJob& job, double v)
+{
+    if (!(v >= job.mLow && v <= job.mHigh))
+        return;
+
+    size_t bin = job.mHigh > job.mLow ?
+        (size_t)((v - job.mLow) / (job.mHigh - job.mLow) * job.mBinCount) : 0;
+    if (bin >= job.mBinCount)
+        bin = job.mBinCount - 1;
+
+    p.mBins[bin]++;
+}
+
+static void
+reduceInts (const int64_t* v, size_t n, aggPart& p, const aggJob& job)
+{
+    p.mCount += n;
+
+    switch (job.mFn)
+    {
+    case AGG_SUM:
+    case AGG_MEAN:
+    {
+        // high and low halves sum separately without overflow over a chunk
+        int64_t hi = 0;
+        int64_t lo = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            hi += v[i] >> 32;
+            lo += v[i] & 0xffffffff;
+        }
+        p.mIntSum += ((__int128)hi << 32) + lo;
+        break;
+    }
+    case AGG_MIN:
+    case AGG_MAX:
+    {
+        int64_t mn = p.mIntMin;
+        int64_t mx = p.mIntMax;
+        for (size_t i = 0; i < n; ++i)
+        {
+            mn = v[i] < mn ? v[i] : mn;
+            mx = v[i] > mx ? v[i] : mx;
+        }
+        p.mIntMin = mn;
+        p.mIntMax = mx;
+        p.mOrdered += n;
+        break;
+    }
+    case AGG_HISTOGRAM:
+        for (size_t i = 0; i < n; ++i)
+            binValue (p, job, (double)v[i]);
+        break;
+    case AGG_COUNT:
+        break;
+    }
+}
+
+static void
+reduceFloats (const double* v, size_t n, aggPart& p, const aggJob& job)
+{
+    p.mCount += n;
+
+    switch (job.mFn)
+    {
+    case AGG_SUM:
+    case AGG_MEAN:
+    {
+        // independent lanes keep the loop vectorizable without -ffast-math
+        double  s[4] = {0, 0, 0, 0};
+        size_t  body = n & ~(size_t)3;
+        for (size_t i = 0; i < body; i += 4)
+        {
+            s[0] += v[i];
+            s[1] += v[i + 1];
+            s[2] += v[i + 2];
+            s[3] += v[i + 3];
+        }
+        for (size_t i = body; i < n; ++i)
+            s[0] += v[i];
+        p.mSum += (s[0] + s[1]) + (s[2] + s[3]);
+        break;
+    }
+    case AGG_MIN:
+    case AGG_MAX:
+    {
+        double mn = p.mMin;
+        double mx = p.mMax;
+        for (size_t i = 0; i < n; ++i)
+        {
+            mn = v[i] < mn ? v[i] : mn;
+            mx = v[i] > mx ? v[i] : mx;
+            p.mOrdered += v[i] == v[i];
+        }
+        p.mMin = mn;
+        p.mMax = mx;
+        break;
+    }
+    case AGG_HISTOGRAM:
+        for (size_t i = 0; i < n; ++i)
+            binValue (p, job, v[i]);
+        break;
+    case AGG_COUNT:
+        break;
+    }
+}
+
+static void
+reduce (const aggChunk& chunk, size_t n, aggPart& p, const aggJob& job)
+{
+    if (job.mType == 'i')
+        reduceInts (chunk.mInts, n, p, job);
+    else
+        reduceFloats (chunk.mFloats, n, p, job);
+}
+
+/* scan range part of the job, called on the pool without the GIL */
+static void
+scanPart (aggJob& job, size_t part)
+{
+    aggPart&        p = job.mParts[part];
+    string          start = job.mBounds[part];
+    const string*   stop = part + 1 < job.mBounds.size () ? &job.mBounds[part + 1] : NULL;
+
+    if (job.mHasStart && compareKey (start.data (), start.size (),
+                                     job.mStart.data (), job.mStart.size ()) < 0)
+        start = job.mStart;
+    if (job.mHasStop && (stop == NULL || compareKey (job.mStop.data (), job.mStop.size (),
+                                                     stop->data (), stop->size ()) < 0))
+        stop = &job.mStop;
+
+    p.mBins.assign (job.mFn == AGG_HISTOGRAM ? job.mBinCount : 0, 0);
+
+    if (stop && compareKey (start.data (), start.size (), stop->data (), stop->size ()) >= 0)
+        return;
+
+    bool        countOnly = job.mFn == AGG_COUNT;
+    heliumdbCursor* itr = job.mDatastore->iterate (start.data (), start.size (),
+                                                   countOnly ? 0 : HE_MAX_VAL_LEN);
+    if (itr == NULL)
+    {
+        p.mFailed = true;
+        return;
+    }
+
+    aggChunk        chunk;
+    size_t          n = 0;
+    const he_item*  item;
+
+    while ((item = itr->next ()))
+    {
+        if (stop && compareKey (item->key, item->key_len, stop->data (), stop->size ()) >= 0)
+            break;
+        if (!hasPrefix (item, job.mPrefix.data (), job.mPrefix.size ()))
+            break;
+
+        if (countOnly)
+        {
+            p.mCount++;
+            continue;
+        }
+
+        // values of another width were not written by this val_type
+        if (item->val_len != sizeof (int64_t))
+            continue;
+
+        memcpy (&chunk.mInts[n], item->val, sizeof (int64_t));
+        if (++n == AGG_CHUNK)
+        {
+            reduce (chunk, n, p, job);
+            n = 0;
+        }
+    }
+    delete itr;
+
+    reduce (chunk, n, p, job);
+}
+
+static bool
+runJob (aggJob& job)
+{
+    // nothing under the prefix still reduces one empty range
+    if (job.mBounds.empty ())
+        job.mBounds.push_back (job.mPrefix);
+
+    job.mParts.assign (job.mBounds.size (), aggPart ());
+
+    heliumdbPool::instance ().parallelFor (job.mBounds.size (), 1, [&job] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            scanPart (job, i);
+    });
+
+    for (size_t i = 1; i < job.mParts.size (); ++i)
+    {
+        aggPart& a = job.mParts[0];
+        aggPart& b = job.mParts[i];
+
+        a.mCount += b.mCount;
+        a.mIntSum += b.mIntSum;
+        a.mSum += b.mSum;
+        a.mIntMin = min (a.mIntMin, b.mIntMin);
+        a.mIntMax = max (a.mIntMax, b.mIntMax);
+        a.mMin = min (a.mMin, b.mMin);
+        a.mMax = max (a.mMax, b.mMax);
+        a.mOrdered += b.mOrdered;
+        a.mFailed = a.mFailed || b.mFailed;
+        for (size_t j = 0; j < a.mBins.size (); ++j)
+            a.mBins[j] += b.mBins[j];
+    }
+
+    return !job.mParts[0].mFailed;
+}
+
+static PyObject*
+intSum (__int128 v)
+{
+    if (v >= numeric_limits<int64_t>::min () && v <= numeric_limits<int64_t>::max ())
+        return PyLong_FromLongLong ((long long)v);
+
+    char    buf[48];
+    char*   p = buf + sizeof (buf);
+    bool    neg = v < 0;
+    unsigned __int128 u = neg ? -(unsigned __int128)v : (unsigned __int128)v;
+
+    *--p = '\0';
+    do
+    {
+        *--p = '0' + (int)(u % 10);
+        u /= 10;
+    }
+    while (u);
+    if (neg)
+        *--p = '-';
+
+    return PyLong_FromString (p, NULL, 10);
+}
+
+static PyObject*
+histogram (const aggJob& job, const aggPart& p)
+{
+    PyObject* edges = PyList_New (job.mBinCount + 1);
+    PyObject* counts = PyList_New (job.mBinCount);
+    if (edges == NULL || counts == NULL)
+    {
+        Py_XDECREF (edges);
+        Py_XDECREF (counts);
+        return NULL;
+    }
+
+    double width = (job.mHigh - job.mLow) / job.mBinCount;
+    for (size_t i = 0; i <= job.mBinCount; ++i)
+    {
+        double edge = i == job.mBinCount ? job.mHigh : job.mLow + width * i;
+        PyList_SET_ITEM (edges, i, PyFloat_FromDouble (edge));
+    }
+    for (size_t i = 0; i < job.mBinCount; ++i)
+        PyList_SET_ITEM (counts, i, PyLong_FromUnsignedLongLong (p.mBins[i]));
+
+    return Py_BuildValue ("{sNsN}", "edges", edges, "counts", counts);
+}
+
+static PyObject*
+result (const aggJob& job)
+{
+    const aggPart&  p = job.mParts[0];
+    bool            ints = job.mType == 'i';
+
+    switch (job.mFn)
+    {
+    case AGG_COUNT:
+        return PyLong_FromUnsignedLongLong (p.mCount);
+    case AGG_SUM:
+        return ints ? intSum (p.mIntSum) : PyFloat_FromDouble (p.mSum);
+    case AGG_MEAN:
+        if (p.mCount == 0)
+            break;
+        return PyFloat_FromDouble ((ints ? (double)p.mIntSum : p.mSum) / p.mCount);
+    case AGG_MIN:
+        if (p.mOrdered == 0)
+            break;
+        return ints ? PyLong_FromLongLong (p.mIntMin) : PyFloat_FromDouble (p.mMin);
+    case AGG_MAX:
+        if (p.mOrdered == 0)
+            break;
+        return ints ? PyLong_FromLongLong (p.mIntMax) : PyFloat_FromDouble (p.mMax);
+    case AGG_HISTOGRAM:
+        return histogram (job, p);
+    }
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
+
+static bool
+parseFn (const char* name, aggFn& fn)
+{
+    static const struct { const char* mName; aggFn mFn; } fns[] = {
+        {"count", AGG_COUNT},
+        {"sum", AGG_SUM},
+        {"min", AGG_MIN},
+        {"max", AGG_MAX},
+        {"mean", AGG_MEAN},
+        {"histogram", AGG_HISTOGRAM}
+    };
+
+    for (size_t i = 0; i < sizeof (fns) / sizeof (fns[0]); ++i)
+    {
+        if (strcmp (name, fns[i].mName) == 0)
+        {
+            fn = fns[i].mFn;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* bounds of the key range argument, a (start, stop) tuple either of which
+ * may be None */
+static bool
+parseRange (heliumdbPy* self, PyObject* range, aggJob& job)
+{
+    job.mHasStart = job.mHasStop = false;
+    if (range == Py_None)
+        return true;
+
+    if (!PyTuple_Check (range) || PyTuple_GET_SIZE (range) != 2)
+    {
+        PyErr_SetString (HeliumDbException, "range must be a (start, stop) tuple");
+        return false;
+    }
+
+    char    key[HE_MAX_KEY_LEN];
+    size_t  len;
+
+    PyObject* start = PyTuple_GET_ITEM (range, 0);
+    if (start != Py_None)
+    {
+        if (!encodeKey (self, start, key, len))
+            return false;
+        job.mStart.assign (key, len);
+        job.mHasStart = true;
+    }
+
+    PyObject* stop = PyTuple_GET_ITEM (range, 1);
+    if (stop != Py_None)
+    {
+        if (!encodeKey (self, stop, key, len))
+            return false;
+        job.mStop.assign (key, len);
+        job.mHasStop = true;
+    }
+
+    return true;
+}
+
+PyObject*
+heliumdb_aggregate (heliumdbPy* self, PyObject* args, PyObject* kwargs)
+{
+    const char* name;
+    PyObject*   prefix = Py_None;
+    PyObject*   range = Py_None;
+    int         threads = 1;
+    Py_ssize_t  bins = 10;
+    PyObject*   bounds = Py_None;
+
+    char *kwlist[] = {(char*)"fn",
+                      (char*)"prefix",
+                      (char*)"range",
+                      (char*)"threads",
+                      (char*)"bins",
+                      (char*)"bounds",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "s|OOinO", kwlist,
+                                      &name, &prefix, &range, &threads, &bins, &bounds))
+        return NULL;
+
+    aggJob job;
+    job.mDatastore = self->mDatastore;
+    job.mType = self->mValType;
+
+    if (!parseFn (name, job.mFn))
+    {
+        PyErr_SetString (HeliumDbException,
+                         "fn must be one of count, sum, min, max, mean, histogram");
+        return NULL;
+    }
+
+    if (job.mFn != AGG_COUNT && job.mType != 'i' && job.mType != 'f')
+    {
+        PyErr_SetString (HeliumDbException, "aggregate requires val_type 'i' or 'f'");
+        return NULL;
+    }
+
+    if (threads < 1 || threads > 64)
+    {
+        PyErr_SetString (HeliumDbException, "threads must be 1-64");
+        return NULL;
+    }
+
+    if (job.mFn == AGG_HISTOGRAM)
+    {
+        if (bins < 1 || bins > AGG_MAX_BINS)
+        {
+            PyErr_SetString (HeliumDbException, "bins must be between 1 and 65536");
+            return NULL;
+        }
+        job.mBinCount = bins;
+
+        if (bounds != Py_None &&
+            !PyArg_ParseTuple (bounds, "dd;bounds must be a (low, high) tuple",
+                               &job.mLow, &job.mHigh))
+            return NULL;
+        if (bounds != Py_None && !(job.mLow <= job.mHigh))
+        {
+            PyErr_SetString (HeliumDbException, "bounds low must not exceed high");
+            return NULL;
+        }
+    }
+
+    if (prefix != Py_None)
+    {
+        char    key[HE_MAX_KEY_LEN];
+        size_t  len;
+        if (!encodePrefix (self, prefix, key, len))
+            return NULL;
+        job.mPrefix.assign (key, len);
+    }
+
+    if (!parseRange (self, range, job))
+        return NULL;
+
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = heliumdbSplitKeys (job.mDatastore, job.mPrefix, threads, job.mBounds);
+    if (ok && job.mFn == AGG_HISTOGRAM && bounds == Py_None)
+    {
+        // without bounds the histogram spans the values found by a first pass
+        job.mFn = AGG_MIN;
+        ok = runJob (job);
+        if (ok)
+        {
+            const aggPart& p = job.mParts[0];
+            job.mLow = job.mType == 'i' ? (double)p.mIntMin : p.mMin;
+            job.mHigh = job.mType == 'i' ? (double)p.mIntMax : p.mMax;
+            if (p.mOrdered == 0)
+                job.mLow = job.mHigh = 0;
+        }
+        job.mFn = AGG_HISTOGRAM;
+    }
+    if (ok)
+        ok = runJob (job);
+    Py_END_ALLOW_THREADS
+
+    if (!ok)
+    {
+        PyErr_SetString (HeliumDbException, "failed to open iterator");
+        return NULL;
+    }
+
+    return result (job);
+}
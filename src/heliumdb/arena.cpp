@@ -0,0 +1,176 @@
+#include "arena.h"
+
+#include <cerrno>
+
+using namespace std;
+
+/* initial size class of a new handle */
+#define ARENA_MIN_CLASS 4096
+
+/* values above this are still read but not learned, and the thread buffer
+ * is trimmed back once the lookup completes */
+#define ARENA_MAX_CLASS (16 * 1024 * 1024)
+
+/* number of idle view blocks kept per handle */
+#define ARENA_MAX_BLOCKS 16
+
+struct threadBuffer
+{
+    vector<char>    mBuf;
+    bool            mBusy;
+};
+
+static thread_local threadBuffer THREAD_BUFFER;
+
+static size_t
+roundUp (size_t len)
+{
+    size_t res = ARENA_MIN_CLASS;
+    while (res < len)
+        res <<= 1;
+
+    return res;
+}
+
+heliumdbArena::heliumdbArena ()
+    : mLookups (0),
+      mRetries (0),
+      mAllocations (0),
+      mSizeClass (ARENA_MIN_CLASS)
+{
+}
+
+heliumdbArena::~heliumdbArena ()
+{
+    for (size_t i = 0; i < mBlocks.size (); ++i)
+        delete mBlocks[i];
+}
+
+vector<char>*
+heliumdbArena::acquireBlock ()
+{
+    {
+        lock_guard<mutex> guard (mBlockLock);
+        if (!mBlocks.empty ())
+        {
+            vector<char>* block = mBlocks.back ();
+            mBlocks.pop_back ();
+            return block;
+        }
+    }
+
+    return new vector<char> ();
+}
+
+void
+heliumdbArena::releaseBlock (vector<char>* block)
+{
+    if (block->capacity () <= ARENA_MAX_CLASS)
+    {
+        lock_guard<mutex> guard (mBlockLock);
+        if (mBlocks.size () < ARENA_MAX_BLOCKS)
+        {
+            mBlocks.push_back (block);
+            return;
+        }
+    }
+
+    delete block;
+}
+
+void
+heliumdbArena::learn (size_t len)
+{
+    if (len > ARENA_MAX_CLASS)
+        return;
+
+    size_t want = roundUp (len);
+    size_t cur = mSizeClass.load (memory_order_relaxed);
+    while (cur < want &&
+           !mSizeClass.compare_exchange_weak (cur, want, memory_order_relaxed))
+        ;
+}
+
+heliumdbBuffer::heliumdbBuffer (heliumdbArena* arena)
+    : mArena (arena),
+      mOwned (THREAD_BUFFER.mBusy)
+{
+    if (mOwned)
+    {
+        mBuf = &mPrivate;
+    }
+    else
+    {
+        mBuf = &THREAD_BUFFER.mBuf;
+        THREAD_BUFFER.mBusy = true;
+    }
+}
+
+heliumdbBuffer::heliumdbBuffer (heliumdbArena* arena, vector<char>& target)
+    : mArena (arena),
+      mBuf (&target),
+      mOwned (true)
+{
+}
+
+heliumdbBuffer::~heliumdbBuffer ()
+{
+    if (mOwned)
+        return;
+
+    if (mBuf->capacity () > ARENA_MAX_CLASS)
+        vector<char> ().swap (*mBuf);
+
+    THREAD_BUFFER.mBusy = false;
+}
+
+void
+heliumdbBuffer::reserve (size_t len)
+{
+    if (mBuf->size () >= len)
+        return;
+
+    if (mBuf->capacity () < len)
+        mArena->mAllocations.fetch_add (1, memory_order_relaxed);
+
+    mBuf->resize (len);
+}
+
+int
+heliumdbBuffer::lookup (heliumdbBackend* ds, he_item& item, bool remove)
+{
+    mArena->mLookups.fetch_add (1, memory_order_relaxed);
+
+    reserve (mArena->sizeClass ());
+    item.val = &(*mBuf)[0];
+
+    int rc = ds->lookup (&item, 0, mBuf->size ());
+    if (rc != 0)
+        return rc;
+
+    while (item.val_len > mBuf->size ())
+    {
+        mArena->learn (item.val_len);
+        mArena->mRetries.fetch_add (1, memory_order_relaxed);
+
+        reserve (item.val_len);
+        item.val = &(*mBuf)[0];
+
+        rc = ds->lookup (&item, 0, mBuf->size ());
+        if (rc != 0)
+            return rc;
+    }
+
+    if (!remove)
+        return 0;
+
+    if ((rc = ds->deleteLookup (&item, 0, mBuf->size ())) == 0 &&
+        item.val_len > mBuf->size ())
+    {
+        // the value grew between lookup and delete and came back truncated
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    return rc;
+}
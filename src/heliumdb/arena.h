@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "backend.h"
+
+/*
+ * Per handle lookup buffer policy.
+ *
+ * Lookups read into a buffer owned by the calling thread which is sized by
+ * the handle's learned size class, the largest value size seen rounded up to
+ * a power of two. Once the class has been learned a lookup of a large value
+ * needs a single store call and no heap allocation.
+ */
+class heliumdbArena
+{
+public:
+    heliumdbArena ();
+
+    ~heliumdbArena ();
+
+    /* grow the size class to fit len */
+    void learn (size_t len);
+
+    size_t sizeClass () const { return mSizeClass.load (std::memory_order_relaxed); }
+
+    std::atomic<uint64_t>   mLookups;
+    std::atomic<uint64_t>   mRetries;
+    std::atomic<uint64_t>   mAllocations;
+
+    /* pooled blocks backing the memoryviews returned by get_view */
+    std::vector<char>* acquireBlock ();
+
+    void releaseBlock (std::vector<char>* block);
+
+private:
+    std::atomic<size_t>             mSizeClass;
+    std::mutex                      mBlockLock;
+    std::vector<std::vector<char>*> mBlocks;
+};
+
+/*
+ * Scoped use of the calling thread's lookup buffer, item.val stays valid
+ * until this object is destroyed. A nested lookup on the same thread (e.g.
+ * from a deserializer calling back into python) gets a private buffer.
+ */
+class heliumdbBuffer
+{
+public:
+    heliumdbBuffer (heliumdbArena* arena);
+
+    /* read into target rather than the thread's buffer */
+    heliumdbBuffer (heliumdbArena* arena, std::vector<char>& target);
+
+    ~heliumdbBuffer ();
+
+    /* he_lookup item into the buffer, retrying with a larger buffer if
+     * the value exceeds the size class. With remove set the item is then
+     * deleted with he_delete_lookup into the sized buffer so the returned
+     * value is never truncated. Safe to call without the GIL */
+    int lookup (heliumdbBackend* ds, he_item& item, bool remove);
+
+private:
+    void reserve (size_t len);
+
+    heliumdbArena*      mArena;
+    std::vector<char>*  mBuf;
+    std::vector<char>   mPrivate;
+    bool                mOwned;
+};
@@ -0,0 +1,211 @@
+#include "module.h"
+
+/*
+ * Columnar bulk load, every row of two contiguous buffers is written with
+ * the GIL released and without creating a python object per row.
+ */
+enum columnKind
+{
+    COLUMN_INT,
+    COLUMN_ORDERED_INT,
+    COLUMN_FLOAT,
+    COLUMN_ORDERED_FLOAT,
+    COLUMN_BYTES
+};
+
+typedef struct
+{
+    Py_buffer   mView;
+    columnKind  mKind;
+    size_t      mRows;
+    size_t      mWidth;
+    uint64_t    mScratch;
+} column;
+
+static bool
+columnKindOf (serializer s, columnKind& kind)
+{
+    if (s == &serializeIntKey || s == &serializeIntVal)
+        kind = COLUMN_INT;
+    else if (s == &serializeOrderedIntKey)
+        kind = COLUMN_ORDERED_INT;
+    else if (s == &serializeFloatKey || s == &serializeFloatVal)
+        kind = COLUMN_FLOAT;
+    else if (s == &serializeOrderedFloatKey)
+        kind = COLUMN_ORDERED_FLOAT;
+    else if (s == &serializeBytesKey || s == &serializeBytesVal)
+        kind = COLUMN_BYTES;
+    else
+        return false;
+
+    return true;
+}
+
+/* struct module format of the buffer without byte order prefix */
+static const char*
+formatCode (const Py_buffer& view)
+{
+    const char* fmt = view.format ? view.format : "B";
+    if (*fmt == '@' || *fmt == '=' || *fmt == '<')
+        fmt++;
+
+    return fmt;
+}
+
+static bool
+openColumn (PyObject* o, serializer s, column& col, const char* name)
+{
+    char err[128];
+
+    if (!columnKindOf (s, col.mKind))
+    {
+        snprintf (err, sizeof (err),
+                  "put_arrays does not support the %s type of this datastore", name);
+        PyErr_SetString (HeliumDbException, err);
+        return false;
+    }
+
+    if (PyObject_GetBuffer (o, &col.mView, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == -1)
+        return false;
+
+    const char* fmt = formatCode (col.mView);
+    bool        ok;
+
+    if (col.mKind == COLUMN_BYTES)
+    {
+        // a 1-d array of fixed width strings or a 2-d matrix of bytes
+        ok = col.mView.ndim == 1 || (col.mView.ndim == 2 && col.mView.itemsize == 1);
+        col.mRows = col.mView.ndim ? col.mView.shape[0] : 0;
+        col.mWidth = col.mView.ndim == 2 ? col.mView.shape[1] : col.mView.itemsize;
+    }
+    else
+    {
+        bool isFloat = col.mKind == COLUMN_FLOAT || col.mKind == COLUMN_ORDERED_FLOAT;
+        bool isInt64 = strcmp (fmt, "q") == 0 ||
+                       (strcmp (fmt, "l") == 0 && sizeof (long) == 8);
+
+        ok = col.mView.ndim == 1 &&
+             col.mView.itemsize == 8 &&
+             (isFloat ? strcmp (fmt, "d") == 0 : isInt64);
+        col.mRows = ok ? col.mView.shape[0] : 0;
+        col.mWidth = 8;
+    }
+
+    if (!ok)
+    {
+        snprintf (err, sizeof (err),
+                  "%s buffer must be a contiguous %s array",
+                  name,
+                  col.mKind == COLUMN_BYTES ? "fixed width bytes" :
+                  (col.mKind == COLUMN_INT || col.mKind == COLUMN_ORDERED_INT) ?
+                  "int64" : "float64");
+        PyErr_SetString (HeliumDbException, err);
+        PyBuffer_Release (&col.mView);
+        return false;
+    }
+
+    return true;
+}
+
+static inline void
+columnRow (column& col, size_t row, void*& data, size_t& len)
+{
+    const char* p = (const char*)col.mView.buf + row * col.mWidth;
+
+    switch (col.mKind)
+    {
+    case COLUMN_ORDERED_INT:
+    {
+        int64_t i;
+        memcpy (&i, p, sizeof (i));
+        col.mScratch = encodeOrderedInt (i);
+        p = (const char*)&col.mScratch;
+        break;
+    }
+    case COLUMN_ORDERED_FLOAT:
+    {
+        double d;
+        memcpy (&d, p, sizeof (d));
+        col.mScratch = encodeOrderedFloat (d);
+        p = (const char*)&col.mScratch;
+        break;
+    }
+    default:
+        break;
+    }
+
+    data = (void*)p;
+    len = col.mWidth;
+}
+
+PyObject*
+heliumdb_put_arrays (heliumdbPy* self, PyObject* args)
+{
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    PyObject* keys;
+    PyObject* vals;
+
+    if (!PyArg_UnpackTuple (args, "put_arrays", 2, 2, &keys, &vals))
+        return NULL;
+
+    column keyCol;
+    column valCol;
+
+    if (!openColumn (keys, self->mKeySerializer, keyCol, "key"))
+        return NULL;
+
+    if (!openColumn (vals, self->mValSerializer, valCol, "value"))
+    {
+        PyBuffer_Release (&keyCol.mView);
+        return NULL;
+    }
+
+    if (keyCol.mRows != valCol.mRows || keyCol.mWidth > HE_MAX_KEY_LEN)
+    {
+        PyErr_SetString (HeliumDbException,
+                         keyCol.mRows != valCol.mRows ?
+                         "key and value arrays differ in length" :
+                         "key width exceeds maximum key length");
+        PyBuffer_Release (&keyCol.mView);
+        PyBuffer_Release (&valCol.mView);
+        return NULL;
+    }
+
+    size_t  row = 0;
+    int     rc = 0;
+    int     err = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    he_item item;
+    for (; row < keyCol.mRows; ++row)
+    {
+        columnRow (keyCol, row, item.key, item.key_len);
+        columnRow (valCol, row, item.val, item.val_len);
+
+        heliumdbNoteKey (self, item.key, item.key_len);
+        if ((rc = self->mDatastore->update (&item)) != 0)
+        {
+            err = errno;
+            break;
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    heliumdbInvalidate (self, NULL, 0);
+
+    PyBuffer_Release (&keyCol.mView);
+    PyBuffer_Release (&valCol.mView);
+
+    if (rc != 0)
+    {
+        char buffer[128];
+        snprintf (buffer, sizeof (buffer),
+                  "he_update failed at row %zu: %s", row, he_strerror (err));
+        PyErr_SetString (HeliumDbException, buffer);
+        return NULL;
+    }
+
+    return PyLong_FromSize_t (row);
+}
@@ -0,0 +1,550 @@
+#include "module.h"
+#include "batch.h"
+#include "pool.h"
+
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/*
+ * asyncio methods. Each call stages its keys and values, creates a future on
+ * the running event loop and queues the store call on the process pool.
+ * Finished operations are collected on a per loop channel whose fd is
+ * registered with loop.add_reader, a single wakeup completes every
+ * operation finished since the last one on the loop's thread.
+ */
+
+using namespace std;
+
+#define ASYNC_OP_GET    0
+#define ASYNC_OP_PUT    1
+#define ASYNC_OP_DEL    2
+#define ASYNC_OP_MANY   3
+
+struct asyncOp;
+
+typedef struct
+{
+    PyObject*           mLoop;
+    int                 mReadFd;
+    int                 mWriteFd;
+    size_t              mInflight;
+    mutex               mLock;
+    vector<asyncOp*>    mDone;
+} asyncChannel;
+
+struct asyncOp
+{
+    int             mKind;
+    heliumdbPy*     mHe;
+    /* ending a transaction swaps mHe->mDatastore, so run on this one */
+    heliumdbBackend* mDatastore;
+    PyObject*       mFuture;
+    PyObject*       mDefault;
+    asyncChannel*   mChannel;
+    string          mKey;
+    string          mVal;
+    vector<char>    mBuf;
+    he_item         mItem;
+    int             mRc;
+    int             mErrno;
+    heliumdbBatch*  mBatch;
+};
+
+/* channels of every loop that used the async methods, GIL protected */
+static vector<asyncChannel*> sChannels;
+
+static PyObject* sGetRunningLoop = NULL;
+
+static void
+closeChannel (asyncChannel* channel)
+{
+    close (channel->mReadFd);
+    if (channel->mWriteFd != channel->mReadFd)
+        close (channel->mWriteFd);
+    Py_DECREF (channel->mLoop);
+    delete channel;
+}
+
+/* drop channels of closed loops with nothing in flight */
+static void
+pruneChannels ()
+{
+    for (size_t i = 0; i < sChannels.size ();)
+    {
+        asyncChannel*   channel = sChannels[i];
+        PyObject*       closed = NULL;
+
+        if (channel->mInflight == 0)
+            closed = PyObject_CallMethod (channel->mLoop, "is_closed", NULL);
+
+        if (closed == Py_True)
+        {
+            closeChannel (channel);
+            sChannels.erase (sChannels.begin () + i);
+        }
+        else
+        {
+            ++i;
+        }
+        Py_XDECREF (closed);
+        PyErr_Clear ();
+    }
+}
+
+static void
+completeOp (asyncOp* op)
+{
+    asyncChannel*   channel = op->mChannel;
+    bool            wake;
+
+    {
+        lock_guard<mutex> lock (channel->mLock);
+        wake = channel->mDone.empty ();
+        channel->mDone.push_back (op);
+    }
+
+    // one wakeup per batch, the drain empties the list after reading the fd
+    if (wake)
+    {
+        uint64_t    one = 1;
+        ssize_t     rc = write (channel->mWriteFd, &one, channel->mWriteFd == channel->mReadFd ? 8 : 1);
+        (void)rc;
+    }
+}
+
+static void
+runOp (asyncOp* op)
+{
+    heliumdbBackend* ds = op->mDatastore;
+
+    op->mItem.key = (void*)op->mKey.data ();
+    op->mItem.key_len = op->mKey.size ();
+
+    switch (op->mKind)
+    {
+    case ASYNC_OP_GET:
+    {
+        if (heliumdbBloomMiss (op->mHe, op->mItem.key, op->mItem.key_len))
+        {
+            op->mRc = -1;
+            break;
+        }
+
+        heliumdbBuffer buffer (op->mHe->mArena, op->mBuf);
+        op->mRc = buffer.lookup (ds, op->mItem, false);
+        break;
+    }
+    case ASYNC_OP_PUT:
+        op->mItem.val = (void*)op->mVal.data ();
+        op->mItem.val_len = op->mVal.size ();
+        op->mRc = ds->update (&op->mItem);
+        break;
+    case ASYNC_OP_DEL:
+        op->mRc = ds->erase (&op->mItem);
+        break;
+    case ASYNC_OP_MANY:
+        op->mBatch->lookup ();
+        op->mRc = 0;
+        break;
+    }
+    op->mErrno = errno;
+
+    completeOp (op);
+}
+
+/* result of a finished operation, NULL with an exception set on failure */
+static PyObject*
+opResult (asyncOp* op)
+{
+    char err[128];
+
+    switch (op->mKind)
+    {
+    case ASYNC_OP_GET:
+    {
+        if (op->mRc != 0)
+        {
+            if (op->mDefault == NULL)
+            {
+                PyErr_SetString (HeliumDbException, "key not found");
+                return NULL;
+            }
+            Py_INCREF (op->mDefault);
+            return op->mDefault;
+        }
+
+        PyObject* obj = op->mHe->mValDeserializer (op->mItem.val, op->mItem.val_len);
+        if (obj == NULL)
+            PyErr_SetString (HeliumDbException, "failed to deserialize value object");
+        return obj;
+    }
+    case ASYNC_OP_PUT:
+    case ASYNC_OP_DEL:
+        if (op->mRc != 0)
+        {
+            snprintf (err, sizeof (err), "%s failed: %s",
+                      op->mKind == ASYNC_OP_PUT ? "he_update" : "he_delete",
+                      he_strerror (op->mErrno));
+            PyErr_SetString (HeliumDbException, err);
+            return NULL;
+        }
+        Py_RETURN_NONE;
+    case ASYNC_OP_MANY:
+        return op->mBatch->values (op->mDefault ? op->mDefault : Py_None);
+    }
+
+    return NULL;
+}
+
+static void
+finishOp (asyncOp* op)
+{
+    // the store call is done, drop values cached from reads that raced it
+    // before anything awaiting the write resumes
+    if (op->mKind == ASYNC_OP_PUT || op->mKind == ASYNC_OP_DEL)
+        heliumdbInvalidate (op->mHe, op->mKey.data (), op->mKey.size ());
+
+    PyObject* cancelled = PyObject_CallMethod (op->mFuture, "cancelled", NULL);
+
+    if (cancelled == Py_False)
+    {
+        PyObject* res = opResult (op);
+        PyObject* rc;
+
+        if (res != NULL)
+        {
+            rc = PyObject_CallMethod (op->mFuture, "set_result", "O", res);
+            Py_DECREF (res);
+        }
+        else
+        {
+            PyObject*   type;
+            PyObject*   value;
+            PyObject*   tb;
+
+            PyErr_Fetch (&type, &value, &tb);
+            PyErr_NormalizeException (&type, &value, &tb);
+            rc = PyObject_CallMethod (op->mFuture, "set_exception", "O", value);
+            Py_XDECREF (type);
+            Py_XDECREF (value);
+            Py_XDECREF (tb);
+        }
+        Py_XDECREF (rc);
+    }
+    Py_XDECREF (cancelled);
+    PyErr_Clear ();
+
+    op->mChannel->mInflight--;
+    delete op->mBatch;
+    Py_XDECREF (op->mDefault);
+    Py_DECREF (op->mFuture);
+    Py_DECREF (op->mHe);
+    delete op;
+}
+
+/* add_reader callback, self is a capsule holding the channel */
+static PyObject*
+drainChannel (PyObject* self, PyObject* unused)
+{
+    asyncChannel* channel = (asyncChannel*)PyCapsule_GetPointer (self, NULL);
+    if (channel == NULL)
+        return NULL;
+
+    // an eventfd resets on a single read, a pipe is drained
+    char buf[64];
+    if (channel->mReadFd == channel->mWriteFd)
+    {
+        ssize_t rc = read (channel->mReadFd, buf, 8);
+        (void)rc;
+    }
+    else
+    {
+        while (read (channel->mReadFd, buf, sizeof (buf)) > 0)
+            ;
+    }
+
+    vector<asyncOp*> done;
+    {
+        lock_guard<mutex> lock (channel->mLock);
+        done.swap (channel->mDone);
+    }
+
+    for (size_t i = 0; i < done.size (); ++i)
+        finishOp (done[i]);
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef drainDef = {"_drain", (PyCFunction)drainChannel, METH_NOARGS, NULL};
+
+static bool
+openFds (int& readFd, int& writeFd)
+{
+#ifdef __linux__
+    readFd = writeFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return readFd >= 0;
+#else
+    int fds[2];
+    if (pipe (fds) != 0)
+        return false;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        fcntl (fds[i], F_SETFL, fcntl (fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl (fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    readFd = fds[0];
+    writeFd = fds[1];
+    return true;
+#endif
+}
+
+static asyncChannel*
+runningChannel ()
+{
+    if (sGetRunningLoop == NULL)
+    {
+        PyObject* asyncio = PyImport_ImportModule ("asyncio");
+        if (asyncio == NULL)
+            return NULL;
+        sGetRunningLoop = PyObject_GetAttrString (asyncio, "get_running_loop");
+        Py_DECREF (asyncio);
+        if (sGetRunningLoop == NULL)
+            return NULL;
+    }
+
+    PyObject* loop = PyObject_CallObject (sGetRunningLoop, NULL);
+    if (loop == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < sChannels.size (); ++i)
+    {
+        if (sChannels[i]->mLoop == loop)
+        {
+            Py_DECREF (loop);
+            return sChannels[i];
+        }
+    }
+
+    pruneChannels ();
+
+    asyncChannel* channel = new asyncChannel ();
+    channel->mLoop = loop;
+    channel->mInflight = 0;
+    if (!openFds (channel->mReadFd, channel->mWriteFd))
+    {
+        PyErr_SetFromErrno (PyExc_OSError);
+        Py_DECREF (loop);
+        delete channel;
+        return NULL;
+    }
+
+    PyObject* capsule = PyCapsule_New (channel, NULL, NULL);
+    PyObject* drain = capsule ? PyCFunction_New (&drainDef, capsule) : NULL;
+    PyObject* rc = drain ?
+        PyObject_CallMethod (loop, "add_reader", "iO", channel->mReadFd, drain) : NULL;
+    Py_XDECREF (capsule);
+    Py_XDECREF (drain);
+
+    if (rc == NULL)
+    {
+        closeChannel (channel);
+        return NULL;
+    }
+    Py_DECREF (rc);
+
+    sChannels.push_back (channel);
+    return channel;
+}
+
+static bool
+copyEncoded (serializer s, PyObject* o, string& out, const char* what)
+{
+    void*   data;
+    size_t  len;
+
+    if (!s (o, data, len))
+    {
+        if (!PyErr_Occurred ())
+        {
+            char err[64];
+            snprintf (err, sizeof (err), "could not serialize %s object", what);
+            PyErr_SetString (HeliumDbException, err);
+        }
+        return false;
+    }
+
+    out.assign ((const char*)data, len);
+    return true;
+}
+
+/* create the future and queue op, takes ownership of op */
+static PyObject*
+submitOp (heliumdbPy* self, asyncOp* op)
+{
+    op->mChannel = heliumdbFlushWrites (self) ? runningChannel () : NULL;
+    op->mFuture = op->mChannel ?
+        PyObject_CallMethod (op->mChannel->mLoop, "create_future", NULL) : NULL;
+
+    if (op->mFuture == NULL)
+    {
+        delete op->mBatch;
+        Py_XDECREF (op->mDefault);
+        delete op;
+        return NULL;
+    }
+
+    Py_INCREF (self);
+    op->mHe = self;
+    op->mDatastore = self->mDatastore;
+    op->mChannel->mInflight++;
+
+    // invalidated again on completion as a get may cache the old value meanwhile
+    if (op->mKind == ASYNC_OP_PUT || op->mKind == ASYNC_OP_DEL)
+        heliumdbInvalidate (self, op->mKey.data (), op->mKey.size ());
+    if (op->mKind == ASYNC_OP_PUT)
+        heliumdbNoteKey (self, op->mKey.data (), op->mKey.size ());
+
+    Py_INCREF (op->mFuture);
+    heliumdbPool::instance ().submit ([op] { runOp (op); });
+
+    return op->mFuture;
+}
+
+static asyncOp*
+newOp (int kind)
+{
+    asyncOp* op = new asyncOp ();
+    op->mKind = kind;
+    op->mRc = -1;
+    return op;
+}
+
+PyObject*
+heliumdb_aget (heliumdbPy* self, PyObject* args)
+{
+    PyObject* k = NULL;
+    PyObject* failobj = NULL;
+
+    if (!PyArg_UnpackTuple (args, "aget", 1, 2, &k, &failobj))
+        return NULL;
+
+    asyncOp* op = newOp (ASYNC_OP_GET);
+    if (!copyEncoded (self->mKeySerializer, k, op->mKey, "key"))
+    {
+        delete op;
+        return NULL;
+    }
+
+    Py_XINCREF (failobj);
+    op->mDefault = failobj;
+
+    return submitOp (self, op);
+}
+
+PyObject*
+heliumdb_aput (heliumdbPy* self, PyObject* args)
+{
+    PyObject* k;
+    PyObject* v;
+
+    if (!PyArg_UnpackTuple (args, "aput", 2, 2, &k, &v))
+        return NULL;
+
+    asyncOp* op = newOp (ASYNC_OP_PUT);
+    if (!copyEncoded (self->mKeySerializer, k, op->mKey, "key") ||
+        !copyEncoded (self->mValSerializer, v, op->mVal, "value"))
+    {
+        delete op;
+        return NULL;
+    }
+
+    return submitOp (self, op);
+}
+
+PyObject*
+heliumdb_adelete (heliumdbPy* self, PyObject* k)
+{
+    asyncOp* op = newOp (ASYNC_OP_DEL);
+    if (!copyEncoded (self->mKeySerializer, k, op->mKey, "key"))
+    {
+        delete op;
+        return NULL;
+    }
+
+    return submitOp (self, op);
+}
+
+PyObject*
+heliumdb_aget_many (heliumdbPy* self, PyObject* args, PyObject* kwargs)
+{
+    PyObject* keys = NULL;
+    PyObject* dflt = Py_None;
+
+    char *kwlist[] = {(char*)"keys",
+                      (char*)"default",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "O|O", kwlist, &keys, &dflt))
+        return NULL;
+
+    PyObject* itr = PyObject_GetIter (keys);
+    if (itr == NULL)
+        return NULL;
+
+    asyncOp* op = newOp (ASYNC_OP_MANY);
+    op->mBatch = new heliumdbBatch (self);
+
+    PyObject* k;
+    while ((k = PyIter_Next (itr)))
+    {
+        bool staged = op->mBatch->add (k, NULL, HELIUMDB_OP_GET);
+        Py_DECREF (k);
+        if (!staged)
+        {
+            PyErr_SetString (HeliumDbException, "could not serialize key object");
+            break;
+        }
+    }
+    Py_DECREF (itr);
+
+    if (PyErr_Occurred ())
+    {
+        delete op->mBatch;
+        delete op;
+        return NULL;
+    }
+
+    Py_INCREF (dflt);
+    op->mDefault = dflt;
+
+    return submitOp (self, op);
+}
+
+PyObject*
+heliumdb_set_pool_size (PyObject* self, PyObject* args)
+{
+    int threads;
+
+    if (!PyArg_ParseTuple (args, "i", &threads))
+        return NULL;
+
+    if (threads < 1 || threads > 256)
+    {
+        PyErr_SetString (HeliumDbException, "pool size must be 1-256");
+        return NULL;
+    }
+
+    if (!heliumdbPool::configure (threads))
+    {
+        PyErr_SetString (HeliumDbException, "worker pool already started");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
@@ -0,0 +1,220 @@
+#include "backend.h"
+
+#include <errno.h>
+#include <string.h>
+
+class heliumdbHeliumCursor : public heliumdbCursor
+{
+public:
+    /* open counts the cursors of a transaction, NULL otherwise */
+    heliumdbHeliumCursor (he_iter_t itr, std::atomic<size_t>* open)
+        : mItr (itr),
+          mOpen (open)
+    {
+        if (mOpen)
+            (*mOpen)++;
+    }
+
+    ~heliumdbHeliumCursor ()
+    {
+        he_iter_close (mItr);
+        if (mOpen)
+            (*mOpen)--;
+    }
+
+    const he_item* next ()
+    {
+        return he_iter_next (mItr);
+    }
+
+private:
+    he_iter_t               mItr;
+    std::atomic<size_t>*    mOpen;
+};
+
+class heliumdbHelium : public heliumdbBackend
+{
+public:
+    heliumdbHelium (he_t he, bool transaction)
+        : mHe (he),
+          mTransaction (transaction)
+    {
+    }
+
+    ~heliumdbHelium ()
+    {
+        if (mHe == NULL)
+            return;
+
+        if (mTransaction)
+            he_discard (mHe);
+        else
+            he_close (mHe);
+    }
+
+    int lookup (he_item* item, size_t off, size_t len)
+    {
+        heliumdbTxnCall call (state ());
+        return call.ok () ? he_lookup (mHe, item, off, len) : -1;
+    }
+
+    int deleteLookup (he_item* item, size_t off, size_t len)
+    {
+        heliumdbTxnCall call (state ());
+        return call.ok () ? he_delete_lookup (mHe, item, off, len) : -1;
+    }
+
+    int prev (he_item* item, size_t off, size_t len)
+    {
+        heliumdbTxnCall call (state ());
+        return call.ok () ? he_prev (mHe, item, off, len) : -1;
+    }
+
+    int exists (const he_item* item)
+    {
+        heliumdbTxnCall call (state ());
+        return call.ok () ? he_exists (mHe, item) : -1;
+    }
+
+    int update (const he_item* item)
+    {
+        heliumdbTxnCall call (state ());
+        return call.ok () ? he_update (mHe, item) : -1;
+    }
+
+    int erase (const he_item* item)
+    {
+        heliumdbTxnCall call (state ());
+        return call.ok () ? he_delete (mHe, item) : -1;
+    }
+
+    heliumdbCursor* iterate (const void* key, size_t keyLen, size_t maxValLen)
+    {
+        heliumdbTxnCall call (state ());
+        if (!call.ok ())
+            return NULL;
+
+        he_iter_t itr = he_iter_open (mHe, key, keyLen, maxValLen, 0);
+        return itr ? new heliumdbHeliumCursor (itr, mTransaction ? &mState.mCursors : NULL)
+                   : NULL;
+    }
+
+    /* he_commit and he_discard release a transaction handle, so no call
+     * may still be running in it */
+    int commit ()
+    {
+        if (!mTransaction)
+            return he_commit (mHe);
+        if (!mState.end ())
+            return -1;
+
+        int rc = he_commit (mHe);
+        mHe = NULL;
+        return rc;
+    }
+
+    int discard ()
+    {
+        if (!mTransaction)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        if (!mState.end ())
+            return -1;
+
+        int rc = he_discard (mHe);
+        mHe = NULL;
+        return rc;
+    }
+
+    heliumdbBackend* transaction ()
+    {
+        if (mTransaction)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+
+        he_t txn = he_transaction (mHe);
+        return txn ? new heliumdbHelium (txn, true) : NULL;
+    }
+
+    int remove ()
+    {
+        heliumdbTxnCall call (state ());
+        return call.ok () ? he_remove (mHe) : -1;
+    }
+
+    int stats (struct he_stats* stats)
+    {
+        heliumdbTxnCall call (state ());
+        return call.ok () ? he_stats (mHe, stats) : -1;
+    }
+
+private:
+    heliumdbTxnState* state ()
+    {
+        return mTransaction ? &mState : NULL;
+    }
+
+    he_t                mHe;
+    bool                mTransaction;
+    heliumdbTxnState    mState;
+};
+
+class heliumdbEnded : public heliumdbBackend
+{
+public:
+    int lookup (he_item* item, size_t off, size_t len) { return ended (); }
+    int deleteLookup (he_item* item, size_t off, size_t len) { return ended (); }
+    int prev (he_item* item, size_t off, size_t len) { return ended (); }
+    int exists (const he_item* item) { return ended (); }
+    int update (const he_item* item) { return ended (); }
+    int erase (const he_item* item) { return ended (); }
+    int commit () { return ended (); }
+    int remove () { return ended (); }
+    int stats (struct he_stats* stats) { return ended (); }
+    int discard () { return ended (); }
+
+    heliumdbCursor* iterate (const void* key, size_t keyLen, size_t maxValLen)
+    {
+        ended ();
+        return NULL;
+    }
+
+    heliumdbBackend* transaction ()
+    {
+        ended ();
+        return NULL;
+    }
+
+private:
+    static int ended ()
+    {
+        errno = EBADF;
+        return -1;
+    }
+};
+
+heliumdbBackend*
+heliumdbEndedBackend ()
+{
+    return new heliumdbEnded ();
+}
+
+heliumdbBackend*
+heliumdbOpenHelium (const char* url, const char* name, int flags, he_env* env)
+{
+    he_t he = he_open (url, name, flags, env);
+    return he ? new heliumdbHelium (he, false) : NULL;
+}
+
+heliumdbBackend*
+heliumdbBackend::open (const char* url, const char* name, int flags, he_env* env)
+{
+    if (strncmp (url, "mem://", 6) == 0)
+        return heliumdbOpenMem (url, name, flags);
+
+    return heliumdbOpenHelium (url, name, flags, env);
+}
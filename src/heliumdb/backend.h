@@ -0,0 +1,148 @@
+#pragma once
+
+#include "he.h"
+
+#include <atomic>
+#include <errno.h>
+#include <stddef.h>
+#include <thread>
+
+/* items in key order from a start key, like a he_iter_t */
+class heliumdbCursor
+{
+public:
+    virtual ~heliumdbCursor () {}
+
+    /* next item, valid until the following call, NULL at the end */
+    virtual const he_item* next () = 0;
+};
+
+/*
+ * Storage engine behind a handle. Calls mirror the he_* functions they
+ * stand in for, returning 0 on success and -1 with errno set on failure,
+ * and are made without the GIL. Deleting the backend closes the datastore.
+ */
+class heliumdbBackend
+{
+public:
+    /* mem:// urls get the in-memory engine, anything else helium, NULL
+     * with errno set on failure */
+    static heliumdbBackend* open (const char* url, const char* name, int flags, he_env* env);
+
+    virtual ~heliumdbBackend () {}
+
+    virtual int lookup (he_item* item, size_t off, size_t len) = 0;
+    virtual int deleteLookup (he_item* item, size_t off, size_t len) = 0;
+    /* item before the key of item, the last item when key_len is 0 */
+    virtual int prev (he_item* item, size_t off, size_t len) = 0;
+    virtual int exists (const he_item* item) = 0;
+    virtual int update (const he_item* item) = 0;
+    virtual int erase (const he_item* item) = 0;
+
+    /* cursor from the first key >= key, values truncated to maxValLen */
+    virtual heliumdbCursor* iterate (const void* key, size_t keyLen, size_t maxValLen) = 0;
+
+    virtual int commit () = 0;
+    /* delete all items */
+    virtual int remove () = 0;
+    virtual int stats (struct he_stats* stats) = 0;
+
+    /* a transaction over this datastore, whose writes are staged and seen
+     * only through it until commit () publishes them atomically. commit ()
+     * or discard () ends it, they fail with EBUSY leaving it open while any
+     * of its cursors is, and every call after fails with EBADF */
+    virtual heliumdbBackend* transaction () = 0;
+    /* ends a transaction dropping its writes */
+    virtual int discard () = 0;
+};
+
+/*
+ * End of a transaction racing calls made without the GIL, from async ops,
+ * jobs or prefetch threads. Calls register while they run, end () stops
+ * new ones and waits for the running ones, so the transaction handle is
+ * never released under a call.
+ */
+class heliumdbTxnState
+{
+public:
+    heliumdbTxnState ()
+        : mCursors (0),
+          mActive (0),
+          mEnded (false)
+    {
+    }
+
+    /* false with EBADF once ended */
+    bool enter ()
+    {
+        mActive++;
+        if (mEnded)
+        {
+            mActive--;
+            errno = EBADF;
+            return false;
+        }
+        return true;
+    }
+
+    void leave () { mActive--; }
+
+    /* false with EBUSY, still open, while cursors are */
+    bool end ()
+    {
+        if (mEnded.exchange (true))
+        {
+            errno = EBADF;
+            return false;
+        }
+
+        while (mActive > 0)
+            std::this_thread::yield ();
+
+        // opened by calls that have all returned, none can open now
+        if (mCursors > 0)
+        {
+            mEnded = false;
+            errno = EBUSY;
+            return false;
+        }
+        return true;
+    }
+
+    /* cursors opened on the transaction and not yet deleted */
+    std::atomic<size_t> mCursors;
+
+private:
+    std::atomic<size_t> mActive;
+    std::atomic<bool>   mEnded;
+};
+
+/* scoped registration of a call, a no-op without state */
+class heliumdbTxnCall
+{
+public:
+    heliumdbTxnCall (heliumdbTxnState* state)
+        : mState (state),
+          mOk (state == NULL || state->enter ())
+    {
+    }
+
+    ~heliumdbTxnCall ()
+    {
+        if (mState && mOk)
+            mState->leave ();
+    }
+
+    bool ok () const { return mOk; }
+
+private:
+    heliumdbTxnState*   mState;
+    bool                mOk;
+};
+
+/* stands in for a transaction that has ended, every call fails with EBADF */
+heliumdbBackend* heliumdbEndedBackend ();
+
+heliumdbBackend* heliumdbOpenHelium (const char* url, const char* name, int flags, he_env* env);
+
+heliumdbBackend* heliumdbOpenMem (const char* url, const char* name, int flags);
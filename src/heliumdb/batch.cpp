@@ -0,0 +1,566 @@
+#include "batch.h"
+#include "pool.h"
+
+using namespace std;
+
+/* batches smaller than this are looked up on the calling thread */
+#define HELIUMDB_LOOKUP_CHUNK 32
+
+heliumdbBatch::heliumdbBatch (heliumdbPy* h)
+    : mHe (h),
+      mDatastore (h->mDatastore)
+{
+}
+
+heliumdbBatch::~heliumdbBatch ()
+{
+    vector<heliumdbStagedItem>::iterator itr = mItems.begin ();
+    for (; itr != mItems.end (); ++itr)
+        Py_XDECREF (itr->mKey);
+}
+
+bool
+heliumdbBatch::add (PyObject* k, PyObject* v, int op)
+{
+    heliumdbStagedItem staged;
+    memset (&staged, 0, sizeof (staged));
+    staged.mOp = op;
+
+    Py_INCREF (k);
+    staged.mKey = k;
+
+    void*   data;
+    size_t  len;
+    if (!mHe->mKeySerializer (k, data, len))
+    {
+        PyErr_Clear ();
+        staged.mRc = HELIUMDB_SERIALIZE_FAILED;
+        mItems.push_back (staged);
+        return false;
+    }
+    staged.mKeyOffset = mBuffer.size ();
+    staged.mKeyLen = len;
+    mBuffer.append ((const char*)data, len);
+
+    if (v != NULL)
+    {
+        if (!mHe->mValSerializer (v, data, len))
+        {
+            PyErr_Clear ();
+            staged.mRc = HELIUMDB_SERIALIZE_FAILED;
+            mItems.push_back (staged);
+            return false;
+        }
+        staged.mValOffset = mBuffer.size ();
+        staged.mValLen = len;
+        mBuffer.append ((const char*)data, len);
+    }
+
+    mItems.push_back (staged);
+    return true;
+}
+
+void
+heliumdbBatch::item (size_t i, he_item& item)
+{
+    heliumdbStagedItem& staged = mItems[i];
+
+    item.key = (void*)(mBuffer.data () + staged.mKeyOffset);
+    item.key_len = staged.mKeyLen;
+    item.val = (void*)(mBuffer.data () + staged.mValOffset);
+    item.val_len = staged.mValLen;
+}
+
+size_t
+heliumdbBatch::update ()
+{
+    size_t  written = 0;
+    he_item item;
+
+    for (size_t i = 0; i < mItems.size (); ++i)
+    {
+        heliumdbStagedItem& staged = mItems[i];
+        if (staged.mRc == HELIUMDB_SERIALIZE_FAILED)
+            continue;
+
+        this->item (i, item);
+        heliumdbNoteKey (mHe, item.key, item.key_len);
+        staged.mRc = mDatastore->update (&item);
+        if (staged.mRc != 0)
+            staged.mErrno = errno;
+        else
+            written++;
+    }
+
+    return written;
+}
+
+void
+heliumdbBatch::lookup ()
+{
+    mValues.resize (mItems.size ());
+
+    heliumdbPool::instance ().parallelFor (
+        mItems.size (),
+        HELIUMDB_LOOKUP_CHUNK,
+        [this] (size_t begin, size_t end) {
+            heliumdbBuffer  buffer (mHe->mArena);
+            he_item         item;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                heliumdbStagedItem& staged = mItems[i];
+                if (staged.mRc == HELIUMDB_SERIALIZE_FAILED)
+                    continue;
+
+                this->item (i, item);
+                if (heliumdbBloomMiss (mHe, item.key, item.key_len))
+                {
+                    staged.mRc = -1;
+                    staged.mErrno = ENOENT;
+                    continue;
+                }
+
+                staged.mRc = buffer.lookup (mDatastore, item, false);
+                if (staged.mRc != 0)
+                    staged.mErrno = errno;
+                else
+                    mValues[i].assign ((const char*)item.val, item.val_len);
+            }
+        });
+}
+
+PyObject*
+heliumdbBatch::values (PyObject* dflt)
+{
+    PyObject* res = PyList_New (mItems.size ());
+    if (res == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < mItems.size (); ++i)
+    {
+        PyObject* val;
+        if (mItems[i].mRc == HELIUMDB_SERIALIZE_FAILED)
+        {
+            PyErr_SetString (HeliumDbException, "could not serialize key object");
+            Py_DECREF (res);
+            return NULL;
+        }
+        else if (mItems[i].mRc != 0)
+        {
+            Py_INCREF (dflt);
+            val = dflt;
+        }
+        else
+        {
+            val = mHe->mValDeserializer ((void*)mValues[i].data (), mValues[i].size ());
+            if (val == NULL)
+            {
+                PyErr_SetString (HeliumDbException, "failed to deserialize value object");
+                Py_DECREF (res);
+                return NULL;
+            }
+        }
+        PyList_SET_ITEM (res, i, val);
+    }
+
+    return res;
+}
+
+void
+heliumdbBatch::execute ()
+{
+    heliumdbBuffer  buffer (mHe->mArena);
+    he_item         item;
+
+    mValues.resize (mItems.size ());
+    for (size_t i = 0; i < mItems.size (); ++i)
+    {
+        heliumdbStagedItem& staged = mItems[i];
+
+        this->item (i, item);
+        switch (staged.mOp)
+        {
+        case HELIUMDB_OP_PUT:
+            heliumdbNoteKey (mHe, item.key, item.key_len);
+            staged.mRc = mDatastore->update (&item);
+            break;
+        case HELIUMDB_OP_EXISTS:
+            staged.mRc = mDatastore->exists (&item);
+            break;
+        case HELIUMDB_OP_GET:
+        case HELIUMDB_OP_DEL:
+            staged.mRc = buffer.lookup (mDatastore,
+                                        item,
+                                        staged.mOp == HELIUMDB_OP_DEL);
+            if (staged.mRc == 0)
+                mValues[i].assign ((const char*)item.val, item.val_len);
+            break;
+        }
+
+        if (staged.mRc != 0)
+            staged.mErrno = errno;
+    }
+}
+
+PyObject*
+heliumdbBatch::results ()
+{
+    PyObject* res = PyList_New (mItems.size ());
+    if (res == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < mItems.size (); ++i)
+    {
+        heliumdbStagedItem& staged = mItems[i];
+        PyObject*           val;
+
+        if (staged.mOp == HELIUMDB_OP_PUT || staged.mOp == HELIUMDB_OP_EXISTS)
+        {
+            val = PyBool_FromLong (staged.mRc == 0);
+        }
+        else if (staged.mRc != 0)
+        {
+            Py_INCREF (Py_None);
+            val = Py_None;
+        }
+        else
+        {
+            val = mHe->mValDeserializer ((void*)mValues[i].data (), mValues[i].size ());
+            if (val == NULL)
+            {
+                PyErr_SetString (HeliumDbException, "failed to deserialize value object");
+                Py_DECREF (res);
+                return NULL;
+            }
+        }
+        PyList_SET_ITEM (res, i, val);
+    }
+
+    return res;
+}
+
+size_t
+heliumdbBatch::failed () const
+{
+    size_t count = 0;
+
+    vector<heliumdbStagedItem>::const_iterator itr = mItems.begin ();
+    for (; itr != mItems.end (); ++itr)
+    {
+        if (itr->mRc != 0)
+            count++;
+    }
+
+    return count;
+}
+
+static void
+formatError (const heliumdbStagedItem& staged, char* err, size_t len)
+{
+    if (staged.mRc == HELIUMDB_SERIALIZE_FAILED)
+        snprintf (err, len, "could not serialize object");
+    else
+        snprintf (err, len, "he_update failed: %s", he_strerror (staged.mErrno));
+}
+
+PyObject*
+heliumdbBatch::errors () const
+{
+    PyObject* res = PyList_New (0);
+    if (res == NULL)
+        return NULL;
+
+    char err[128];
+    vector<heliumdbStagedItem>::const_iterator itr = mItems.begin ();
+    for (; itr != mItems.end (); ++itr)
+    {
+        if (itr->mRc == 0)
+            continue;
+
+        formatError (*itr, err, sizeof (err));
+        PyObject* entry = Py_BuildValue ("(Os)", itr->mKey, err);
+        if (entry == NULL || PyList_Append (res, entry) < 0)
+        {
+            Py_XDECREF (entry);
+            Py_DECREF (res);
+            return NULL;
+        }
+        Py_DECREF (entry);
+    }
+
+    return res;
+}
+
+static bool
+stagePairs (heliumdbBatch& batch, PyObject* pairs)
+{
+    PyObject* itr = PyObject_GetIter (pairs);
+    if (itr == NULL)
+        return false;
+
+    PyObject* pair;
+    while ((pair = PyIter_Next (itr)))
+    {
+        PyObject* seq = PySequence_Fast (pair, "batch items must be (key, value) pairs");
+        Py_DECREF (pair);
+        if (seq == NULL)
+        {
+            Py_DECREF (itr);
+            return false;
+        }
+
+        if (PySequence_Fast_GET_SIZE (seq) != 2)
+        {
+            PyErr_SetString (PyExc_ValueError, "batch items must be (key, value) pairs");
+            Py_DECREF (seq);
+            Py_DECREF (itr);
+            return false;
+        }
+
+        batch.add (PySequence_Fast_GET_ITEM (seq, 0),
+                   PySequence_Fast_GET_ITEM (seq, 1));
+        Py_DECREF (seq);
+    }
+    Py_DECREF (itr);
+
+    return !PyErr_Occurred ();
+}
+
+static bool
+stageMapping (heliumdbBatch& batch, PyObject* mapping)
+{
+    if (PyDict_Check (mapping))
+    {
+        PyObject*   k;
+        PyObject*   v;
+        Py_ssize_t  pos = 0;
+
+        while (PyDict_Next (mapping, &pos, &k, &v))
+            batch.add (k, v);
+
+        return true;
+    }
+
+    if (!PyObject_HasAttrString (mapping, "keys"))
+        return stagePairs (batch, mapping);
+
+    PyObject* keys = PyMapping_Keys (mapping);
+    if (keys == NULL)
+        return false;
+
+    PyObject* itr = PyObject_GetIter (keys);
+    Py_DECREF (keys);
+    if (itr == NULL)
+        return false;
+
+    PyObject* k;
+    while ((k = PyIter_Next (itr)))
+    {
+        PyObject* v = PyObject_GetItem (mapping, k);
+        if (v == NULL)
+        {
+            Py_DECREF (k);
+            Py_DECREF (itr);
+            return false;
+        }
+        batch.add (k, v);
+        Py_DECREF (k);
+        Py_DECREF (v);
+    }
+    Py_DECREF (itr);
+
+    return !PyErr_Occurred ();
+}
+
+PyObject*
+heliumdb_put_many (heliumdbPy* self, PyObject* pairs)
+{
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    heliumdbBatch batch (self);
+
+    if (!stagePairs (batch, pairs))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    batch.update ();
+    Py_END_ALLOW_THREADS
+
+    heliumdbInvalidate (self, NULL, 0);
+
+    return batch.errors ();
+}
+
+PyObject*
+heliumdb_get_many (heliumdbPy* self, PyObject* args, PyObject* kwargs)
+{
+    PyObject* keys = NULL;
+    PyObject* dflt = Py_None;
+
+    char *kwlist[] = {(char*)"keys",
+                      (char*)"default",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "O|O", kwlist, &keys, &dflt))
+        return NULL;
+
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    heliumdbBatch batch (self);
+
+    PyObject* itr = PyObject_GetIter (keys);
+    if (itr == NULL)
+        return NULL;
+
+    PyObject* k;
+    while ((k = PyIter_Next (itr)))
+    {
+        bool staged = batch.add (k, NULL, HELIUMDB_OP_GET);
+        Py_DECREF (k);
+        if (!staged)
+        {
+            PyErr_SetString (HeliumDbException, "could not serialize key object");
+            Py_DECREF (itr);
+            return NULL;
+        }
+    }
+    Py_DECREF (itr);
+
+    if (PyErr_Occurred ())
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    batch.lookup ();
+    Py_END_ALLOW_THREADS
+
+    return batch.values (dflt);
+}
+
+static int
+parseOp (PyObject* name)
+{
+    if (!PyUnicode_Check (name))
+        return -1;
+
+    if (PyUnicode_CompareWithASCIIString (name, "get") == 0)
+        return HELIUMDB_OP_GET;
+    if (PyUnicode_CompareWithASCIIString (name, "put") == 0)
+        return HELIUMDB_OP_PUT;
+    if (PyUnicode_CompareWithASCIIString (name, "del") == 0)
+        return HELIUMDB_OP_DEL;
+    if (PyUnicode_CompareWithASCIIString (name, "exists") == 0)
+        return HELIUMDB_OP_EXISTS;
+
+    return -1;
+}
+
+PyObject*
+heliumdb_execute (heliumdbPy* self, PyObject* ops)
+{
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    heliumdbBatch batch (self);
+
+    PyObject* itr = PyObject_GetIter (ops);
+    if (itr == NULL)
+        return NULL;
+
+    PyObject* entry;
+    while ((entry = PyIter_Next (itr)))
+    {
+        PyObject* seq = PySequence_Fast (entry, "operations must be tuples");
+        Py_DECREF (entry);
+        if (seq == NULL)
+        {
+            Py_DECREF (itr);
+            return NULL;
+        }
+
+        Py_ssize_t  len = PySequence_Fast_GET_SIZE (seq);
+        int         op = len > 0 ? parseOp (PySequence_Fast_GET_ITEM (seq, 0)) : -1;
+
+        if (op < 0 || len != (op == HELIUMDB_OP_PUT ? 3 : 2))
+        {
+            PyErr_SetString (PyExc_ValueError,
+                             "operations must be ('get', k), ('put', k, v), "
+                             "('del', k) or ('exists', k)");
+            Py_DECREF (seq);
+            Py_DECREF (itr);
+            return NULL;
+        }
+
+        if (!batch.add (PySequence_Fast_GET_ITEM (seq, 1),
+                        op == HELIUMDB_OP_PUT ? PySequence_Fast_GET_ITEM (seq, 2) : NULL,
+                        op))
+        {
+            PyErr_SetString (HeliumDbException, "could not serialize object");
+            Py_DECREF (seq);
+            Py_DECREF (itr);
+            return NULL;
+        }
+        Py_DECREF (seq);
+    }
+    Py_DECREF (itr);
+
+    if (PyErr_Occurred ())
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    batch.execute ();
+    Py_END_ALLOW_THREADS
+
+    heliumdbInvalidate (self, NULL, 0);
+
+    return batch.results ();
+}
+
+PyObject*
+heliumdb_update (heliumdbPy* self, PyObject* mapping)
+{
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    heliumdbBatch batch (self);
+
+    if (!stageMapping (batch, mapping))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    batch.update ();
+    Py_END_ALLOW_THREADS
+
+    heliumdbInvalidate (self, NULL, 0);
+
+    size_t failed = batch.failed ();
+    if (failed > 0)
+    {
+        char err[256];
+        char first[128] = {0};
+
+        vector<heliumdbStagedItem>::const_iterator itr = batch.items ().begin ();
+        for (; itr != batch.items ().end (); ++itr)
+        {
+            if (itr->mRc != 0)
+            {
+                formatError (*itr, first, sizeof (first));
+                break;
+            }
+        }
+
+        snprintf (err,
+                  sizeof (err),
+                  "update failed for %zu of %zu items: %s",
+                  failed,
+                  batch.size (),
+                  first);
+        PyErr_SetString (HeliumDbException, err);
+        return NULL;
+    }
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
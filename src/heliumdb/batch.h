@@ -0,0 +1,78 @@
+#pragma once
+
+#include "module.h"
+
+/*
+ * A batch of serialized items staged in native memory.
+ *
+ * The key/value serializers hand back pointers into thread local or python
+ * owned storage, so each item is copied into one contiguous buffer before the
+ * GIL is released and the batch is applied to the datastore.
+ */
+typedef struct
+{
+    size_t      mKeyOffset;
+    size_t      mKeyLen;
+    size_t      mValOffset;
+    size_t      mValLen;
+    PyObject*   mKey;
+    int         mOp;
+    int         mRc;
+    int         mErrno;
+} heliumdbStagedItem;
+
+/* mRc value of an item whose key or value could not be serialized */
+#define HELIUMDB_SERIALIZE_FAILED -2
+
+/* operations a staged item can carry */
+#define HELIUMDB_OP_PUT     0
+#define HELIUMDB_OP_GET     1
+#define HELIUMDB_OP_DEL     2
+#define HELIUMDB_OP_EXISTS  3
+
+class heliumdbBatch
+{
+public:
+    heliumdbBatch (heliumdbPy* h);
+
+    ~heliumdbBatch ();
+
+    /* serialize and stage k/v, v may be NULL for key only operations */
+    bool add (PyObject* k, PyObject* v, int op = HELIUMDB_OP_PUT);
+
+    /* issue he_update for every staged item, must be called without the GIL */
+    size_t update ();
+
+    /* he_lookup every staged key, fanning out over the worker pool for
+     * large batches, must be called without the GIL */
+    void lookup ();
+
+    /* list of looked up values in staging order, dflt for missing keys */
+    PyObject* values (PyObject* dflt);
+
+    /* run every staged operation in order on the calling thread, must be
+     * called without the GIL */
+    void execute ();
+
+    /* list with one result per executed operation */
+    PyObject* results ();
+
+    /* list of (key, error) tuples for every item that failed */
+    PyObject* errors () const;
+
+    size_t size () const { return mItems.size (); }
+
+    size_t failed () const;
+
+    void item (size_t i, he_item& item);
+
+    std::vector<heliumdbStagedItem>& items () { return mItems; }
+
+private:
+    heliumdbPy*                     mHe;
+    /* captured under the GIL, a transaction may end while the batch runs */
+    heliumdbBackend*                mDatastore;
+    std::string                     mBuffer;
+    std::vector<heliumdbStagedItem> mItems;
+    std::vector<std::string>        mValues;
+};
@@ -0,0 +1,216 @@
+#include "bloom.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+#define BLOOM_BITS_PER_KEY  10
+#define BLOOM_HASHES        7
+#define BLOOM_BLOCK_BITS    512
+
+static const char BLOOM_MAGIC[8] = {'H', 'E', 'B', 'L', 'O', 'O', 'M', '2'};
+
+typedef struct
+{
+    char        mMagic[8];
+    uint64_t    mBlocks;
+    uint64_t    mValidItems;
+    uint64_t    mDeletedItems;
+    uint64_t    mUtilized;
+} bloomHeader;
+
+static bool
+sameStamp (const bloomHeader& header, const struct he_stats& stats)
+{
+    return header.mValidItems == stats.valid_items &&
+           header.mDeletedItems == stats.deleted_items &&
+           header.mUtilized == stats.utilized;
+}
+
+static inline uint64_t
+mix (uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t
+hashKey (const void* key, size_t len)
+{
+    const unsigned char*    p = (const unsigned char*)key;
+    uint64_t                h = 0x9e3779b97f4a7c15ULL ^ (len * 0xc2b2ae3d27d4eb4fULL);
+    uint64_t                w;
+
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        memcpy (&w, p, 8);
+        h = mix (h ^ w) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    w = 0;
+    memcpy (&w, p, len);
+    return mix (h ^ w);
+}
+
+heliumdbBloom::heliumdbBloom (uint64_t expected)
+    : mAvoided (0),
+      mMaybe (0),
+      mFalsePositives (0),
+      mLoaded (false),
+      mData (NULL),
+      mBlocks (0)
+{
+    allocate ((expected * BLOOM_BITS_PER_KEY + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS);
+}
+
+heliumdbBloom::~heliumdbBloom ()
+{
+    delete[] mData;
+}
+
+void
+heliumdbBloom::allocate (size_t blocks)
+{
+    delete[] mData;
+    mBlocks = blocks > 0 ? blocks : 1;
+    mData = new block[mBlocks];
+    clear ();
+}
+
+/* block from the high half of the hash, bit positions by double hashing the
+ * remixed low half */
+#define BLOOM_PROBE(h, blk, h1, h2)                                     \
+    const block& blk = mData[(size_t)(((h) >> 32) * mBlocks >> 32)];    \
+    uint32_t h1 = (uint32_t)mix (h);                                    \
+    uint32_t h2 = (uint32_t)(mix (h) >> 32) | 1
+
+void
+heliumdbBloom::add (const void* key, size_t keyLen)
+{
+    uint64_t h = hashKey (key, keyLen);
+    BLOOM_PROBE (h, blk, h1, h2);
+
+    block& b = const_cast<block&> (blk);
+    for (int i = 0; i < BLOOM_HASHES; ++i)
+    {
+        uint32_t bit = (h1 + i * h2) % BLOOM_BLOCK_BITS;
+        uint64_t mask = 1ULL << (bit & 63);
+
+        if (!(b.mWords[bit >> 6].load (memory_order_relaxed) & mask))
+            b.mWords[bit >> 6].fetch_or (mask, memory_order_relaxed);
+    }
+}
+
+bool
+heliumdbBloom::mayContain (const void* key, size_t keyLen) const
+{
+    uint64_t h = hashKey (key, keyLen);
+    BLOOM_PROBE (h, blk, h1, h2);
+
+    for (int i = 0; i < BLOOM_HASHES; ++i)
+    {
+        uint32_t bit = (h1 + i * h2) % BLOOM_BLOCK_BITS;
+        if (!(blk.mWords[bit >> 6].load (memory_order_relaxed) & (1ULL << (bit & 63))))
+            return false;
+    }
+
+    return true;
+}
+
+void
+heliumdbBloom::clear ()
+{
+    for (size_t i = 0; i < mBlocks; ++i)
+    {
+        for (int j = 0; j < 8; ++j)
+            mData[i].mWords[j].store (0, memory_order_relaxed);
+    }
+}
+
+bool
+heliumdbBloom::build (heliumdbBackend* ds)
+{
+    heliumdbCursor* itr = ds->iterate (NULL, 0, 0);
+    if (itr == NULL)
+        return false;
+
+    const he_item* item;
+    while ((item = itr->next ()))
+        add (item->key, item->key_len);
+    delete itr;
+
+    return true;
+}
+
+bool
+heliumdbBloom::load (const string& path, const struct he_stats& stats)
+{
+    FILE* f = fopen (path.c_str (), "rb");
+    if (f == NULL)
+        return false;
+
+    bloomHeader header;
+    bool        ok = fread (&header, sizeof (header), 1, f) == 1 &&
+                     memcmp (header.mMagic, BLOOM_MAGIC, sizeof (BLOOM_MAGIC)) == 0 &&
+                     sameStamp (header, stats) &&
+                     header.mBlocks > 0 && header.mBlocks < ((uint64_t)1 << 32);
+
+    if (ok)
+    {
+        allocate (header.mBlocks);
+
+        uint64_t words[8];
+        for (size_t i = 0; ok && i < mBlocks; ++i)
+        {
+            ok = fread (words, sizeof (words), 1, f) == 1;
+            for (int j = 0; ok && j < 8; ++j)
+                mData[i].mWords[j].store (words[j], memory_order_relaxed);
+        }
+
+        if (!ok)
+            clear ();
+    }
+    fclose (f);
+
+    return ok;
+}
+
+bool
+heliumdbBloom::save (const string& path, const struct he_stats& stats) const
+{
+    // write a temporary and rename so a crash never leaves a torn sidecar
+    string  tmp = path + ".tmp";
+    FILE*   f = fopen (tmp.c_str (), "wb");
+    if (f == NULL)
+        return false;
+
+    bloomHeader header;
+    memcpy (header.mMagic, BLOOM_MAGIC, sizeof (BLOOM_MAGIC));
+    header.mBlocks = mBlocks;
+    header.mValidItems = stats.valid_items;
+    header.mDeletedItems = stats.deleted_items;
+    header.mUtilized = stats.utilized;
+
+    bool ok = fwrite (&header, sizeof (header), 1, f) == 1;
+
+    uint64_t words[8];
+    for (size_t i = 0; ok && i < mBlocks; ++i)
+    {
+        for (int j = 0; j < 8; ++j)
+            words[j] = mData[i].mWords[j].load (memory_order_relaxed);
+        ok = fwrite (words, sizeof (words), 1, f) == 1;
+    }
+
+    ok = fclose (f) == 0 && ok;
+    if (ok)
+        ok = rename (tmp.c_str (), path.c_str ()) == 0;
+    else
+        remove (tmp.c_str ());
+
+    return ok;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+#include "backend.h"
+
+/*
+ * Blocked Bloom filter over the encoded keys of a handle opened with
+ * bloom_filter=N, consulted before any store call of a point read.
+ *
+ * Each key sets BLOOM_HASHES bits of a single 64 byte block so a probe
+ * touches one cache line. Keys are added before they are written and never
+ * removed, so a negative answer is exact while a positive one still goes to
+ * the store. Bits are set atomically and may be added from any thread.
+ *
+ * Only writes made through the handle and its transactions are seen, so it
+ * must be the only writer of the datastore while open. Other handles or
+ * processes writing to it make get and in report keys they wrote missing.
+ * The same holds between saving a sidecar and loading it, its stamp only
+ * catches changes to the item counts or the space used.
+ */
+class heliumdbBloom
+{
+public:
+    /* sized for expected keys at about 1% false positives */
+    heliumdbBloom (uint64_t expected);
+
+    ~heliumdbBloom ();
+
+    void add (const void* key, size_t keyLen);
+
+    bool mayContain (const void* key, size_t keyLen) const;
+
+    void clear ();
+
+    /* add every key of the datastore */
+    bool build (heliumdbBackend* ds);
+
+    /* replace the filter with a sidecar written by save, false if the file
+     * is missing, malformed or stamped with different stats */
+    bool load (const std::string& path, const struct he_stats& stats);
+
+    bool save (const std::string& path, const struct he_stats& stats) const;
+
+    size_t bytes () const { return mBlocks * sizeof (block); }
+
+    /* lookups answered by the filter, passed on, and passed on for a key
+     * that was not found */
+    std::atomic<uint64_t>   mAvoided;
+    std::atomic<uint64_t>   mMaybe;
+    std::atomic<uint64_t>   mFalsePositives;
+
+    /* sidecar saved on close when opened with bloom_file */
+    std::string             mFile;
+    bool                    mLoaded;
+
+private:
+    typedef struct
+    {
+        std::atomic<uint64_t>   mWords[8];
+    } block;
+
+    void allocate (size_t blocks);
+
+    block*  mData;
+    size_t  mBlocks;
+};
@@ -0,0 +1,381 @@
+#include "utils.h"
+#include "exception.h"
+#include "codec.h"
+#include <string>
+
+/* nesting deeper than this is handed to pickle which copes with cycles */
+#define MAX_NATIVE_DEPTH 64
+
+void
+nativePutVarint (std::string& out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back ((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back ((char)v);
+}
+
+bool
+nativeGetVarint (const unsigned char*& p, const unsigned char* end, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p >= end)
+            return false;
+
+        unsigned char b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+static bool
+encodePickle (PyObject* o, std::string& out)
+{
+    PyObject* pickled = pickleDumps (o);
+    if (pickled == NULL)
+        return false;
+
+    char*       data;
+    Py_ssize_t  len;
+    if (PyBytes_AsStringAndSize (pickled, &data, &len) == -1)
+    {
+        Py_DECREF (pickled);
+        return false;
+    }
+
+    out.push_back (TAG_PICKLE);
+    nativePutVarint (out, len);
+    out.append (data, len);
+    Py_DECREF (pickled);
+
+    return true;
+}
+
+static bool
+encodeLong (PyObject* o, std::string& out)
+{
+    int         overflow;
+    long long   v = PyLong_AsLongLongAndOverflow (o, &overflow);
+
+    if (!overflow)
+    {
+        if (v == -1 && PyErr_Occurred ())
+            return false;
+
+        out.push_back (TAG_INT);
+        nativePutVarint (out, nativeZigzag (v));
+        return true;
+    }
+
+    size_t          len = _PyLong_NumBits (o) / 8 + 1;
+    std::string     bytes (len, '\0');
+#if PY_VERSION_HEX >= 0x030D0000
+    if (_PyLong_AsByteArray ((PyLongObject*)o, (unsigned char*)&bytes[0], len, 1, 1, 1) < 0)
+#else
+    if (_PyLong_AsByteArray ((PyLongObject*)o, (unsigned char*)&bytes[0], len, 1, 1) < 0)
+#endif
+        return false;
+
+    out.push_back (TAG_BIGINT);
+    nativePutVarint (out, len);
+    out.append (bytes);
+
+    return true;
+}
+
+static bool
+containerChanged ()
+{
+    PyErr_SetString (PyExc_RuntimeError, "container changed size during serialization");
+    return false;
+}
+
+static bool
+encode (PyObject* o, std::string& out, int depth)
+{
+    if (o == Py_None)
+    {
+        out.push_back (TAG_NONE);
+        return true;
+    }
+
+    if (o == Py_True || o == Py_False)
+    {
+        out.push_back (o == Py_True ? TAG_TRUE : TAG_FALSE);
+        return true;
+    }
+
+    if (PyLong_CheckExact (o))
+        return encodeLong (o, out);
+
+    if (PyFloat_CheckExact (o))
+    {
+        double v = PyFloat_AS_DOUBLE (o);
+        out.push_back (TAG_FLOAT);
+        out.append ((const char*)&v, sizeof (v));
+        return true;
+    }
+
+    if (PyUnicode_CheckExact (o))
+    {
+        Py_ssize_t  len;
+        const char* data = PyUnicode_AsUTF8AndSize (o, &len);
+        if (data == NULL)
+        {
+            // lone surrogates have no UTF-8 form, pickle keeps them
+            if (!PyErr_ExceptionMatches (PyExc_UnicodeEncodeError))
+                return false;
+            PyErr_Clear ();
+            return encodePickle (o, out);
+        }
+
+        out.push_back (TAG_STR);
+        nativePutVarint (out, len);
+        out.append (data, len);
+        return true;
+    }
+
+    if (PyBytes_CheckExact (o))
+    {
+        out.push_back (TAG_BYTES);
+        nativePutVarint (out, PyBytes_GET_SIZE (o));
+        out.append (PyBytes_AS_STRING (o), PyBytes_GET_SIZE (o));
+        return true;
+    }
+
+    if (depth >= MAX_NATIVE_DEPTH)
+        return encodePickle (o, out);
+
+    if (PyTuple_CheckExact (o) || PyList_CheckExact (o))
+    {
+        Py_ssize_t len = PySequence_Fast_GET_SIZE (o);
+        out.push_back (PyTuple_CheckExact (o) ? TAG_TUPLE : TAG_LIST);
+        nativePutVarint (out, len);
+
+        // pickling an element may run python code that changes the list,
+        // so each item is held across its encode and the size rechecked
+        for (Py_ssize_t i = 0; i < len; ++i)
+        {
+            if (PySequence_Fast_GET_SIZE (o) != len)
+                return containerChanged ();
+
+            PyObject* item = PySequence_Fast_GET_ITEM (o, i);
+            Py_INCREF (item);
+            bool ok = encode (item, out, depth + 1);
+            Py_DECREF (item);
+            if (!ok)
+                return false;
+        }
+        return PySequence_Fast_GET_SIZE (o) == len || containerChanged ();
+    }
+
+    if (PyDict_CheckExact (o))
+    {
+        PyObject*   k;
+        PyObject*   v;
+        Py_ssize_t  pos = 0;
+
+        Py_ssize_t  len = PyDict_GET_SIZE (o);
+        Py_ssize_t  n = 0;
+
+        out.push_back (TAG_DICT);
+        nativePutVarint (out, len);
+        while (PyDict_Next (o, &pos, &k, &v))
+        {
+            Py_INCREF (k);
+            Py_INCREF (v);
+            bool ok = encode (k, out, depth + 1) && encode (v, out, depth + 1);
+            Py_DECREF (k);
+            Py_DECREF (v);
+            if (!ok)
+                return false;
+            if (PyDict_GET_SIZE (o) != len)
+                return containerChanged ();
+            n++;
+        }
+        return n == len || containerChanged ();
+    }
+
+    return encodePickle (o, out);
+}
+
+static PyObject*
+decodeError ()
+{
+    if (!PyErr_Occurred ())
+        PyErr_SetString (HeliumDbException, "malformed native encoded object");
+    return NULL;
+}
+
+/* containers are nested at most MAX_NATIVE_DEPTH deep by encode, deeper
+ * ones can only come from corrupt data and would exhaust the stack */
+static PyObject*
+decode (const unsigned char*& p, const unsigned char* end, int depth)
+{
+    if (p >= end)
+        return decodeError ();
+
+    uint64_t len;
+    unsigned char tag = *p++;
+    switch (tag)
+    {
+    case TAG_NONE:
+        Py_INCREF (Py_None);
+        return Py_None;
+
+    case TAG_FALSE:
+    case TAG_TRUE:
+        return PyBool_FromLong (tag == TAG_TRUE);
+
+    case TAG_INT:
+    {
+        if (!nativeGetVarint (p, end, len))
+            return decodeError ();
+
+        return PyLong_FromLongLong (nativeUnzigzag (len));
+    }
+
+    case TAG_FLOAT:
+    {
+        double v;
+        if ((size_t)(end - p) < sizeof (v))
+            return decodeError ();
+
+        memcpy (&v, p, sizeof (v));
+        p += sizeof (v);
+        return PyFloat_FromDouble (v);
+    }
+
+    case TAG_BIGINT:
+    case TAG_STR:
+    case TAG_BYTES:
+    case TAG_PICKLE:
+    {
+        if (!nativeGetVarint (p, end, len) || (uint64_t)(end - p) < len)
+            return decodeError ();
+
+        const unsigned char* data = p;
+        p += len;
+
+        if (tag == TAG_BIGINT)
+            return _PyLong_FromByteArray (data, len, 1, 1);
+        if (tag == TAG_STR)
+            return PyUnicode_DecodeUTF8 ((const char*)data, len, NULL);
+        if (tag == TAG_BYTES)
+            return PyBytes_FromStringAndSize ((const char*)data, len);
+
+        return pickleLoads ((const char*)data, len);
+    }
+
+    case TAG_TUPLE:
+    case TAG_LIST:
+    {
+        if (depth >= MAX_NATIVE_DEPTH)
+            return decodeError ();
+        if (!nativeGetVarint (p, end, len) || (uint64_t)(end - p) < len)
+            return decodeError ();
+
+        PyObject* res = tag == TAG_TUPLE ? PyTuple_New (len) : PyList_New (len);
+        if (res == NULL)
+            return NULL;
+
+        for (uint64_t i = 0; i < len; ++i)
+        {
+            PyObject* item = decode (p, end, depth + 1);
+            if (item == NULL)
+            {
+                Py_DECREF (res);
+                return NULL;
+            }
+
+            if (tag == TAG_TUPLE)
+                PyTuple_SET_ITEM (res, i, item);
+            else
+                PyList_SET_ITEM (res, i, item);
+        }
+        return res;
+    }
+
+    case TAG_DICT:
+    {
+        if (depth >= MAX_NATIVE_DEPTH)
+            return decodeError ();
+        if (!nativeGetVarint (p, end, len) || (uint64_t)(end - p) < len)
+            return decodeError ();
+
+        PyObject* res = PyDict_New ();
+        if (res == NULL)
+            return NULL;
+
+        for (uint64_t i = 0; i < len; ++i)
+        {
+            PyObject* k = decode (p, end, depth + 1);
+            PyObject* v = k ? decode (p, end, depth + 1) : NULL;
+            if (v == NULL || PyDict_SetItem (res, k, v) < 0)
+            {
+                Py_XDECREF (k);
+                Py_XDECREF (v);
+                Py_DECREF (res);
+                return NULL;
+            }
+            Py_DECREF (k);
+            Py_DECREF (v);
+        }
+        return res;
+    }
+    }
+
+    return decodeError ();
+}
+
+static bool
+serializeNative (PyObject* o, std::string& buffer, void*& v, size_t& l)
+{
+    buffer.clear ();
+    if (!encode (o, buffer, 0))
+        return false;
+
+    v = (void*)buffer.data ();
+    l = buffer.size ();
+
+    return true;
+}
+
+bool
+serializeNativeKey (PyObject* o, void*& v, size_t& l)
+{
+    static thread_local std::string res;
+
+    return serializeNative (o, res, v, l);
+}
+
+bool
+serializeNativeVal (PyObject* o, void*& v, size_t& l)
+{
+    static thread_local std::string res;
+
+    return serializeNative (o, res, v, l);
+}
+
+PyObject*
+deserializeNative (void* buf, size_t len)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*> (buf);
+    const unsigned char* end = p + len;
+
+    PyObject* res = decode (p, end, 0);
+    if (res != NULL && p != end)
+    {
+        Py_DECREF (res);
+        return decodeError ();
+    }
+
+    return res;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+/*
+ * Compact tagged binary encoding for the 'N' key/val type.
+ *
+ * Every value is a one byte tag followed by its payload, lengths and small
+ * integers are varints. Containers are encoded recursively, anything that is
+ * not one of the builtin types below is stored as a pickle blob.
+ */
+enum
+{
+    TAG_NONE    = 0x00,
+    TAG_FALSE   = 0x01,
+    TAG_TRUE    = 0x02,
+    TAG_INT     = 0x03,
+    TAG_BIGINT  = 0x04,
+    TAG_FLOAT   = 0x05,
+    TAG_STR     = 0x06,
+    TAG_BYTES   = 0x07,
+    TAG_TUPLE   = 0x08,
+    TAG_LIST    = 0x09,
+    TAG_DICT    = 0x0a,
+    TAG_PICKLE  = 0x0b
+};
+
+void nativePutVarint (std::string& out, uint64_t v);
+
+bool nativeGetVarint (const unsigned char*& p, const unsigned char* end, uint64_t& v);
+
+/* zigzag mapping used by TAG_INT so small negative numbers stay short */
+inline uint64_t
+nativeZigzag (int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+inline int64_t
+nativeUnzigzag (uint64_t v)
+{
+    return (int64_t)((v >> 1) ^ (~(v & 1) + 1));
+}
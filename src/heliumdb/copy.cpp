@@ -0,0 +1,194 @@
+#include "module.h"
+#include "keyrange.h"
+#include "job.h"
+
+#include <thread>
+
+/*
+ * Datastore to datastore copy. The source key space is split into ranges
+ * each streamed by its own iterator straight into the destination, items
+ * stay in their stored encoding so no codec runs on either side.
+ */
+
+using namespace std;
+
+struct copyJob : heliumdbJob
+{
+    heliumdbPy*         mSrc;
+    heliumdbPy*         mDst;
+    string              mPrefix;
+    vector<string>      mBounds;
+    uint64_t            mCommitEvery;
+    atomic<uint64_t>    mSinceCommit;
+
+    copyJob () : mSinceCommit (0) {}
+};
+
+static void
+commitDst (copyJob& job)
+{
+    if (job.mDst->mDatastore->commit () != 0)
+        job.fatal (string ("he_commit failed: ") + he_strerror (errno));
+}
+
+static void
+copyRange (copyJob& job, size_t part)
+{
+    const string&   start = job.mBounds[part];
+    const string*   stop = part + 1 < job.mBounds.size () ? &job.mBounds[part + 1] : NULL;
+    const string&   prefix = job.mPrefix;
+
+    heliumdbCursor* itr = job.mSrc->mDatastore->iterate (start.data (), start.size (),
+                                                         HE_MAX_VAL_LEN);
+    if (itr == NULL)
+    {
+        job.fatal ("failed to open iterator");
+        return;
+    }
+
+    const he_item*  item;
+    uint64_t        copied = 0;
+    uint64_t        bytes = 0;
+
+    while (!job.mCancel && (item = itr->next ()))
+    {
+        if (stop && compareKey (item->key, item->key_len, stop->data (), stop->size ()) >= 0)
+            break;
+        if (!hasPrefix (item, prefix.data (), prefix.size ()))
+            break;
+
+        heliumdbNoteKey (job.mDst, item->key, item->key_len);
+        if (job.mDst->mDatastore->update (item) != 0)
+        {
+            job.fatal (string ("he_update failed: ") + he_strerror (errno));
+            break;
+        }
+
+        // publish counters in small steps so progress stays cheap
+        copied++;
+        bytes += item->key_len + item->val_len;
+        if (copied == 256)
+        {
+            job.mRecords += copied;
+            job.mBytes += bytes;
+            if (job.mCommitEvery > 0 &&
+                job.mSinceCommit.fetch_add (copied) + copied >= job.mCommitEvery)
+            {
+                job.mSinceCommit = 0;
+                commitDst (job);
+            }
+            copied = bytes = 0;
+        }
+    }
+    delete itr;
+
+    job.mRecords += copied;
+    job.mBytes += bytes;
+    job.mSinceCommit += copied;
+}
+
+static void
+runCopy (copyJob* job)
+{
+    vector<thread> workers;
+    for (size_t i = 1; i < job->mBounds.size (); ++i)
+        workers.push_back (thread (copyRange, ref (*job), i));
+
+    if (!job->mBounds.empty ())
+        copyRange (*job, 0);
+
+    for (size_t i = 0; i < workers.size (); ++i)
+        workers[i].join ();
+
+    if (job->mCommitEvery > 0 && !job->mCancel)
+        commitDst (*job);
+
+    job->finish ();
+}
+
+PyObject*
+heliumdb_copy_to (heliumdbPy* self, PyObject* args, PyObject* kwargs)
+{
+    PyObject*   dst;
+    int         threads = 4;
+    PyObject*   filter = Py_None;
+    Py_ssize_t  commitEvery = 100000;
+    PyObject*   progress = Py_None;
+    double      interval = 1.0;
+
+    char *kwlist[] = {(char*)"dst",
+                      (char*)"threads",
+                      (char*)"filter_prefix",
+                      (char*)"commit_every",
+                      (char*)"progress",
+                      (char*)"progress_interval",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "O!|iOnOd", kwlist,
+                                      &heliumdbPyType, &dst, &threads, &filter,
+                                      &commitEvery, &progress, &interval))
+        return NULL;
+
+    copyJob job;
+    job.mSrc = self;
+    job.mDst = (heliumdbPy*)dst;
+    // a transaction publishes the copy at its own commit, committing it
+    // here would end it under the writers
+    job.mCommitEvery = commitEvery > 0 && job.mDst->mParent == NULL ? commitEvery : 0;
+
+    if (job.mDst == self)
+    {
+        PyErr_SetString (HeliumDbException, "cannot copy a datastore onto itself");
+        return NULL;
+    }
+
+    // stored bytes are only meaningful to a handle using the same codecs
+    if (job.mDst->mKeyType != self->mKeyType || job.mDst->mValType != self->mValType)
+    {
+        PyErr_SetString (HeliumDbException,
+                         "destination key_type and val_type must match the source");
+        return NULL;
+    }
+
+    if (threads < 1 || threads > 64 || interval <= 0)
+    {
+        PyErr_SetString (HeliumDbException,
+                         "threads must be 1-64 and progress_interval positive");
+        return NULL;
+    }
+
+    if (!heliumdbFlushWrites (self) || !heliumdbFlushWrites (job.mDst))
+        return NULL;
+
+    if (filter != Py_None)
+    {
+        char    prefix[HE_MAX_KEY_LEN];
+        size_t  len;
+        if (!encodePrefix (self, filter, prefix, len))
+            return NULL;
+        job.mPrefix.assign (prefix, len);
+    }
+
+    bool split;
+    Py_BEGIN_ALLOW_THREADS
+    split = heliumdbSplitKeys (self->mDatastore, job.mPrefix, threads, job.mBounds);
+    Py_END_ALLOW_THREADS
+
+    if (!split)
+    {
+        PyErr_SetString (HeliumDbException, "failed to open iterator");
+        return NULL;
+    }
+
+    // the handles stay referenced by the caller's arguments until we return
+    thread driver (runCopy, &job);
+    bool ok = job.wait (progress, interval);
+    driver.join ();
+
+    heliumdbInvalidate (job.mDst, NULL, 0);
+
+    if (!ok)
+        return NULL;
+
+    return job.report ();
+}
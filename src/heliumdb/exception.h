@@ -2,4 +2,4 @@
 
 #include <Python.h>
 
-static PyObject* HeliumDbException;
+extern PyObject* HeliumDbException;
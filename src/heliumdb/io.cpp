@@ -0,0 +1,826 @@
+#include "module.h"
+#include "textcodec.h"
+#include "job.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Bulk file import and export. Records are parsed and encoded natively from
+ * an mmap of the input on a reader thread and written by a set of writer
+ * threads, the python thread only reports progress. Keys are routed to
+ * writers by hash so repeated keys are applied in file order.
+ *
+ * Formats:
+ *  ndjson  one json object per line, key and value taken from members
+ *  csv     header line naming the columns, RFC 4180 quoting
+ *  binary  [u32 le key len][key][u32 le val len][val], stored bytes as is
+ */
+
+using namespace std;
+
+enum ioFormat
+{
+    FORMAT_NDJSON,
+    FORMAT_CSV,
+    FORMAT_BINARY
+};
+
+/* batches of encoded records in binary format queued per writer */
+#define IO_QUEUE_DEPTH 4
+
+/* export output buffer */
+#define IO_WRITE_BUFFER (1 << 20)
+
+class ioQueue
+{
+public:
+    ioQueue () : mClosed (false) {}
+
+    /* false if cancelled while waiting for space */
+    bool push (string* batch, const atomic<bool>& cancel)
+    {
+        unique_lock<mutex> lock (mLock);
+        while (mBatches.size () >= IO_QUEUE_DEPTH)
+        {
+            if (cancel)
+            {
+                delete batch;
+                return false;
+            }
+            mSpace.wait_for (lock, chrono::milliseconds (10));
+        }
+        mBatches.push_back (batch);
+        mReady.notify_one ();
+        return true;
+    }
+
+    /* NULL once closed and drained */
+    string* pop ()
+    {
+        unique_lock<mutex> lock (mLock);
+        while (mBatches.empty () && !mClosed)
+            mReady.wait (lock);
+
+        if (mBatches.empty ())
+            return NULL;
+
+        string* batch = mBatches.front ();
+        mBatches.pop_front ();
+        mSpace.notify_one ();
+        return batch;
+    }
+
+    void close ()
+    {
+        lock_guard<mutex> lock (mLock);
+        mClosed = true;
+        mReady.notify_all ();
+    }
+
+    ~ioQueue ()
+    {
+        for (size_t i = 0; i < mBatches.size (); ++i)
+            delete mBatches[i];
+    }
+
+private:
+    mutex               mLock;
+    condition_variable  mReady;
+    condition_variable  mSpace;
+    deque<string*>      mBatches;
+    bool                mClosed;
+};
+
+struct ioJob : heliumdbJob
+{
+    heliumdbPy*         mHe;
+    ioFormat            mFormat;
+    string              mKeyField;
+    string              mValField;
+    bool                mWholeRecord;
+    char                mDelimiter;
+};
+
+struct importJob : ioJob
+{
+    const char*         mData;
+    size_t              mSize;
+    size_t              mBatchSize;
+    uint64_t            mCommitEvery;
+    atomic<uint64_t>    mSinceCommit;
+    vector<ioQueue*>    mQueues;
+
+    importJob () : mData (NULL), mSize (0), mSinceCommit (0) {}
+};
+
+static bool
+parseFormat (const char* name, ioFormat& format)
+{
+    if (strcmp (name, "ndjson") == 0)
+        format = FORMAT_NDJSON;
+    else if (strcmp (name, "csv") == 0)
+        format = FORMAT_CSV;
+    else if (strcmp (name, "binary") == 0)
+        format = FORMAT_BINARY;
+    else
+    {
+        PyErr_SetString (HeliumDbException,
+                         "format must be 'ndjson', 'csv' or 'binary'");
+        return false;
+    }
+
+    return true;
+}
+
+/* text formats need a native conversion for both type codes */
+static bool
+checkTextTypes (const ioJob& job)
+{
+    if (job.mFormat == FORMAT_BINARY)
+        return true;
+
+    char keyType = job.mHe->mKeyType;
+    char valType = job.mHe->mValType;
+
+    if (!textTypeSupported (keyType) || !textTypeSupported (valType))
+    {
+        PyErr_SetString (HeliumDbException,
+                         "pickled ('O') keys or values can only use the binary format");
+        return false;
+    }
+
+    if (job.mWholeRecord && valType != 's' && valType != 'b' && valType != 'N')
+    {
+        PyErr_SetString (HeliumDbException,
+                         "value_field=None needs an 's', 'b' or 'N' value type");
+        return false;
+    }
+
+    return true;
+}
+
+static void
+putLength (string& out, size_t len)
+{
+    unsigned char b[4] = {(unsigned char)len, (unsigned char)(len >> 8),
+                          (unsigned char)(len >> 16), (unsigned char)(len >> 24)};
+    out.append ((const char*)b, sizeof (b));
+}
+
+static bool
+getLength (const char*& p, const char* end, size_t& len)
+{
+    if (end - p < 4)
+        return false;
+
+    const unsigned char* b = (const unsigned char*)p;
+    len = b[0] | (b[1] << 8) | (b[2] << 16) | ((size_t)b[3] << 24);
+    p += 4;
+
+    return true;
+}
+
+static bool
+getRecord (const char*& p, const char* end, he_item& item)
+{
+    size_t len;
+    if (!getLength (p, end, len) || (size_t)(end - p) < len)
+        return false;
+
+    item.key = (void*)p;
+    item.key_len = len;
+    p += len;
+
+    if (!getLength (p, end, len) || (size_t)(end - p) < len)
+        return false;
+
+    item.val = (void*)p;
+    item.val_len = len;
+    p += len;
+
+    return true;
+}
+
+/* one csv record starting at p, quoted fields may span lines */
+static bool
+parseCsvRecord (const char*& p, const char* end, char delimiter, vector<string>& fields)
+{
+    fields.clear ();
+    fields.push_back (string ());
+
+    bool quoted = false;
+    while (p < end)
+    {
+        char c = *p++;
+        string& field = fields.back ();
+
+        if (quoted)
+        {
+            if (c != '"')
+                field.push_back (c);
+            else if (p < end && *p == '"')
+                field.push_back (*p++);
+            else
+                quoted = false;
+        }
+        else if (c == '"' && field.empty ())
+            quoted = true;
+        else if (c == delimiter)
+            fields.push_back (string ());
+        else if (c == '\n')
+            break;
+        else if (c != '\r')
+            field.push_back (c);
+    }
+
+    return !quoted;
+}
+
+static const char*
+lineEnd (const char* p, const char* end)
+{
+    const char* nl = (const char*)memchr (p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+static bool
+blank (const char* p, const char* end)
+{
+    for (; p < end; ++p)
+    {
+        if (*p != ' ' && *p != '\t' && *p != '\r')
+            return false;
+    }
+    return true;
+}
+
+static bool
+encodeNdjson (importJob& job, const char* line, const char* end,
+              string& key, string& val, string& err)
+{
+    jsonValue   doc;
+    const char* p = line;
+
+    if (!jsonParse (p, end, doc) || !blank (p, end))
+    {
+        err = "invalid json";
+        return false;
+    }
+
+    const jsonValue* k = jsonMember (doc, job.mKeyField);
+    if (k == NULL)
+    {
+        err = "missing key field '" + job.mKeyField + "'";
+        return false;
+    }
+
+    if (!encodeJsonAs (*k, job.mHe->mKeyType, key, err))
+        return false;
+
+    if (job.mWholeRecord)
+    {
+        if (job.mHe->mValType == 'N')
+            return encodeJsonAs (doc, 'N', val, err);
+
+        while (end > line && end[-1] == '\r')
+            end--;
+        val.assign (line, end - line);
+        return true;
+    }
+
+    const jsonValue* v = jsonMember (doc, job.mValField);
+    if (v == NULL)
+    {
+        err = "missing value field '" + job.mValField + "'";
+        return false;
+    }
+
+    return encodeJsonAs (*v, job.mHe->mValType, val, err);
+}
+
+static uint64_t
+hashKey (const string& key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size (); ++i)
+        h = (h ^ (unsigned char)key[i]) * 1099511628211ULL;
+
+    return h;
+}
+
+static void
+importReader (importJob& job)
+{
+    size_t          writers = job.mQueues.size ();
+    vector<string*> pending (writers);
+    vector<size_t>  counts (writers, 0);
+    vector<string>  fields;
+    string          key;
+    string          val;
+    string          err;
+    size_t          record = 0;
+    size_t          keyCol = 0;
+    size_t          valCol = 0;
+
+    const char* start = job.mData;
+    const char* end = start + job.mSize;
+    const char* p = start;
+
+    for (size_t i = 0; i < writers; ++i)
+        pending[i] = new string ();
+
+    if (job.mFormat == FORMAT_CSV && p < end)
+    {
+        if (!parseCsvRecord (p, end, job.mDelimiter, fields))
+            job.fatal ("unterminated quote in csv header");
+
+        keyCol = valCol = fields.size ();
+        for (size_t i = 0; i < fields.size (); ++i)
+        {
+            if (fields[i] == job.mKeyField)
+                keyCol = i;
+            if (!job.mWholeRecord && fields[i] == job.mValField)
+                valCol = i;
+        }
+
+        if (keyCol == fields.size () ||
+            (!job.mWholeRecord && valCol == fields.size ()))
+            job.fatal ("csv header does not name the key and value fields");
+    }
+
+    while (p < end && !job.mCancel)
+    {
+        const char* rec = p;
+        bool        ok = true;
+
+        key.clear ();
+        val.clear ();
+        err.clear ();
+
+        if (job.mFormat == FORMAT_BINARY)
+        {
+            he_item item;
+            if (!getRecord (p, end, item))
+            {
+                job.fatal ("truncated record in binary file");
+                break;
+            }
+            key.assign ((const char*)item.key, item.key_len);
+            val.assign ((const char*)item.val, item.val_len);
+        }
+        else if (job.mFormat == FORMAT_NDJSON)
+        {
+            const char* eol = lineEnd (p, end);
+            p = eol < end ? eol + 1 : end;
+            if (blank (rec, eol))
+                continue;
+
+            ok = encodeNdjson (job, rec, eol, key, val, err);
+        }
+        else
+        {
+            if (!parseCsvRecord (p, end, job.mDelimiter, fields))
+            {
+                ok = false;
+                err = "unterminated quote";
+            }
+            else if (fields.size () == 1 && fields[0].empty ())
+            {
+                continue;
+            }
+            else if (keyCol >= fields.size () ||
+                     (!job.mWholeRecord && valCol >= fields.size ()))
+            {
+                ok = false;
+                err = "missing column";
+            }
+            else
+            {
+                ok = encodeTextAs (fields[keyCol].data (), fields[keyCol].size (),
+                                   job.mHe->mKeyType, key, err);
+                if (ok && job.mWholeRecord)
+                {
+                    const char* last = p;
+                    while (last > rec && (last[-1] == '\n' || last[-1] == '\r'))
+                        last--;
+                    ok = encodeTextAs (rec, last - rec, job.mHe->mValType, val, err);
+                }
+                else if (ok)
+                {
+                    ok = encodeTextAs (fields[valCol].data (), fields[valCol].size (),
+                                       job.mHe->mValType, val, err);
+                }
+            }
+        }
+
+        record++;
+        job.mBytes.store (p - start, memory_order_relaxed);
+
+        if (ok && (key.empty () || key.size () > HE_MAX_KEY_LEN))
+        {
+            ok = false;
+            err = key.empty () ? "empty key" : "key exceeds maximum key length";
+        }
+
+        if (!ok)
+        {
+            job.error (record, err);
+            continue;
+        }
+
+        size_t w = hashKey (key) % writers;
+        putLength (*pending[w], key.size ());
+        pending[w]->append (key);
+        putLength (*pending[w], val.size ());
+        pending[w]->append (val);
+
+        if (++counts[w] == job.mBatchSize)
+        {
+            if (!job.mQueues[w]->push (pending[w], job.mCancel))
+                pending[w] = NULL;
+            else
+                pending[w] = new string ();
+            counts[w] = 0;
+            if (pending[w] == NULL)
+                break;
+        }
+    }
+
+    for (size_t i = 0; i < writers; ++i)
+    {
+        if (pending[i] && counts[i] > 0)
+            job.mQueues[i]->push (pending[i], job.mCancel);
+        else
+            delete pending[i];
+        job.mQueues[i]->close ();
+    }
+}
+
+static void
+importWriter (importJob& job, ioQueue& queue)
+{
+    string* batch;
+    while ((batch = queue.pop ()))
+    {
+        const char* p = batch->data ();
+        const char* end = p + batch->size ();
+        uint64_t    written = 0;
+        he_item     item;
+
+        while (!job.mCancel && getRecord (p, end, item))
+        {
+            heliumdbNoteKey (job.mHe, item.key, item.key_len);
+            if (job.mHe->mDatastore->update (&item) != 0)
+            {
+                job.fatal (string ("he_update failed: ") + he_strerror (errno));
+                break;
+            }
+            written++;
+        }
+        delete batch;
+
+        job.mRecords += written;
+        if (job.mCommitEvery > 0 &&
+            job.mSinceCommit.fetch_add (written) + written >= job.mCommitEvery)
+        {
+            job.mSinceCommit = 0;
+            if (job.mHe->mDatastore->commit () != 0)
+                job.fatal (string ("he_commit failed: ") + he_strerror (errno));
+        }
+    }
+}
+
+static void
+runImport (importJob* job)
+{
+    vector<thread> writers;
+    for (size_t i = 0; i < job->mQueues.size (); ++i)
+        writers.push_back (thread (importWriter, ref (*job), ref (*job->mQueues[i])));
+
+    importReader (*job);
+
+    for (size_t i = 0; i < writers.size (); ++i)
+        writers[i].join ();
+
+    if (job->mCommitEvery > 0 && !job->mCancel && job->mHe->mDatastore->commit () != 0)
+        job->fatal (string ("he_commit failed: ") + he_strerror (errno));
+
+    job->finish ();
+}
+
+static bool
+writeOut (FILE* f, const string& out, ioJob& job)
+{
+    if (fwrite (out.data (), 1, out.size (), f) != out.size ())
+    {
+        job.fatal (string ("write failed: ") + strerror (errno));
+        return false;
+    }
+
+    job.mBytes += out.size ();
+    return true;
+}
+
+static void
+putCsvField (const string& field, char delimiter, string& out)
+{
+    if (field.find_first_of (string ("\"\r\n") + delimiter) == string::npos)
+    {
+        out.append (field);
+        return;
+    }
+
+    out.push_back ('"');
+    for (size_t i = 0; i < field.size (); ++i)
+    {
+        if (field[i] == '"')
+            out.push_back ('"');
+        out.push_back (field[i]);
+    }
+    out.push_back ('"');
+}
+
+static bool
+exportRecord (ioJob& job, const he_item& item, string& out, string& err)
+{
+    char keyType = job.mHe->mKeyType;
+    char valType = job.mHe->mValType;
+
+    const char* key = (const char*)item.key;
+    const char* val = (const char*)item.val;
+
+    if (job.mFormat == FORMAT_BINARY)
+    {
+        putLength (out, item.key_len);
+        out.append (key, item.key_len);
+        putLength (out, item.val_len);
+        out.append (val, item.val_len);
+        return true;
+    }
+
+    if (job.mFormat == FORMAT_NDJSON)
+    {
+        out.push_back ('{');
+        jsonWriteString (job.mKeyField.data (), job.mKeyField.size (), out);
+        out.push_back (':');
+        if (!decodeToJson (key, item.key_len, keyType, out, err))
+            return false;
+        out.push_back (',');
+        jsonWriteString (job.mValField.data (), job.mValField.size (), out);
+        out.push_back (':');
+        if (!decodeToJson (val, item.val_len, valType, out, err))
+            return false;
+        out.append ("}\n");
+        return true;
+    }
+
+    string field;
+    if (!decodeToText (key, item.key_len, keyType, field, err))
+        return false;
+    putCsvField (field, job.mDelimiter, out);
+    out.push_back (job.mDelimiter);
+
+    field.clear ();
+    if (!decodeToText (val, item.val_len, valType, field, err))
+        return false;
+    putCsvField (field, job.mDelimiter, out);
+    out.push_back ('\n');
+
+    return true;
+}
+
+static void
+runExport (ioJob* job, FILE* f)
+{
+    string  out;
+    string  err;
+    size_t  record = 0;
+
+    if (job->mFormat == FORMAT_CSV)
+    {
+        putCsvField (job->mKeyField, job->mDelimiter, out);
+        out.push_back (job->mDelimiter);
+        putCsvField (job->mValField, job->mDelimiter, out);
+        out.push_back ('\n');
+    }
+
+    heliumdbCursor* itr = job->mHe->mDatastore->iterate (NULL, 0, HE_MAX_VAL_LEN);
+    if (itr == NULL)
+    {
+        job->fatal ("failed to open iterator");
+        job->finish ();
+        return;
+    }
+
+    const he_item* item;
+    while (!job->mCancel && (item = itr->next ()))
+    {
+        size_t mark = out.size ();
+
+        record++;
+        err.clear ();
+        if (!exportRecord (*job, *item, out, err))
+        {
+            out.resize (mark);
+            job->error (record, err);
+            continue;
+        }
+        job->mRecords++;
+
+        if (out.size () >= IO_WRITE_BUFFER)
+        {
+            if (!writeOut (f, out, *job))
+                break;
+            out.clear ();
+        }
+    }
+    delete itr;
+
+    if (!job->mCancel)
+        writeOut (f, out, *job);
+
+    job->finish ();
+}
+
+PyObject*
+heliumdb_import_file (heliumdbPy* self, PyObject* args, PyObject* kwargs)
+{
+    const char* path;
+    const char* format = "ndjson";
+    const char* keyField = "key";
+    const char* valField = "value";
+    int         threads = 2;
+    Py_ssize_t  commitEvery = 0;
+    Py_ssize_t  batch = 1024;
+    int         delimiter = ',';
+    PyObject*   progress = Py_None;
+    double      interval = 1.0;
+
+    char *kwlist[] = {(char*)"path",
+                      (char*)"format",
+                      (char*)"key_field",
+                      (char*)"value_field",
+                      (char*)"threads",
+                      (char*)"commit_every",
+                      (char*)"batch",
+                      (char*)"delimiter",
+                      (char*)"progress",
+                      (char*)"progress_interval",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "s|sszinnCOd", kwlist,
+                                      &path, &format, &keyField, &valField,
+                                      &threads, &commitEvery, &batch, &delimiter,
+                                      &progress, &interval))
+        return NULL;
+
+    importJob job;
+    job.mHe = self;
+    if (!parseFormat (format, job.mFormat))
+        return NULL;
+
+    job.mKeyField = keyField;
+    job.mWholeRecord = valField == NULL;
+    job.mValField = valField ? valField : "";
+    job.mDelimiter = (char)delimiter;
+    job.mBatchSize = batch > 0 ? batch : 1;
+    // a transaction publishes the import at its own commit
+    job.mCommitEvery = commitEvery > 0 && self->mParent == NULL ? commitEvery : 0;
+
+    if (threads < 1 || threads > 64 || interval <= 0)
+    {
+        PyErr_SetString (HeliumDbException,
+                         "threads must be 1-64 and progress_interval positive");
+        return NULL;
+    }
+
+    if (!checkTextTypes (job) || !heliumdbFlushWrites (self))
+        return NULL;
+
+    int         fd;
+    struct stat st;
+    void*       data = NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    fd = open (path, O_RDONLY);
+    if (fd >= 0 && fstat (fd, &st) == 0 && st.st_size > 0)
+    {
+        data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+            madvise (data, st.st_size, MADV_SEQUENTIAL);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (fd < 0 || data == MAP_FAILED)
+    {
+        PyErr_SetFromErrnoWithFilename (PyExc_OSError, path);
+        if (fd >= 0)
+            close (fd);
+        return NULL;
+    }
+
+    job.mData = (const char*)data;
+    job.mSize = data ? st.st_size : 0;
+    for (int i = 0; i < threads; ++i)
+        job.mQueues.push_back (new ioQueue ());
+
+    thread driver (runImport, &job);
+    bool ok = job.wait (progress, interval);
+    driver.join ();
+
+    heliumdbInvalidate (self, NULL, 0);
+
+    if (data)
+        munmap (data, job.mSize);
+    close (fd);
+    for (size_t i = 0; i < job.mQueues.size (); ++i)
+        delete job.mQueues[i];
+
+    if (!ok)
+        return NULL;
+
+    return job.report ();
+}
+
+PyObject*
+heliumdb_export_file (heliumdbPy* self, PyObject* args, PyObject* kwargs)
+{
+    const char* path;
+    const char* format = "ndjson";
+    const char* keyField = "key";
+    const char* valField = "value";
+    int         delimiter = ',';
+    PyObject*   progress = Py_None;
+    double      interval = 1.0;
+
+    char *kwlist[] = {(char*)"path",
+                      (char*)"format",
+                      (char*)"key_field",
+                      (char*)"value_field",
+                      (char*)"delimiter",
+                      (char*)"progress",
+                      (char*)"progress_interval",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "s|sssCOd", kwlist,
+                                      &path, &format, &keyField, &valField,
+                                      &delimiter, &progress, &interval))
+        return NULL;
+
+    ioJob job;
+    job.mHe = self;
+    if (!parseFormat (format, job.mFormat))
+        return NULL;
+
+    job.mKeyField = keyField;
+    job.mValField = valField;
+    job.mWholeRecord = false;
+    job.mDelimiter = (char)delimiter;
+
+    if (interval <= 0)
+    {
+        PyErr_SetString (HeliumDbException, "progress_interval must be positive");
+        return NULL;
+    }
+
+    if (!checkTextTypes (job) || !heliumdbFlushWrites (self))
+        return NULL;
+
+    FILE* f;
+    Py_BEGIN_ALLOW_THREADS
+    f = fopen (path, "wb");
+    Py_END_ALLOW_THREADS
+
+    if (f == NULL)
+    {
+        PyErr_SetFromErrnoWithFilename (PyExc_OSError, path);
+        return NULL;
+    }
+
+    thread worker (runExport, &job, f);
+    bool ok = job.wait (progress, interval);
+    worker.join ();
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = fclose (f);
+    Py_END_ALLOW_THREADS
+
+    if (!ok)
+        return NULL;
+
+    if (rc != 0)
+        job.fatal (string ("write failed: ") + strerror (errno));
+
+    return job.report ();
+}
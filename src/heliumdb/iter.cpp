@@ -1,101 +1,588 @@
 #include "module.h"
+#include "keyrange.h"
+
+using namespace std;
+
+/* initial value buffer of reverse iterators, grown on demand */
+#define REVERSE_VAL_BUFFER 4096
+
+/* largest chunk=N accepted by the iterator methods */
+#define MAX_ITER_CHUNK (1 << 20)
+
+bool
+encodeKey (heliumdbPy* h, PyObject* k, char* buf, size_t& len)
+{
+    void*   data;
+    size_t  l;
+
+    if (!h->mKeySerializer (k, data, l))
+    {
+        PyErr_SetString (HeliumDbException, "could not serialize key object");
+        return false;
+    }
+
+    if (l > HE_MAX_KEY_LEN)
+    {
+        PyErr_SetString (HeliumDbException, "key exceeds maximum key length");
+        return false;
+    }
+
+    memcpy (buf, data, l);
+    len = l;
+
+    return true;
+}
 
 static void
 heliumdbiter_dealloc (heliumdbiter* hitr)
 {
-    Py_BEGIN_ALLOW_THREADS
-    he_iter_close (hitr->mItr);
-    Py_END_ALLOW_THREADS
+    if (hitr->mItr || hitr->mPrefetch)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        delete hitr->mPrefetch;
+        if (hitr->mItr)
+            delete hitr->mItr;
+        Py_END_ALLOW_THREADS
+    }
 
+    delete hitr->mWhere;
+    free (hitr->mValBuf);
     Py_XDECREF (hitr->mHe);
     PyObject_GC_Del (hitr);
 }
 
-PyObject*
-heliumdb_itervalues (heliumdbPy* h)
+static int
+heliumdbiter_traverse (heliumdbiter* hitr, visitproc visit, void* arg)
+{
+    Py_VISIT (hitr->mHe);
+    return 0;
+}
+
+static heliumdbiter*
+newIterator (heliumdbPy* h, PyTypeObject* type, size_t maxValLen)
 {
-    heliumdbiter* hitr = PyObject_GC_New (heliumdbiter, &heliumdbIterValuesType);
+    if (!heliumdbFlushWrites (h))
+        return NULL;
+
+    heliumdbiter* hitr = PyObject_GC_New (heliumdbiter, type);
     if (hitr == NULL)
         return NULL;
 
-    Py_INCREF (h);
+    // the allocator only initialises the object header
+    memset ((char*)hitr + sizeof (PyObject), 0, sizeof (heliumdbiter) - sizeof (PyObject));
 
+    Py_INCREF (h);
     hitr->mHe = h;
+    hitr->mMaxValLen = maxValLen;
+
+    return hitr;
+}
+
+/*
+ * Position the iterator so the next item is the first key >= key, or for
+ * reverse iterators the last key < key (<= key when inclusive). A NULL key
+ * starts from the beginning, or the end when reversed.
+ */
+static bool
+openIterator (heliumdbiter* hitr, const char* key, size_t keyLen, bool inclusive)
+{
+    // read-ahead must stop before the position it reads from changes
+    if (hitr->mPrefetch)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        hitr->mPrefetch->reset ();
+        Py_END_ALLOW_THREADS
+    }
+
+    hitr->mDone = false;
+
+    if (hitr->mReverse)
+    {
+        if (key == NULL)
+        {
+            // no stored key can sort after a maximum length run of 0xff
+            memset (hitr->mCursor, 0xff, HE_MAX_KEY_LEN);
+            hitr->mCursorLen = HE_MAX_KEY_LEN;
+            inclusive = false;
+        }
+        else
+        {
+            memcpy (hitr->mCursor, key, keyLen);
+            hitr->mCursorLen = keyLen;
+        }
+        hitr->mInclusive = inclusive;
+
+        if (hitr->mMaxValLen && hitr->mValBuf == NULL)
+        {
+            hitr->mValBuf = malloc (REVERSE_VAL_BUFFER);
+            if (hitr->mValBuf == NULL)
+            {
+                PyErr_NoMemory ();
+                return false;
+            }
+            hitr->mValBufLen = REVERSE_VAL_BUFFER;
+        }
+        return true;
+    }
+
+    heliumdbCursor* old = hitr->mItr;
 
     Py_BEGIN_ALLOW_THREADS
-    hitr->mItr = he_iter_open (h->mDatastore, NULL, 0, HE_MAX_VAL_LEN, 0);
+    if (old)
+        delete old;
+    hitr->mItr = hitr->mHe->mDatastore->iterate (key, keyLen, hitr->mMaxValLen);
     Py_END_ALLOW_THREADS
 
     if (!hitr->mItr)
     {
         PyErr_SetString (HeliumDbException, "failed to open iterator");
+        return false;
+    }
+
+    return true;
+}
+
+static PyObject*
+openBounded (heliumdbiter* hitr)
+{
+    bool ok;
+    if (hitr->mReverse)
+        ok = openIterator (hitr, hitr->mHasStop ? hitr->mStop : NULL, hitr->mStopLen, false);
+    else
+        ok = openIterator (hitr, hitr->mHasStart ? hitr->mStart : NULL, hitr->mStartLen, true);
+
+    if (!ok)
+    {
+        Py_DECREF (hitr);
         return NULL;
     }
 
     return (PyObject*)hitr;
 }
 
-PyObject*
-heliumdb_iteritems (heliumdbPy* h)
+/* step a reverse iterator, called without the GIL */
+static const he_item*
+prevItem (heliumdbiter* hitr)
 {
-    heliumdbiter* hitr = PyObject_GC_New (heliumdbiter, &heliumdbIterItemType);
-    if (hitr == NULL)
+    heliumdbBackend*    ds = hitr->mHe->mDatastore;
+    he_item&            item = hitr->mItem;
+    int                 rc = -1;
+
+    item.key = hitr->mCursor;
+    item.key_len = hitr->mCursorLen;
+    item.val = hitr->mValBuf;
+
+    if (hitr->mInclusive)
+    {
+        hitr->mInclusive = false;
+        rc = ds->lookup (&item, 0, hitr->mValBufLen);
+    }
+    if (rc != 0)
+        rc = ds->prev (&item, 0, hitr->mValBufLen);
+    if (rc != 0)
         return NULL;
 
-    Py_INCREF (h);
+    hitr->mCursorLen = item.key_len;
 
-    hitr->mHe = h;
+    if (hitr->mHasStart &&
+        compareKey (item.key, item.key_len, hitr->mStart, hitr->mStartLen) < 0)
+        return NULL;
+
+    if (!hitr->mMaxValLen)
+    {
+        item.val_len = 0;
+        return &item;
+    }
+
+    if (item.val_len > hitr->mValBufLen)
+    {
+        void* buf = realloc (hitr->mValBuf, item.val_len);
+        if (buf == NULL)
+            return NULL;
+
+        hitr->mValBuf = buf;
+        hitr->mValBufLen = item.val_len;
+        item.val = buf;
+
+        if (ds->lookup (&item, 0, hitr->mValBufLen) != 0)
+            return NULL;
+    }
 
+    return &item;
+}
+
+/* next item honouring direction and bounds, called without the GIL */
+static const he_item*
+nextItem (heliumdbiter* hitr)
+{
+    if (hitr->mDone)
+        return NULL;
+
+    const he_item* item;
+    do
+    {
+        if (hitr->mReverse)
+        {
+            item = prevItem (hitr);
+        }
+        else
+        {
+            item = hitr->mItr->next ();
+            if (item && hitr->mHasStop &&
+                compareKey (item->key, item->key_len, hitr->mStop, hitr->mStopLen) >= 0)
+                item = NULL;
+            if (item && hitr->mPrefix && !hasPrefix (item, hitr->mStart, hitr->mStartLen))
+                item = NULL;
+        }
+    }
+    while (item && hitr->mWhere && !hitr->mWhere->match (item->val, item->val_len));
+
+    if (!item)
+    {
+        // close the cursor now, an open one keeps a transaction from ending
+        delete hitr->mItr;
+        hitr->mItr = NULL;
+        hitr->mDone = true;
+    }
+
+    return item;
+}
+
+/* next item of a possibly chunked iterator, called with the GIL */
+static const he_item*
+fetchItem (heliumdbiter* hitr, heliumdbTimer& timer)
+{
+    const he_item* item;
+
+    if (hitr->mPrefetch == NULL)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        item = nextItem (hitr);
+        timer.phase (PHASE_STORE);
+        Py_END_ALLOW_THREADS
+        timer.phase (PHASE_GIL);
+        return item;
+    }
+
+    if ((item = hitr->mPrefetch->take ()))
+    {
+        timer.phase (PHASE_STORE);
+        return item;
+    }
+
+    bool more;
     Py_BEGIN_ALLOW_THREADS
-    hitr->mItr = he_iter_open (h->mDatastore, NULL, 0, HE_MAX_VAL_LEN, 0);
+    more = hitr->mPrefetch->refill ();
+    timer.phase (PHASE_STORE);
     Py_END_ALLOW_THREADS
+    timer.phase (PHASE_GIL);
 
-    if (!hitr->mItr)
+    return more ? hitr->mPrefetch->take () : NULL;
+}
+
+/* buffer chunk raw items per GIL release, read ahead in the background
+ * with prefetch set */
+static bool
+setChunk (heliumdbiter* hitr, Py_ssize_t chunk, int prefetch)
+{
+    if (chunk < 1 || chunk > MAX_ITER_CHUNK)
     {
-        PyErr_SetString (HeliumDbException, "failed to open iterator");
+        PyErr_SetString (HeliumDbException, "chunk must be between 1 and 1048576");
+        return false;
+    }
+
+    if (chunk > 1 || prefetch)
+        hitr->mPrefetch = new heliumdbPrefetch (chunk, prefetch, [hitr] () {
+            return nextItem (hitr);
+        });
+
+    return true;
+}
+
+static PyObject*
+chunkedIterator (heliumdbPy* h,
+                 PyObject* args,
+                 PyObject* kwargs,
+                 PyTypeObject* type,
+                 size_t maxValLen)
+{
+    Py_ssize_t  chunk = 1;
+    int         prefetch = 0;
+
+    char *kwlist[] = {(char*)"chunk",
+                      (char*)"prefetch",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "|np", kwlist, &chunk, &prefetch))
+        return NULL;
+
+    heliumdbiter* hitr = newIterator (h, type, maxValLen);
+    if (hitr == NULL)
+        return NULL;
+
+    if (!setChunk (hitr, chunk, prefetch))
+    {
+        Py_DECREF (hitr);
         return NULL;
     }
 
-    return (PyObject*)hitr;
+    return openBounded (hitr);
+}
+
+PyObject*
+heliumdb_itervalues (heliumdbPy* h, PyObject* args, PyObject* kwargs)
+{
+    return chunkedIterator (h, args, kwargs, &heliumdbIterValuesType, HE_MAX_VAL_LEN);
+}
+
+PyObject*
+heliumdb_iteritems (heliumdbPy* h, PyObject* args, PyObject* kwargs)
+{
+    return chunkedIterator (h, args, kwargs, &heliumdbIterItemType, HE_MAX_VAL_LEN);
+}
+
+PyObject*
+heliumdb_iterkeys (heliumdbPy* h, PyObject* args, PyObject* kwargs)
+{
+    return chunkedIterator (h, args, kwargs, &heliumdbIterKeyType, 0);
 }
 
 PyObject*
 heliumdb_iter (heliumdbPy* h)
 {
-    heliumdbiter* hitr = PyObject_GC_New (heliumdbiter, &heliumdbIterKeyType);
+    heliumdbiter* hitr = newIterator (h, &heliumdbIterKeyType, 0);
     if (hitr == NULL)
         return NULL;
 
-    Py_INCREF (h);
+    return openBounded (hitr);
+}
 
-    hitr->mHe = h;
+PyObject*
+heliumdb_range (heliumdbPy* h, PyObject* args, PyObject* kwargs)
+{
+    PyObject*   start = Py_None;
+    PyObject*   stop = Py_None;
+    int         reverse = 0;
+    Py_ssize_t  chunk = 1;
+    int         prefetch = 0;
+
+    char *kwlist[] = {(char*)"start",
+                      (char*)"stop",
+                      (char*)"reverse",
+                      (char*)"chunk",
+                      (char*)"prefetch",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "|OOpnp", kwlist,
+                                      &start, &stop, &reverse, &chunk, &prefetch))
+        return NULL;
+
+    heliumdbiter* hitr = newIterator (h, &heliumdbIterItemType, HE_MAX_VAL_LEN);
+    if (hitr == NULL)
+        return NULL;
+
+    hitr->mReverse = reverse;
+
+    if (!setChunk (hitr, chunk, prefetch))
+    {
+        Py_DECREF (hitr);
+        return NULL;
+    }
+
+    if (start != Py_None)
+    {
+        if (!encodeKey (h, start, hitr->mStart, hitr->mStartLen))
+        {
+            Py_DECREF (hitr);
+            return NULL;
+        }
+        hitr->mHasStart = true;
+    }
+
+    if (stop != Py_None)
+    {
+        if (!encodeKey (h, stop, hitr->mStop, hitr->mStopLen))
+        {
+            Py_DECREF (hitr);
+            return NULL;
+        }
+        hitr->mHasStop = true;
+    }
+
+    return openBounded (hitr);
+}
+
+PyObject*
+heliumdb_scan_where (heliumdbPy* h, PyObject* args, PyObject* kwargs)
+{
+    const char* op;
+    PyObject*   operand;
+    int         keysOnly = 0;
+    Py_ssize_t  chunk = 1;
+    int         prefetch = 0;
+
+    char *kwlist[] = {(char*)"op",
+                      (char*)"operand",
+                      (char*)"keys_only",
+                      (char*)"chunk",
+                      (char*)"prefetch",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "sO|pnp", kwlist,
+                                      &op, &operand, &keysOnly, &chunk, &prefetch))
+        return NULL;
+
+    heliumdbPredicate* where = heliumdbPredicate::create (h->mValType, op, operand);
+    if (where == NULL)
+        return NULL;
+
+    // keys only iterators still read values to test them
+    heliumdbiter* hitr = newIterator (h,
+                                      keysOnly ? &heliumdbIterKeyType : &heliumdbIterItemType,
+                                      HE_MAX_VAL_LEN);
+    if (hitr == NULL)
+    {
+        delete where;
+        return NULL;
+    }
+    hitr->mWhere = where;
+
+    if (!setChunk (hitr, chunk, prefetch))
+    {
+        Py_DECREF (hitr);
+        return NULL;
+    }
+
+    return openBounded (hitr);
+}
+
+bool
+encodePrefix (heliumdbPy* h, PyObject* prefix, char* buf, size_t& len)
+{
+    if (h->mKeySerializer != &serializeString && h->mKeySerializer != &serializeBytesKey)
+    {
+        PyErr_SetString (HeliumDbException, "prefix scans require key_type 's' or 'b'");
+        return false;
+    }
+
+    return encodeKey (h, prefix, buf, len);
+}
+
+static PyObject*
+prefixIterator (heliumdbPy* h, PyObject* prefix, PyTypeObject* type, size_t maxValLen)
+{
+    heliumdbiter* hitr = newIterator (h, type, maxValLen);
+    if (hitr == NULL)
+        return NULL;
+
+    if (!encodePrefix (h, prefix, hitr->mStart, hitr->mStartLen))
+    {
+        Py_DECREF (hitr);
+        return NULL;
+    }
+    hitr->mHasStart = true;
+    hitr->mPrefix = true;
+
+    return openBounded (hitr);
+}
+
+PyObject*
+heliumdb_iter_prefix (heliumdbPy* h, PyObject* prefix)
+{
+    return prefixIterator (h, prefix, &heliumdbIterKeyType, 0);
+}
+
+PyObject*
+heliumdb_items_prefix (heliumdbPy* h, PyObject* prefix)
+{
+    return prefixIterator (h, prefix, &heliumdbIterItemType, HE_MAX_VAL_LEN);
+}
+
+PyObject*
+heliumdb_count_prefix (heliumdbPy* h, PyObject* prefix)
+{
+    char    key[HE_MAX_KEY_LEN];
+    size_t  keyLen;
+
+    if (!encodePrefix (h, prefix, key, keyLen))
+        return NULL;
+
+    if (!heliumdbFlushWrites (h))
+        return NULL;
+
+    heliumdbCursor*     itr;
+    const he_item*      item;
+    unsigned long long  count = 0;
 
     Py_BEGIN_ALLOW_THREADS
-    hitr->mItr = he_iter_open (h->mDatastore, NULL, 0, 0, 0);
+    itr = h->mDatastore->iterate (key, keyLen, 0);
+    if (itr)
+    {
+        while ((item = itr->next ()) && hasPrefix (item, key, keyLen))
+            count++;
+        delete itr;
+    }
     Py_END_ALLOW_THREADS
 
-    if (!hitr->mItr)
+    if (!itr)
     {
         PyErr_SetString (HeliumDbException, "failed to open iterator");
         return NULL;
     }
 
-    return (PyObject*)hitr;
+    return PyLong_FromUnsignedLongLong (count);
+}
+
+static PyObject*
+heliumdbiter_seek (heliumdbiter* hitr, PyObject* k)
+{
+    char    key[HE_MAX_KEY_LEN];
+    size_t  keyLen;
+
+    if (!encodeKey (hitr->mHe, k, key, keyLen))
+        return NULL;
+
+    bool ok;
+    if (hitr->mReverse)
+    {
+        if (hitr->mHasStop &&
+            compareKey (key, keyLen, hitr->mStop, hitr->mStopLen) >= 0)
+            ok = openIterator (hitr, hitr->mStop, hitr->mStopLen, false);
+        else
+            ok = openIterator (hitr, key, keyLen, true);
+    }
+    else
+    {
+        if (hitr->mHasStart &&
+            compareKey (key, keyLen, hitr->mStart, hitr->mStartLen) < 0)
+            ok = openIterator (hitr, hitr->mStart, hitr->mStartLen, true);
+        else
+            ok = openIterator (hitr, key, keyLen, true);
+    }
+
+    if (!ok)
+        return NULL;
+
+    Py_INCREF (Py_None);
+    return Py_None;
 }
 
 PyObject*
 heliumdbiter_iternextkey (heliumdbiter* hitr)
 {
-    const he_item* item;
-
-    Py_BEGIN_ALLOW_THREADS
-    item = he_iter_next (hitr->mItr);
-    Py_END_ALLOW_THREADS
+    heliumdbTimer   timer (hitr->mHe->mMetrics, OP_ITER_NEXT);
+    const he_item*  item = fetchItem (hitr, timer);
 
     if (!item)
+    {
+        timer.done ();
         return NULL;
+    }
+    timer.item (item);
 
     PyObject* key = hitr->mHe->mKeyDeserializer (item->key, item->key_len);
+    timer.phase (PHASE_DESERIALIZE);
+    timer.done ();
     if (key == NULL)
     {
         PyErr_SetString (HeliumDbException, "failed to deserialize key object");
@@ -108,13 +595,15 @@ heliumdbiter_iternextkey (heliumdbiter* hitr)
 PyObject*
 heliumdbiter_iternextitem (heliumdbiter* hitr)
 {
-    const he_item* item;
-    Py_BEGIN_ALLOW_THREADS
-    item = he_iter_next (hitr->mItr);
-    Py_END_ALLOW_THREADS
+    heliumdbTimer   timer (hitr->mHe->mMetrics, OP_ITER_NEXT);
+    const he_item*  item = fetchItem (hitr, timer);
 
     if (!item)
+    {
+        timer.done ();
         return NULL;
+    }
+    timer.item (item);
 
     PyObject* key = hitr->mHe->mKeyDeserializer (item->key, item->key_len);
     if (key == NULL)
@@ -126,16 +615,23 @@ heliumdbiter_iternextitem (heliumdbiter* hitr)
     PyObject* val = hitr->mHe->mValDeserializer (item->val, item->val_len);
     if (val == NULL)
     {
+        Py_DECREF (key);
         PyErr_SetString (HeliumDbException, "failed to deserialize val object");
         return NULL;
     }
 
     PyObject* result = PyTuple_New (2);
     if (result == NULL)
+    {
+        Py_DECREF (key);
+        Py_DECREF (val);
         return NULL;
+    }
 
     PyTuple_SET_ITEM (result, 0, key);
     PyTuple_SET_ITEM (result, 1, val);
+    timer.phase (PHASE_DESERIALIZE);
+    timer.done ();
 
     return result;
 }
@@ -143,16 +639,19 @@ heliumdbiter_iternextitem (heliumdbiter* hitr)
 PyObject*
 heliumdbiter_iternextvalue (heliumdbiter* hitr)
 {
-    const he_item* item;
-
-    Py_BEGIN_ALLOW_THREADS
-    item = he_iter_next (hitr->mItr);
-    Py_END_ALLOW_THREADS
+    heliumdbTimer   timer (hitr->mHe->mMetrics, OP_ITER_NEXT);
+    const he_item*  item = fetchItem (hitr, timer);
 
     if (!item)
+    {
+        timer.done ();
         return NULL;
+    }
+    timer.item (item);
 
     PyObject* val = hitr->mHe->mValDeserializer (item->val, item->val_len);
+    timer.phase (PHASE_DESERIALIZE);
+    timer.done ();
     if (val == NULL)
     {
         PyErr_SetString (HeliumDbException, "failed to deserialize val object");
@@ -163,6 +662,7 @@ heliumdbiter_iternextvalue (heliumdbiter* hitr)
 }
 
 static PyMethodDef heliumdbiter_methods[] = {
+    {"seek", (PyCFunction)heliumdbiter_seek, METH_O, "reposition at the first key >= k, or the last key <= k when reversed"},
     { NULL, NULL, 0, NULL }
 };
 
@@ -189,7 +689,7 @@ PyTypeObject heliumdbIterKeyType = {
     0,                                          /* tp_as_buffer */
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
     0,                                          /* tp_doc */
-    0,                                          /* tp_traverse */
+    (traverseproc)heliumdbiter_traverse,          /* tp_traverse */
     0,                                          /* tp_clear */
     0,                                          /* tp_richcompare */
     0,                                          /* tp_weaklistoffset */
@@ -201,7 +701,7 @@ PyTypeObject heliumdbIterKeyType = {
 
 PyTypeObject heliumdbIterItemType = {
     PyVarObject_HEAD_INIT(&PyType_Type, 0)
-    "heliumdb-keyiterator",                       /* tp_name */
+    "heliumdb-itemiterator",                       /* tp_name */
     sizeof(heliumdbiter),                         /* tp_basicsize */
     0,                                          /* tp_itemsize */
     /* methods */
@@ -222,7 +722,7 @@ PyTypeObject heliumdbIterItemType = {
     0,                                          /* tp_as_buffer */
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
     0,                                          /* tp_doc */
-    0,                                          /* tp_traverse */
+    (traverseproc)heliumdbiter_traverse,          /* tp_traverse */
     0,                                          /* tp_clear */
     0,                                          /* tp_richcompare */
     0,                                          /* tp_weaklistoffset */
@@ -255,7 +755,7 @@ PyTypeObject heliumdbIterValuesType = {
     0,                                          /* tp_as_buffer */
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
     0,                                          /* tp_doc */
-    0,                                          /* tp_traverse */
+    (traverseproc)heliumdbiter_traverse,          /* tp_traverse */
     0,                                          /* tp_clear */
     0,                                          /* tp_richcompare */
     0,                                          /* tp_weaklistoffset */
@@ -264,3 +764,11 @@ PyTypeObject heliumdbIterValuesType = {
     heliumdbiter_methods,                         /* tp_methods */
     0                                           /* tp_members */
 };
+
+bool
+heliumdbiter_ready ()
+{
+    return PyType_Ready (&heliumdbIterKeyType) == 0 &&
+           PyType_Ready (&heliumdbIterItemType) == 0 &&
+           PyType_Ready (&heliumdbIterValuesType) == 0;
+}
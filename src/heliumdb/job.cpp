@@ -0,0 +1,145 @@
+#include "job.h"
+#include "exception.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+
+static double
+now ()
+{
+    return chrono::duration<double> (chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+heliumdbJob::heliumdbJob ()
+    : mRecords (0),
+      mBytes (0),
+      mErrors (0),
+      mCancel (false),
+      mDone (false),
+      mStart (now ()),
+      mSeconds (0)
+{
+}
+
+void
+heliumdbJob::error (size_t record, const string& msg)
+{
+    mErrors++;
+
+    lock_guard<mutex> lock (mLock);
+    if (mFirstError.empty ())
+    {
+        char buffer[64];
+        snprintf (buffer, sizeof (buffer), "record %zu: ", record);
+        mFirstError = buffer + msg;
+    }
+}
+
+void
+heliumdbJob::fatal (const string& msg)
+{
+    lock_guard<mutex> lock (mLock);
+    if (mFatal.empty ())
+        mFatal = msg;
+    mCancel = true;
+}
+
+void
+heliumdbJob::finish ()
+{
+    lock_guard<mutex> lock (mLock);
+    mDone = true;
+    mSeconds = now () - mStart;
+    mDoneCond.notify_all ();
+}
+
+bool
+heliumdbJob::wait (PyObject* progress, double interval)
+{
+    bool cancelled = false;
+
+    for (;;)
+    {
+        bool done;
+
+        Py_BEGIN_ALLOW_THREADS
+        {
+            unique_lock<mutex> lock (mLock);
+            if (!mDone)
+                mDoneCond.wait_for (lock, chrono::duration<double> (interval));
+            done = mDone;
+        }
+        Py_END_ALLOW_THREADS
+
+        if (done)
+            break;
+
+        if (!cancelled && progress != NULL && progress != Py_None)
+        {
+            PyObject* res = PyObject_CallFunction (progress, "KK",
+                                                   (unsigned long long)mRecords,
+                                                   (unsigned long long)mBytes);
+            if (res == NULL)
+            {
+                mCancel = true;
+                cancelled = true;
+            }
+            Py_XDECREF (res);
+        }
+    }
+
+    return !cancelled;
+}
+
+static void
+addField (PyObject* res, const char* name, PyObject* val)
+{
+    if (val)
+    {
+        PyDict_SetItemString (res, name, val);
+        Py_DECREF (val);
+    }
+}
+
+PyObject*
+heliumdbJob::report ()
+{
+    if (!mFatal.empty ())
+    {
+        PyErr_SetString (HeliumDbException, mFatal.c_str ());
+        return NULL;
+    }
+
+    PyObject* res = PyDict_New ();
+    if (res == NULL)
+        return NULL;
+
+    double elapsed = mSeconds > 0 ? mSeconds : 1e-9;
+
+    addField (res, "records", PyLong_FromUnsignedLongLong (mRecords));
+    addField (res, "bytes", PyLong_FromUnsignedLongLong (mBytes));
+    addField (res, "errors", PyLong_FromUnsignedLongLong (mErrors));
+    addField (res, "seconds", PyFloat_FromDouble (mSeconds));
+    addField (res, "records_per_sec", PyFloat_FromDouble (mRecords / elapsed));
+    addField (res, "mb_per_sec", PyFloat_FromDouble (mBytes / elapsed / (1 << 20)));
+
+    if (mFirstError.empty ())
+    {
+        Py_INCREF (Py_None);
+        addField (res, "first_error", Py_None);
+    }
+    else
+    {
+        addField (res, "first_error", PyUnicode_FromString (mFirstError.c_str ()));
+    }
+
+    if (PyErr_Occurred ())
+    {
+        Py_DECREF (res);
+        return NULL;
+    }
+
+    return res;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Python.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+/*
+ * State shared between the python thread and the native threads of a long
+ * running bulk operation (file import/export, datastore copy). Workers bump
+ * the counters and call finish () when done, the python thread waits in
+ * wait () with the GIL released and reports progress.
+ */
+class heliumdbJob
+{
+public:
+    heliumdbJob ();
+
+    /* count a skipped record, the first message is kept for the report */
+    void error (size_t record, const std::string& msg);
+
+    /* stop the job, report () raises msg */
+    void fatal (const std::string& msg);
+
+    void finish ();
+
+    /* called with the GIL, waits for finish () calling progress (records,
+     * bytes) every interval seconds. An exception from progress cancels the
+     * job and false is returned once the workers stopped */
+    bool wait (PyObject* progress, double interval);
+
+    /* dict of records, bytes, errors, first_error, seconds and rates, or
+     * NULL with the fatal error set */
+    PyObject* report ();
+
+    std::atomic<uint64_t>   mRecords;
+    std::atomic<uint64_t>   mBytes;
+    std::atomic<uint64_t>   mErrors;
+    std::atomic<bool>       mCancel;
+
+private:
+    std::mutex              mLock;
+    std::condition_variable mDoneCond;
+    bool                    mDone;
+    double                  mStart;
+    double                  mSeconds;
+    std::string             mFirstError;
+    std::string             mFatal;
+};
@@ -0,0 +1,105 @@
+#include "keyrange.h"
+
+using namespace std;
+
+/* branches wanted per range, more give an even split of uneven branches */
+#define SPLIT_BRANCHES_PER_PART 8
+
+/* key bytes examined below the prefix */
+#define SPLIT_MAX_DEPTH 8
+
+/* iterator seeks spent finding split points */
+#define SPLIT_MAX_PROBES 4096
+
+typedef struct
+{
+    string  mStart;
+    string  mPrefix;
+} branch;
+
+/* populated values of the key byte following prefix in ascending order */
+static bool
+nextBytes (heliumdbBackend* he, const string& prefix, vector<unsigned char>& bytes, size_t& probes)
+{
+    string  key = prefix + '\0';
+    size_t  pos = prefix.size ();
+
+    for (int b = 0; b < 256 && probes < SPLIT_MAX_PROBES; ++probes)
+    {
+        key[pos] = (char)b;
+
+        heliumdbCursor* itr = he->iterate (key.data (), key.size (), 0);
+        if (itr == NULL)
+            return false;
+
+        const he_item*  item = itr->next ();
+        int             next = -1;
+        if (item && item->key_len > pos && hasPrefix (item, prefix.data (), pos))
+            next = ((const unsigned char*)item->key)[pos];
+        delete itr;
+
+        if (next < 0)
+            break;
+
+        bytes.push_back ((unsigned char)next);
+        b = next + 1;
+    }
+
+    return true;
+}
+
+bool
+heliumdbSplitKeys (heliumdbBackend* he, const string& prefix, size_t parts, vector<string>& bounds)
+{
+    vector<branch>  branches (1);
+    size_t          probes = 0;
+
+    branches[0].mStart = prefix;
+    branches[0].mPrefix = prefix;
+
+    for (size_t depth = 0;
+         depth < SPLIT_MAX_DEPTH && parts > 1 &&
+         branches.size () < parts * SPLIT_BRANCHES_PER_PART &&
+         probes < SPLIT_MAX_PROBES;
+         ++depth)
+    {
+        vector<branch>  next;
+        bool            grew = false;
+
+        for (size_t i = 0; i < branches.size (); ++i)
+        {
+            vector<unsigned char> bytes;
+            if (branches[i].mPrefix.size () < HE_MAX_KEY_LEN &&
+                !nextBytes (he, branches[i].mPrefix, bytes, probes))
+                return false;
+
+            if (bytes.empty ())
+            {
+                next.push_back (branches[i]);
+                continue;
+            }
+
+            // the first child keeps the parent start which covers the
+            // parent prefix itself when it is a key
+            for (size_t j = 0; j < bytes.size (); ++j)
+            {
+                branch child;
+                child.mPrefix = branches[i].mPrefix + (char)bytes[j];
+                child.mStart = j == 0 ? branches[i].mStart : child.mPrefix;
+                next.push_back (child);
+            }
+            grew = true;
+        }
+
+        branches.swap (next);
+        if (!grew)
+            break;
+    }
+
+    bounds.clear ();
+    size_t n = branches.size ();
+    for (size_t i = 0; i < min (parts, n); ++i)
+        bounds.push_back (branches[i * n / min (parts, n)].mStart);
+
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+
+/* he key order, bytewise with shorter keys first on a common prefix */
+inline int
+compareKey (const void* a, size_t alen, const void* b, size_t blen)
+{
+    int rc = memcmp (a, b, std::min (alen, blen));
+    if (rc != 0)
+        return rc;
+
+    return alen < blen ? -1 : (alen > blen ? 1 : 0);
+}
+
+inline bool
+hasPrefix (const he_item* item, const char* prefix, size_t len)
+{
+    return item->key_len >= len && memcmp (item->key, prefix, len) == 0;
+}
+
+/*
+ * Split the keys starting with prefix into at most parts contiguous ranges
+ * for parallel workers. bounds receives the ordered start key of every
+ * range, range i ends at bounds[i + 1] and the last one at the end of the
+ * prefix. Split points are found by seeking iterators to each possible next
+ * key byte, descending a few bytes until there are enough populated
+ * branches, so the ranges hold similar numbers of branches rather than
+ * exactly equal item counts. Safe to call without the GIL.
+ */
+bool heliumdbSplitKeys (heliumdbBackend* he,
+                        const std::string& prefix,
+                        size_t parts,
+                        std::vector<std::string>& bounds);
@@ -0,0 +1,704 @@
+#include "backend.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+/*
+ * Ordered in-process engine for url="mem://...". Handles opened with the
+ * same url and datastore share one store, which is dropped when the last of
+ * them closes, so scratch stores cost nothing once closed. Writes are
+ * visible immediately and commit has nothing to do, except on transactions
+ * which stage writes in an overlay until commit applies it under the store
+ * lock.
+ */
+typedef map<string, string> memItems;
+
+typedef struct
+{
+    mutex       mLock;
+    memItems    mItems;
+    /* key and value bytes of all items */
+    uint64_t    mBytes;
+    /* handles and transactions open on the store */
+    size_t      mHandles;
+    string      mPath;
+} memStore;
+
+/* staged write of a transaction */
+typedef struct
+{
+    bool        mDeleted;
+    string      mVal;
+} memStaged;
+
+typedef map<string, memStaged> memOverlay;
+
+static mutex                    storesLock;
+static map<string, memStore*>   stores;
+
+static void
+retainStore (memStore* store)
+{
+    lock_guard<mutex> guard (storesLock);
+    store->mHandles++;
+}
+
+static void
+releaseStore (memStore* store)
+{
+    lock_guard<mutex> guard (storesLock);
+    if (--store->mHandles == 0)
+    {
+        stores.erase (store->mPath);
+        delete store;
+    }
+}
+
+static inline string
+keyOf (const he_item* item)
+{
+    return string ((const char*)item->key, item->key_len);
+}
+
+/* copies up to len bytes of val from off, val_len gets the full size like
+ * he_lookup so callers can retry with a larger buffer */
+static void
+copyVal (he_item* item, const string& val, size_t off, size_t len)
+{
+    size_t avail = off < val.size () ? val.size () - off : 0;
+
+    len = min (len, avail);
+    if (len > 0)
+        memcpy (item->val, val.data () + off, len);
+    item->val_len = val.size ();
+}
+
+static inline int
+fail (int err)
+{
+    errno = err;
+    return -1;
+}
+
+/* fills item from a cursor position, key and value copied into the cursor */
+static const he_item*
+cursorItem (he_item& item, string& key, string& val, const string& k, const string& v,
+            size_t maxValLen)
+{
+    key = k;
+    val.assign (v, 0, min (v.size (), maxValLen));
+
+    item.key = (void*)key.data ();
+    item.key_len = key.size ();
+    item.val = (void*)val.data ();
+    item.val_len = val.size ();
+    return &item;
+}
+
+class heliumdbMemCursor : public heliumdbCursor
+{
+public:
+    heliumdbMemCursor (memStore* store, const void* key, size_t keyLen, size_t maxValLen)
+        : mStore (store),
+          mKey ((const char*)key, key ? keyLen : 0),
+          mMaxValLen (maxValLen),
+          mStarted (false)
+    {
+    }
+
+    /* resumes after the last key returned, so items written meanwhile are
+     * seen if they sort later, as on a helium volume */
+    const he_item* next ()
+    {
+        lock_guard<mutex>   guard (mStore->mLock);
+        memItems::iterator  it = mStarted ? mStore->mItems.upper_bound (mKey)
+                                          : mStore->mItems.lower_bound (mKey);
+
+        if (it == mStore->mItems.end ())
+            return NULL;
+
+        mStarted = true;
+        return cursorItem (mItem, mKey, mVal, it->first, it->second, mMaxValLen);
+    }
+
+private:
+    memStore*   mStore;
+    string      mKey;
+    string      mVal;
+    size_t      mMaxValLen;
+    bool        mStarted;
+    he_item     mItem;
+};
+
+class heliumdbMem : public heliumdbBackend
+{
+public:
+    heliumdbMem (memStore* store, const char* name, bool readOnly)
+        : mStore (store),
+          mName (name),
+          mReadOnly (readOnly)
+    {
+    }
+
+    ~heliumdbMem ()
+    {
+        releaseStore (mStore);
+    }
+
+    int lookup (he_item* item, size_t off, size_t len)
+    {
+        lock_guard<mutex>   guard (mStore->mLock);
+        memItems::iterator  it = mStore->mItems.find (keyOf (item));
+
+        if (it == mStore->mItems.end ())
+            return fail (ENOENT);
+
+        copyVal (item, it->second, off, len);
+        return 0;
+    }
+
+    int deleteLookup (he_item* item, size_t off, size_t len)
+    {
+        if (mReadOnly)
+            return fail (EROFS);
+
+        lock_guard<mutex>   guard (mStore->mLock);
+        memItems::iterator  it = mStore->mItems.find (keyOf (item));
+
+        if (it == mStore->mItems.end ())
+            return fail (ENOENT);
+
+        copyVal (item, it->second, off, len);
+        mStore->mBytes -= it->first.size () + it->second.size ();
+        mStore->mItems.erase (it);
+        return 0;
+    }
+
+    int prev (he_item* item, size_t off, size_t len)
+    {
+        lock_guard<mutex>   guard (mStore->mLock);
+        memItems&           items = mStore->mItems;
+        memItems::iterator  it = item->key_len ? items.lower_bound (keyOf (item)) : items.end ();
+
+        if (it == items.begin ())
+            return fail (ENOENT);
+
+        --it;
+        memcpy (item->key, it->first.data (), it->first.size ());
+        item->key_len = it->first.size ();
+        copyVal (item, it->second, off, len);
+        return 0;
+    }
+
+    int exists (const he_item* item)
+    {
+        lock_guard<mutex> guard (mStore->mLock);
+        return mStore->mItems.count (keyOf (item)) ? 0 : fail (ENOENT);
+    }
+
+    int update (const he_item* item)
+    {
+        if (mReadOnly)
+            return fail (EROFS);
+
+        lock_guard<mutex>   guard (mStore->mLock);
+        string              key = keyOf (item);
+        memItems::iterator  it = mStore->mItems.lower_bound (key);
+
+        if (it == mStore->mItems.end () || it->first != key)
+        {
+            it = mStore->mItems.insert (it, make_pair (key, string ()));
+            mStore->mBytes += key.size ();
+        }
+
+        mStore->mBytes += item->val_len;
+        mStore->mBytes -= it->second.size ();
+        it->second.assign ((const char*)item->val, item->val_len);
+        return 0;
+    }
+
+    int erase (const he_item* item)
+    {
+        if (mReadOnly)
+            return fail (EROFS);
+
+        lock_guard<mutex>   guard (mStore->mLock);
+        memItems::iterator  it = mStore->mItems.find (keyOf (item));
+
+        if (it == mStore->mItems.end ())
+            return fail (ENOENT);
+
+        mStore->mBytes -= it->first.size () + it->second.size ();
+        mStore->mItems.erase (it);
+        return 0;
+    }
+
+    heliumdbCursor* iterate (const void* key, size_t keyLen, size_t maxValLen)
+    {
+        return new heliumdbMemCursor (mStore, key, keyLen, maxValLen);
+    }
+
+    int commit ()
+    {
+        return 0;
+    }
+
+    int remove ()
+    {
+        if (mReadOnly)
+            return fail (EROFS);
+
+        lock_guard<mutex> guard (mStore->mLock);
+        mStore->mItems.clear ();
+        mStore->mBytes = 0;
+        return 0;
+    }
+
+    int stats (struct he_stats* stats)
+    {
+        lock_guard<mutex> guard (mStore->mLock);
+
+        memset (stats, 0, sizeof (*stats));
+        stats->name = mName.c_str ();
+        stats->valid_items = mStore->mItems.size ();
+        stats->utilized = mStore->mBytes;
+        return 0;
+    }
+
+    heliumdbBackend* transaction ();
+
+    int discard ()
+    {
+        return fail (EINVAL);
+    }
+
+private:
+    memStore*   mStore;
+    string      mName;
+    bool        mReadOnly;
+};
+
+class heliumdbMemTxn : public heliumdbBackend
+{
+public:
+    heliumdbMemTxn (memStore* store, const string& name)
+        : mStore (store),
+          mName (name)
+    {
+        retainStore (mStore);
+    }
+
+    ~heliumdbMemTxn ()
+    {
+        releaseStore (mStore);
+    }
+
+    int lookup (he_item* item, size_t off, size_t len)
+    {
+        heliumdbTxnCall call (&mState);
+        if (!call.ok ())
+            return -1;
+
+        lock_guard<mutex>   guard (mLock);
+        lock_guard<mutex>   storeGuard (mStore->mLock);
+        const string*       val = find (keyOf (item));
+
+        if (val == NULL)
+            return fail (ENOENT);
+
+        copyVal (item, *val, off, len);
+        return 0;
+    }
+
+    int deleteLookup (he_item* item, size_t off, size_t len)
+    {
+        heliumdbTxnCall call (&mState);
+        if (!call.ok ())
+            return -1;
+
+        lock_guard<mutex>   guard (mLock);
+        lock_guard<mutex>   storeGuard (mStore->mLock);
+        string              key = keyOf (item);
+        const string*       val = find (key);
+
+        if (val == NULL)
+            return fail (ENOENT);
+
+        copyVal (item, *val, off, len);
+        stageDelete (key);
+        return 0;
+    }
+
+    int prev (he_item* item, size_t off, size_t len)
+    {
+        heliumdbTxnCall call (&mState);
+        if (!call.ok ())
+            return -1;
+
+        lock_guard<mutex>   guard (mLock);
+        lock_guard<mutex>   storeGuard (mStore->mLock);
+        string              key = keyOf (item);
+        const string*       val;
+
+        if (!seekBack (key, item->key_len == 0, key, val))
+            return fail (ENOENT);
+
+        memcpy (item->key, key.data (), key.size ());
+        item->key_len = key.size ();
+        copyVal (item, *val, off, len);
+        return 0;
+    }
+
+    int exists (const he_item* item)
+    {
+        heliumdbTxnCall call (&mState);
+        if (!call.ok ())
+            return -1;
+
+        lock_guard<mutex> guard (mLock);
+        lock_guard<mutex> storeGuard (mStore->mLock);
+        return find (keyOf (item)) ? 0 : fail (ENOENT);
+    }
+
+    int update (const he_item* item)
+    {
+        heliumdbTxnCall call (&mState);
+        if (!call.ok ())
+            return -1;
+
+        lock_guard<mutex>   guard (mLock);
+        memStaged&          staged = mStaged[keyOf (item)];
+
+        staged.mDeleted = false;
+        staged.mVal.assign ((const char*)item->val, item->val_len);
+        return 0;
+    }
+
+    int erase (const he_item* item)
+    {
+        heliumdbTxnCall call (&mState);
+        if (!call.ok ())
+            return -1;
+
+        lock_guard<mutex>   guard (mLock);
+        lock_guard<mutex>   storeGuard (mStore->mLock);
+        string              key = keyOf (item);
+
+        if (find (key) == NULL)
+            return fail (ENOENT);
+
+        stageDelete (key);
+        return 0;
+    }
+
+    heliumdbCursor* iterate (const void* key, size_t keyLen, size_t maxValLen);
+
+    /* publishes the staged writes at once, other handles never see part
+     * of them */
+    int commit ()
+    {
+        if (!mState.end ())
+            return -1;
+
+        lock_guard<mutex> guard (mLock);
+        lock_guard<mutex> storeGuard (mStore->mLock);
+
+        for (memOverlay::iterator o = mStaged.begin (); o != mStaged.end (); ++o)
+        {
+            memItems::iterator it = mStore->mItems.find (o->first);
+            if (it != mStore->mItems.end ())
+            {
+                mStore->mBytes -= it->first.size () + it->second.size ();
+                if (o->second.mDeleted)
+                {
+                    mStore->mItems.erase (it);
+                    continue;
+                }
+                it->second.swap (o->second.mVal);
+            }
+            else if (!o->second.mDeleted)
+            {
+                it = mStore->mItems.insert (make_pair (o->first, string ())).first;
+                it->second.swap (o->second.mVal);
+            }
+            else
+                continue;
+
+            mStore->mBytes += it->first.size () + it->second.size ();
+        }
+
+        mStaged.clear ();
+        return 0;
+    }
+
+    int discard ()
+    {
+        if (!mState.end ())
+            return -1;
+
+        lock_guard<mutex> guard (mLock);
+        mStaged.clear ();
+        return 0;
+    }
+
+    /* stages deletes of every item visible to the transaction */
+    int remove ()
+    {
+        heliumdbTxnCall call (&mState);
+        if (!call.ok ())
+            return -1;
+
+        lock_guard<mutex> guard (mLock);
+        lock_guard<mutex> storeGuard (mStore->mLock);
+
+        for (memItems::iterator it = mStore->mItems.begin (); it != mStore->mItems.end (); ++it)
+            stageDelete (it->first);
+        for (memOverlay::iterator o = mStaged.begin (); o != mStaged.end (); ++o)
+            stageDelete (o->first);
+        return 0;
+    }
+
+    int stats (struct he_stats* stats)
+    {
+        heliumdbTxnCall call (&mState);
+        if (!call.ok ())
+            return -1;
+
+        lock_guard<mutex> guard (mLock);
+        lock_guard<mutex> storeGuard (mStore->mLock);
+
+        memset (stats, 0, sizeof (*stats));
+        stats->name = mName.c_str ();
+        stats->valid_items = mStore->mItems.size ();
+        stats->utilized = mStore->mBytes;
+
+        for (memOverlay::const_iterator o = mStaged.begin (); o != mStaged.end (); ++o)
+        {
+            memItems::const_iterator it = mStore->mItems.find (o->first);
+            if (it != mStore->mItems.end ())
+            {
+                stats->valid_items--;
+                stats->utilized -= it->first.size () + it->second.size ();
+            }
+            if (!o->second.mDeleted)
+            {
+                stats->valid_items++;
+                stats->utilized += o->first.size () + o->second.mVal.size ();
+            }
+        }
+        return 0;
+    }
+
+    heliumdbBackend* transaction ()
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* first key after from visible to the transaction, or at from when
+     * inclusive. Callers hold both locks */
+    bool seek (const string& from, bool inclusive, string& key, const string*& val)
+    {
+        string cur = from;
+
+        for (;;)
+        {
+            memItems::iterator  s = inclusive ? mStore->mItems.lower_bound (cur)
+                                              : mStore->mItems.upper_bound (cur);
+            memOverlay::iterator o = inclusive ? mStaged.lower_bound (cur)
+                                               : mStaged.upper_bound (cur);
+            bool                hasStore = s != mStore->mItems.end ();
+            bool                hasStaged = o != mStaged.end ();
+
+            if (!hasStore && !hasStaged)
+                return false;
+
+            if (hasStaged && (!hasStore || o->first <= s->first))
+            {
+                if (!o->second.mDeleted)
+                {
+                    key = o->first;
+                    val = &o->second.mVal;
+                    return true;
+                }
+                cur = o->first;
+                inclusive = false;
+                continue;
+            }
+
+            key = s->first;
+            val = &s->second;
+            return true;
+        }
+    }
+
+    mutex mLock;
+
+private:
+    /* value of key as the transaction sees it, NULL if missing. Callers
+     * hold both locks */
+    const string* find (const string& key)
+    {
+        memOverlay::iterator o = mStaged.find (key);
+        if (o != mStaged.end ())
+            return o->second.mDeleted ? NULL : &o->second.mVal;
+
+        memItems::iterator it = mStore->mItems.find (key);
+        return it == mStore->mItems.end () ? NULL : &it->second;
+    }
+
+    void stageDelete (const string& key)
+    {
+        memStaged& staged = mStaged[key];
+        staged.mDeleted = true;
+        staged.mVal.clear ();
+    }
+
+    /* last visible key before from, or the last key when fromEnd */
+    bool seekBack (const string& from, bool fromEnd, string& key, const string*& val)
+    {
+        string cur = from;
+
+        for (;;)
+        {
+            memItems::iterator  s = fromEnd ? mStore->mItems.end ()
+                                            : mStore->mItems.lower_bound (cur);
+            memOverlay::iterator o = fromEnd ? mStaged.end () : mStaged.lower_bound (cur);
+            bool                hasStore = s != mStore->mItems.begin ();
+            bool                hasStaged = o != mStaged.begin ();
+
+            if (!hasStore && !hasStaged)
+                return false;
+            if (hasStore)
+                --s;
+            if (hasStaged)
+                --o;
+
+            if (hasStaged && (!hasStore || o->first >= s->first))
+            {
+                if (!o->second.mDeleted)
+                {
+                    key = o->first;
+                    val = &o->second.mVal;
+                    return true;
+                }
+                cur = o->first;
+                fromEnd = false;
+                continue;
+            }
+
+            key = s->first;
+            val = &s->second;
+            return true;
+        }
+    }
+
+    memStore*           mStore;
+    string              mName;
+    memOverlay          mStaged;
+    heliumdbTxnState    mState;
+
+    friend class heliumdbMemTxnCursor;
+};
+
+/* merges the transaction's staged writes over the store */
+class heliumdbMemTxnCursor : public heliumdbCursor
+{
+public:
+    heliumdbMemTxnCursor (heliumdbMemTxn* txn, const void* key, size_t keyLen, size_t maxValLen)
+        : mTxn (txn),
+          mKey ((const char*)key, key ? keyLen : 0),
+          mMaxValLen (maxValLen),
+          mStarted (false)
+    {
+        mTxn->mState.mCursors++;
+    }
+
+    /* the transaction cannot end while cursors are open */
+    ~heliumdbMemTxnCursor ()
+    {
+        mTxn->mState.mCursors--;
+    }
+
+    const he_item* next ()
+    {
+        lock_guard<mutex>   guard (mTxn->mLock);
+        lock_guard<mutex>   storeGuard (mTxn->mStore->mLock);
+        string              key;
+        const string*       val;
+
+        if (!mTxn->seek (mKey, !mStarted, key, val))
+            return NULL;
+
+        mStarted = true;
+        return cursorItem (mItem, mKey, mVal, key, *val, mMaxValLen);
+    }
+
+private:
+    heliumdbMemTxn* mTxn;
+    string          mKey;
+    string          mVal;
+    size_t          mMaxValLen;
+    bool            mStarted;
+    he_item         mItem;
+};
+
+heliumdbCursor*
+heliumdbMemTxn::iterate (const void* key, size_t keyLen, size_t maxValLen)
+{
+    heliumdbTxnCall call (&mState);
+    if (!call.ok ())
+        return NULL;
+
+    return new heliumdbMemTxnCursor (this, key, keyLen, maxValLen);
+}
+
+heliumdbBackend*
+heliumdbMem::transaction ()
+{
+    if (mReadOnly)
+    {
+        errno = EROFS;
+        return NULL;
+    }
+
+    return new heliumdbMemTxn (mStore, mName);
+}
+
+heliumdbBackend*
+heliumdbOpenMem (const char* url, const char* name, int flags)
+{
+    lock_guard<mutex>   guard (storesLock);
+    string              path = string (url) + "/" + name;
+    memStore*&          store = stores[path];
+
+    if (store == NULL)
+    {
+        if (!(flags & HE_O_CREATE))
+        {
+            stores.erase (path);
+            errno = ENOENT;
+            return NULL;
+        }
+        store = new memStore ();
+        store->mBytes = 0;
+        store->mHandles = 0;
+        store->mPath = path;
+    }
+    else if (flags & HE_O_TRUNCATE)
+    {
+        lock_guard<mutex> storeGuard (store->mLock);
+        store->mItems.clear ();
+        store->mBytes = 0;
+    }
+
+    store->mHandles++;
+    return new heliumdbMem (store, name, flags & HE_O_READONLY);
+}
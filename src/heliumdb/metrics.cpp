@@ -0,0 +1,199 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+static const char* opNames[OP_COUNT] = {
+    "get", "put", "delete", "exists", "iter_next", "commit"
+};
+
+static const char* phaseNames[PHASE_COUNT] = {
+    "serialize", "store", "gil", "deserialize", "total"
+};
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+const char*
+heliumdbOpName (heliumdbOp op)
+{
+    return op < OP_COUNT ? opNames[op] : "unknown";
+}
+
+static inline size_t
+bucketOf (uint64_t ns)
+{
+    if (ns < (1 << METRICS_SUB_BITS))
+        return ns;
+
+    int exp = 63 - __builtin_clzll (ns);
+    size_t sub = (ns >> (exp - METRICS_SUB_BITS)) & ((1 << METRICS_SUB_BITS) - 1);
+
+    return ((exp - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS) + sub;
+}
+
+/* midpoint of the values falling into bucket i */
+static uint64_t
+bucketValue (size_t i)
+{
+    if (i < (1 << METRICS_SUB_BITS))
+        return i;
+
+    int         exp = (i >> METRICS_SUB_BITS) + METRICS_SUB_BITS - 1;
+    uint64_t    sub = i & ((1 << METRICS_SUB_BITS) - 1);
+    uint64_t    width = 1ULL << (exp - METRICS_SUB_BITS);
+    uint64_t    low = ((1ULL << METRICS_SUB_BITS) + sub) << (exp - METRICS_SUB_BITS);
+
+    return low + width / 2;
+}
+
+heliumdbMetrics::heliumdbMetrics ()
+{
+    reset ();
+}
+
+void
+heliumdbMetrics::record (heliumdbOp op, heliumdbPhase phase, uint64_t ns)
+{
+    histogram& h = mHistograms[op][phase];
+
+    h.mCount.fetch_add (1, memory_order_relaxed);
+    h.mSum.fetch_add (ns, memory_order_relaxed);
+    h.mBuckets[bucketOf (ns)].fetch_add (1, memory_order_relaxed);
+
+    uint64_t max = h.mMax.load (memory_order_relaxed);
+    while (ns > max && !h.mMax.compare_exchange_weak (max, ns, memory_order_relaxed))
+        ;
+}
+
+void
+heliumdbMetrics::reset ()
+{
+    for (int op = 0; op < OP_COUNT; ++op)
+    {
+        for (int phase = 0; phase < PHASE_COUNT; ++phase)
+        {
+            histogram& h = mHistograms[op][phase];
+            h.mCount.store (0, memory_order_relaxed);
+            h.mSum.store (0, memory_order_relaxed);
+            h.mMax.store (0, memory_order_relaxed);
+            for (size_t i = 0; i < METRICS_BUCKETS; ++i)
+                h.mBuckets[i].store (0, memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t
+heliumdbMetrics::quantile (const histogram& h, uint64_t count, double q)
+{
+    uint64_t rank = (uint64_t)(q * count);
+    uint64_t seen = 0;
+    uint64_t max = h.mMax.load (memory_order_relaxed);
+
+    for (size_t i = 0; i < METRICS_BUCKETS; ++i)
+    {
+        seen += h.mBuckets[i].load (memory_order_relaxed);
+        if (seen > rank)
+            return min (bucketValue (i), max);
+    }
+
+    return max;
+}
+
+static bool
+setField (PyObject* dict, const char* name, PyObject* v)
+{
+    if (v == NULL)
+        return false;
+
+    int rc = PyDict_SetItemString (dict, name, v);
+    Py_DECREF (v);
+    return rc == 0;
+}
+
+PyObject*
+heliumdbMetrics::toDict () const
+{
+    PyObject* res = PyDict_New ();
+    if (res == NULL)
+        return NULL;
+
+    for (int op = 0; op < OP_COUNT; ++op)
+    {
+        PyObject* phases = PyDict_New ();
+        if (!setField (res, opNames[op], phases))
+        {
+            Py_DECREF (res);
+            return NULL;
+        }
+
+        for (int phase = 0; phase < PHASE_COUNT; ++phase)
+        {
+            const histogram&    h = mHistograms[op][phase];
+            uint64_t            count = h.mCount.load (memory_order_relaxed);
+            if (count == 0)
+                continue;
+
+            PyObject*   stats = PyDict_New ();
+            bool        ok = setField (phases, phaseNames[phase], stats) &&
+                setField (stats, "count", PyLong_FromUnsignedLongLong (count)) &&
+                setField (stats, "mean_ns", PyFloat_FromDouble (
+                    (double)h.mSum.load (memory_order_relaxed) / count)) &&
+                setField (stats, "p50_ns", PyLong_FromUnsignedLongLong (quantile (h, count, 0.5))) &&
+                setField (stats, "p90_ns", PyLong_FromUnsignedLongLong (quantile (h, count, 0.9))) &&
+                setField (stats, "p99_ns", PyLong_FromUnsignedLongLong (quantile (h, count, 0.99))) &&
+                setField (stats, "p999_ns", PyLong_FromUnsignedLongLong (quantile (h, count, 0.999))) &&
+                setField (stats, "max_ns", PyLong_FromUnsignedLongLong (
+                    h.mMax.load (memory_order_relaxed)));
+            if (!ok)
+            {
+                Py_DECREF (res);
+                return NULL;
+            }
+        }
+    }
+
+    return res;
+}
+
+PyObject*
+heliumdbMetrics::toPrometheus () const
+{
+    string  out;
+    char    line[256];
+
+    out += "# HELP heliumdb_op_latency_seconds Latency of heliumdb operations by phase.\n";
+    out += "# TYPE heliumdb_op_latency_seconds summary\n";
+
+    for (int op = 0; op < OP_COUNT; ++op)
+    {
+        for (int phase = 0; phase < PHASE_COUNT; ++phase)
+        {
+            const histogram&    h = mHistograms[op][phase];
+            uint64_t            count = h.mCount.load (memory_order_relaxed);
+            if (count == 0)
+                continue;
+
+            for (size_t i = 0; i < sizeof (quantiles) / sizeof (quantiles[0]); ++i)
+            {
+                snprintf (line, sizeof (line),
+                          "heliumdb_op_latency_seconds{op=\"%s\",phase=\"%s\",quantile=\"%g\"} %.9g\n",
+                          opNames[op], phaseNames[phase], quantiles[i],
+                          quantile (h, count, quantiles[i]) / 1e9);
+                out += line;
+            }
+
+            snprintf (line, sizeof (line),
+                      "heliumdb_op_latency_seconds_sum{op=\"%s\",phase=\"%s\"} %.9g\n"
+                      "heliumdb_op_latency_seconds_count{op=\"%s\",phase=\"%s\"} %llu\n",
+                      opNames[op], phaseNames[phase],
+                      h.mSum.load (memory_order_relaxed) / 1e9,
+                      opNames[op], phaseNames[phase], (unsigned long long)count);
+            out += line;
+        }
+    }
+
+    return PyUnicode_FromStringAndSize (out.data (), out.size ());
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <Python.h>
+#include "he.h"
+#include "probes.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+enum heliumdbOp
+{
+    OP_GET,
+    OP_PUT,
+    OP_DELETE,
+    OP_EXISTS,
+    OP_ITER_NEXT,
+    OP_COMMIT,
+    OP_COUNT
+};
+
+enum heliumdbPhase
+{
+    /* python objects to stored bytes */
+    PHASE_SERIALIZE,
+    /* the helium call, or the write buffer or cache standing in for it */
+    PHASE_STORE,
+    /* from the end of the store call until the GIL is held again */
+    PHASE_GIL,
+    /* stored bytes to python objects */
+    PHASE_DESERIALIZE,
+    PHASE_TOTAL,
+    PHASE_COUNT
+};
+
+/* log-linear buckets, 8 per power of two so a bucket spans at most 12.5% */
+#define METRICS_SUB_BITS    3
+#define METRICS_BUCKETS     ((64 - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+
+/*
+ * Latency histograms per operation and phase of a handle opened with
+ * metrics=True. Recording is a few relaxed atomic adds and safe from any
+ * thread, reset races benignly with concurrent recording.
+ */
+class heliumdbMetrics
+{
+public:
+    heliumdbMetrics ();
+
+    void record (heliumdbOp op, heliumdbPhase phase, uint64_t ns);
+
+    void reset ();
+
+    /* {op: {phase: {count, mean_ns, p50_ns, p90_ns, p99_ns, p999_ns,
+     * max_ns}}} of the phases recorded so far */
+    PyObject* toDict () const;
+
+    /* prometheus text exposition of the same histograms as summaries */
+    PyObject* toPrometheus () const;
+
+private:
+    typedef struct
+    {
+        std::atomic<uint64_t>   mCount;
+        std::atomic<uint64_t>   mSum;
+        std::atomic<uint64_t>   mMax;
+        std::atomic<uint64_t>   mBuckets[METRICS_BUCKETS];
+    } histogram;
+
+    /* ns value at quantile q of h, which holds count samples */
+    static uint64_t quantile (const histogram& h, uint64_t count, double q);
+
+    histogram mHistograms[OP_COUNT][PHASE_COUNT];
+};
+
+/* name of op in metrics output and probe arguments */
+const char* heliumdbOpName (heliumdbOp op);
+
+/* true while a tracer is attached to the probe of op or a phase probe */
+inline bool
+heliumdbProbing (heliumdbOp op)
+{
+    if (HELIUMDB_PROBE_ENABLED (serialize) || HELIUMDB_PROBE_ENABLED (deserialize))
+        return true;
+
+    switch (op)
+    {
+    case OP_GET:        return HELIUMDB_PROBE_ENABLED (get);
+    case OP_PUT:        return HELIUMDB_PROBE_ENABLED (put);
+    case OP_DELETE:     return HELIUMDB_PROBE_ENABLED (delete);
+    case OP_EXISTS:     return HELIUMDB_PROBE_ENABLED (exists);
+    case OP_ITER_NEXT:  return HELIUMDB_PROBE_ENABLED (iter_next);
+    case OP_COMMIT:     return HELIUMDB_PROBE_ENABLED (commit);
+    default:            return false;
+    }
+}
+
+inline uint64_t
+heliumdbNow ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Times the phases of one operation for metrics and fires the USDT probes
+ * of the operation, reading key and value lengths from item. Every call is
+ * a single branch when metrics are disabled and no tracer is attached.
+ * phase () closes the phase started by the previous call, done () records
+ * the total.
+ */
+class heliumdbTimer
+{
+public:
+    heliumdbTimer (heliumdbMetrics* metrics, heliumdbOp op, const he_item* item = NULL)
+        : mMetrics (metrics),
+          mOp (op),
+          mItem (item),
+          mStart (0),
+          mLast (0),
+          mEnabled (metrics != NULL || heliumdbProbing (op))
+    {
+        if (mEnabled)
+            mStart = mLast = heliumdbNow ();
+    }
+
+    void item (const he_item* item)
+    {
+        mItem = item;
+    }
+
+    void phase (heliumdbPhase phase)
+    {
+        if (mEnabled)
+        {
+            uint64_t now = heliumdbNow ();
+            if (mMetrics)
+                mMetrics->record (mOp, phase, now - mLast);
+            if (phase == PHASE_SERIALIZE)
+                HELIUMDB_PROBE (serialize, heliumdbOpName (mOp), keyLen (), valLen (), 0, now - mLast);
+            else if (phase == PHASE_DESERIALIZE)
+                HELIUMDB_PROBE (deserialize, heliumdbOpName (mOp), keyLen (), valLen (), 0, now - mLast);
+            mLast = now;
+        }
+    }
+
+    /* rc is what the store call returned, 0 on success */
+    void done (int rc = 0)
+    {
+        if (!mEnabled)
+            return;
+
+        uint64_t ns = heliumdbNow () - mStart;
+        if (mMetrics)
+            mMetrics->record (mOp, PHASE_TOTAL, ns);
+
+        switch (mOp)
+        {
+        case OP_GET:
+            HELIUMDB_PROBE (get, "get", keyLen (), valLen (), rc, ns);
+            break;
+        case OP_PUT:
+            HELIUMDB_PROBE (put, "put", keyLen (), valLen (), rc, ns);
+            break;
+        case OP_DELETE:
+            HELIUMDB_PROBE (delete, "delete", keyLen (), valLen (), rc, ns);
+            break;
+        case OP_EXISTS:
+            HELIUMDB_PROBE (exists, "exists", keyLen (), valLen (), rc, ns);
+            break;
+        case OP_ITER_NEXT:
+            HELIUMDB_PROBE (iter_next, "iter_next", keyLen (), valLen (), rc, ns);
+            break;
+        case OP_COMMIT:
+            HELIUMDB_PROBE (commit, "commit", keyLen (), valLen (), rc, ns);
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    size_t keyLen () const
+    {
+        return mItem ? mItem->key_len : 0;
+    }
+
+    size_t valLen () const
+    {
+        return mItem ? mItem->val_len : 0;
+    }
+
+    heliumdbMetrics*    mMetrics;
+    heliumdbOp          mOp;
+    const he_item*      mItem;
+    uint64_t            mStart;
+    uint64_t            mLast;
+    bool                mEnabled;
+};
@@ -2,6 +2,8 @@
 
 using namespace std;
 
+PyObject* HeliumDbException = NULL;
+
 struct module_state 
 {
     PyObject* error;
@@ -25,17 +27,178 @@ setEnvVariable (PyObject* kwargs, const char* param, T val, T& o)
         o = val;
 }
 
-PyObject*
-heliumdb_contains (heliumdbPy* self, PyObject* k)
+bool
+heliumdbBloomMiss (heliumdbPy* self, const void* key, size_t keyLen)
 {
-    he_item item;
+    if (self->mBloom == NULL)
+        return false;
+
+    if (!self->mBloom->mayContain (key, keyLen))
+    {
+        self->mBloom->mAvoided++;
+        return true;
+    }
+
+    self->mBloom->mMaybe++;
+    return false;
+}
+
+/* count a lookup the bloom filter let through that found nothing */
+static inline void
+bloomFalsePositive (heliumdbPy* self)
+{
+    if (self->mBloom)
+        self->mBloom->mFalsePositives++;
+}
+
+/* 1 if H has key k, 0 if not, -1 on error */
+static int
+containsKey (heliumdbPy* self, PyObject* k)
+{
+    he_item         item = {};
+    heliumdbTimer   timer (self->mMetrics, OP_EXISTS, &item);
+
     if (!self->mKeySerializer (k, item.key, item.key_len))
     {
         PyErr_SetString (HeliumDbException, "could not serialize key object");
+        return -1;
+    }
+    timer.phase (PHASE_SERIALIZE);
+
+    int     rc = -1;
+    string  pending;
+
+    if (heliumdbBloomMiss (self, item.key, item.key_len))
+    {
+        timer.phase (PHASE_STORE);
+        timer.done (ENOENT);
+        return 0;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    if (self->mWriteBuffer)
+        rc = self->mWriteBuffer->find (item.key, item.key_len, pending);
+    if (rc < 0)
+        rc = self->mDatastore->exists (&item) == 0;
+    timer.phase (PHASE_STORE);
+    Py_END_ALLOW_THREADS
+    timer.phase (PHASE_GIL);
+
+    if (rc == 0)
+        bloomFalsePositive (self);
+
+    timer.done (rc ? 0 : ENOENT);
+    return rc;
+}
+
+PyObject*
+heliumdb_contains (heliumdbPy* self, PyObject* k)
+{
+    int rc = containsKey (self, k);
+    if (rc < 0)
+        return NULL;
+
+    return PyBool_FromLong (rc);
+}
+
+bool
+heliumdbFlushWrites (heliumdbPy* self)
+{
+    if (self->mWriteBuffer == NULL)
+        return true;
+
+    string  err;
+    bool    ok;
+
+    Py_BEGIN_ALLOW_THREADS
+    ok = self->mWriteBuffer->flush (err);
+    Py_END_ALLOW_THREADS
+
+    if (!ok)
+    {
+        err = "write-behind flush failed: " + err;
+        PyErr_SetString (HeliumDbException, err.c_str ());
+    }
+
+    return ok;
+}
+
+void
+heliumdbInvalidate (heliumdbPy* self, const void* key, size_t keyLen)
+{
+    if (self->mObjectCache == NULL)
+        return;
+
+    if (key == NULL)
+        self->mObjectCache->clear ();
+    else
+        self->mObjectCache->invalidate (key, keyLen);
+}
+
+/* cached decoded value of key or NULL */
+static PyObject*
+cachedValue (heliumdbPy* self, const he_item& item)
+{
+    if (self->mObjectCache == NULL)
         return NULL;
+
+    return self->mObjectCache->get (item.key, item.key_len);
+}
+
+/* taken before the lookup of a value that may be cached */
+static uint64_t
+cacheGeneration (heliumdbPy* self)
+{
+    return self->mObjectCache ? self->mObjectCache->generation () : 0;
+}
+
+/* decode the looked up value, caching it when enabled and no write went
+ * through the handle since generation. The key is copied first as
+ * decoding may run python code reusing the key buffer */
+static PyObject*
+decodeValue (heliumdbPy* self, const he_item& item, uint64_t generation)
+{
+    string key;
+    if (self->mObjectCache)
+        key.assign ((const char*)item.key, item.key_len);
+
+    PyObject* obj = self->mValDeserializer (item.val, item.val_len);
+    if (obj == NULL)
+    {
+        PyErr_SetString (HeliumDbException, "failed to deserialize value object");
+        return NULL;
+    }
+
+    if (self->mObjectCache)
+        self->mObjectCache->put (key.data (), key.size (), obj, item.val_len, generation);
+
+    return obj;
+}
+
+/* lookup that sees writes still in the write-behind buffer, item.val may
+ * point into pending, called without the GIL */
+static int
+lookupItem (heliumdbPy* self, heliumdbBuffer& buffer, he_item& item, string& pending)
+{
+    if (heliumdbBloomMiss (self, item.key, item.key_len))
+        return -1;
+
+    if (self->mWriteBuffer)
+    {
+        int state = self->mWriteBuffer->find (item.key, item.key_len, pending);
+        if (state >= 0)
+        {
+            item.val = (void*)pending.data ();
+            item.val_len = pending.size ();
+            return state == 1 ? 0 : -1;
+        }
     }
 
-    return PyBool_FromLong (he_exists (self->mDatastore, &item) == 0);
+    int rc = buffer.lookup (self->mDatastore, item, false);
+    if (rc != 0)
+        bloomFalsePositive (self);
+
+    return rc;
 }
 
 int
@@ -58,6 +221,12 @@ heliumdbPy_init (heliumdbPy* self, PyObject* args, PyObject* kwargs)
     uint64_t retry_count;
     uint64_t retry_delay;
     uint64_t compress_threshold;
+    uint64_t write_buffer = 0;
+    double flush_interval = 0.1;
+    uint64_t object_cache = 0;
+    uint64_t bloom_filter = 0;
+    char* bloom_file = NULL;
+    int metrics = 0;
 
     char *kwlist[] = {(char*)"url",
                       (char*)"datastore",
@@ -75,11 +244,17 @@ heliumdbPy_init (heliumdbPy* self, PyObject* args, PyObject* kwargs)
                       (char*)"retry_count",
                       (char*)"retry_delay",
                       (char*)"compress_threshold",
+                      (char*)"write_buffer",
+                      (char*)"flush_interval",
+                      (char*)"object_cache",
+                      (char*)"bloom_filter",
+                      (char*)"bloom_file",
+                      (char*)"metrics",
                       NULL};
 
     if (!PyArg_ParseTupleAndKeywords(args,
                                      kwargs,
-                                     "|ssssKKKKKKKKKKK",
+                                     "|ssssKiKKKKKKKKKKKdKKsp",
                                      kwlist,
                                      &url,
                                      &datastore,
@@ -96,7 +271,13 @@ heliumdbPy_init (heliumdbPy* self, PyObject* args, PyObject* kwargs)
                                      &clean_dirty_pct,
                                      &retry_count,
                                      &retry_delay,
-                                     &compress_threshold))
+                                     &compress_threshold,
+                                     &write_buffer,
+                                     &flush_interval,
+                                     &object_cache,
+                                     &bloom_filter,
+                                     &bloom_file,
+                                     &metrics))
         return -1;
 
     if (url == NULL)
@@ -126,9 +307,12 @@ heliumdbPy_init (heliumdbPy* self, PyObject* args, PyObject* kwargs)
     setEnvVariable (kwargs, "retry_delay", retry_delay, env.retry_delay);
     setEnvVariable (kwargs, "compress_threshold", compress_threshold, env.compress_threshold);
 
+    if (self->mArena == NULL)
+        self->mArena = new heliumdbArena ();
+
     if (self->mDatastore == NULL)
     {
-        self->mDatastore = he_open (url, datastore, flags, &env);
+        self->mDatastore = heliumdbBackend::open (url, datastore, flags, &env);
         if (!self->mDatastore)
         {
             PyErr_SetString (HeliumDbException, he_strerror (errno));
@@ -143,7 +327,7 @@ heliumdbPy_init (heliumdbPy* self, PyObject* args, PyObject* kwargs)
     }
     else if (strcmp (key_type, "b") == 0)
     {
-        self->mKeySerializer = &serializeBytes;
+        self->mKeySerializer = &serializeBytesKey;
         self->mKeyDeserializer = &deserializeBytes;
     }
     else if (strcmp (key_type, "i") == 0)
@@ -161,12 +345,29 @@ heliumdbPy_init (heliumdbPy* self, PyObject* args, PyObject* kwargs)
         self->mKeySerializer = &serializeFloatKey;
         self->mKeyDeserializer = &deserializeFloat;
     }
+    else if (strcmp (key_type, "I") == 0)
+    {
+        self->mKeySerializer = &serializeOrderedIntKey;
+        self->mKeyDeserializer = &deserializeOrderedInt;
+    }
+    else if (strcmp (key_type, "F") == 0)
+    {
+        self->mKeySerializer = &serializeOrderedFloatKey;
+        self->mKeyDeserializer = &deserializeOrderedFloat;
+    }
+    else if (strcmp (key_type, "N") == 0)
+    {
+        self->mKeySerializer = &serializeNativeKey;
+        self->mKeyDeserializer = &deserializeNative;
+    }
     else
     {
         PyErr_SetString (HeliumDbException, "unsupported key_type");
         return -1;
     }
 
+    self->mKeyType = key_type == NULL ? 'O' : key_type[0];
+
     if (val_type == NULL || strcmp (val_type, "O") == 0)
     {
         self->mValSerializer = &serializeObject;
@@ -174,7 +375,7 @@ heliumdbPy_init (heliumdbPy* self, PyObject* args, PyObject* kwargs)
     }
     else if (strcmp (val_type, "b") == 0)
     {
-        self->mValSerializer = &serializeBytes;
+        self->mValSerializer = &serializeBytesVal;
         self->mValDeserializer = &deserializeBytes;
     }
     else if (strcmp (val_type, "i") == 0)
@@ -192,11 +393,68 @@ heliumdbPy_init (heliumdbPy* self, PyObject* args, PyObject* kwargs)
         self->mValSerializer = &serializeFloatVal;
         self->mValDeserializer = &deserializeFloat;
     }
+    else if (strcmp (val_type, "N") == 0)
+    {
+        self->mValSerializer = &serializeNativeVal;
+        self->mValDeserializer = &deserializeNative;
+    }
     else
     {
         PyErr_SetString (HeliumDbException, "unsupported val_type");
         return -1;
     }
+    self->mValType = val_type == NULL ? 'O' : val_type[0];
+
+    if (write_buffer > 0 && self->mWriteBuffer == NULL)
+    {
+        if (flush_interval <= 0)
+        {
+            PyErr_SetString (HeliumDbException, "flush_interval must be positive");
+            return -1;
+        }
+        self->mWriteBuffer = new heliumdbWriteBuffer (self->mDatastore, write_buffer, flush_interval);
+    }
+
+    if (object_cache > 0 && self->mObjectCache == NULL)
+        self->mObjectCache = new heliumdbObjectCache (object_cache);
+
+    if (metrics && self->mMetrics == NULL)
+        self->mMetrics = new heliumdbMetrics ();
+
+    if (bloom_filter > 0 && self->mBloom == NULL)
+    {
+        struct he_stats stats;
+        bool            ok;
+
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->mDatastore->stats (&stats) == 0;
+        Py_END_ALLOW_THREADS
+
+        if (!ok)
+        {
+            PyErr_SetString (HeliumDbException, he_strerror (errno));
+            return -1;
+        }
+
+        // a sidecar stamped with the current stats is trusted, anything
+        // else is rebuilt from the keys on disk
+        heliumdbBloom* bloom = new heliumdbBloom (max (bloom_filter, stats.valid_items));
+        if (bloom_file)
+            bloom->mFile = bloom_file;
+
+        Py_BEGIN_ALLOW_THREADS
+        bloom->mLoaded = bloom_file && bloom->load (bloom_file, stats);
+        ok = bloom->mLoaded || bloom->build (self->mDatastore);
+        Py_END_ALLOW_THREADS
+
+        if (!ok)
+        {
+            delete bloom;
+            PyErr_SetString (HeliumDbException, "failed to open iterator");
+            return -1;
+        }
+        self->mBloom = bloom;
+    }
 
     return 0;
 }
@@ -205,8 +463,25 @@ static void
 heliumdbPy_dealloc (heliumdbPy* self)
 {
     Py_BEGIN_ALLOW_THREADS
-    he_close (self->mDatastore);
+    delete self->mWriteBuffer;
+    if (self->mParent == NULL && self->mBloom && !self->mBloom->mFile.empty ())
+    {
+        struct he_stats stats;
+        if (self->mDatastore->stats (&stats) == 0)
+            self->mBloom->save (self->mBloom->mFile, stats);
+    }
+    /* a transaction still open is discarded */
+    delete self->mDatastore;
+    delete self->mFinished;
     Py_END_ALLOW_THREADS
+    if (self->mParent == NULL)
+    {
+        delete self->mBloom;
+        delete self->mMetrics;
+    }
+    Py_XDECREF (self->mParent);
+    delete self->mObjectCache;
+    delete self->mArena;
     Py_TYPE (self)->tp_free((PyObject*)self);
 }
 
@@ -215,8 +490,16 @@ heliumdb_cleanup (heliumdbPy* self)
 {
     int rc;
     Py_BEGIN_ALLOW_THREADS
-    rc = he_remove (self->mDatastore);
+    if (self->mWriteBuffer)
+        self->mWriteBuffer->discard ();
+    rc = self->mDatastore->remove ();
+    /* a transaction shares its parent's filter and may still be discarded,
+     * the stale keys left in it only cost false positives */
+    if (rc == 0 && self->mBloom && self->mParent == NULL)
+        self->mBloom->clear ();
     Py_END_ALLOW_THREADS
+
+    heliumdbInvalidate (self, NULL, 0);
     if (rc)
     {
         PyErr_SetString (HeliumDbException, he_strerror (errno));
@@ -236,17 +519,35 @@ heliumdb_get (heliumdbPy *self, PyObject *args)
     if (!PyArg_UnpackTuple (args, "get", 1, 2, &k, &failobj))
         return NULL; 
 
-    he_item item;
+    he_item         item = {};
+    heliumdbTimer   timer (self->mMetrics, OP_GET, &item);
+
     if (!self->mKeySerializer (k, item.key, item.key_len))
         return NULL;
+    timer.phase (PHASE_SERIALIZE);
+
+    PyObject* cached = cachedValue (self, item);
+    if (cached)
+    {
+        timer.phase (PHASE_STORE);
+        timer.done ();
+        return cached;
+    }
+
+    heliumdbBuffer  buffer (self->mArena);
+    string          pending;
+    uint64_t        generation = cacheGeneration (self);
 
     int rc;
     Py_BEGIN_ALLOW_THREADS
-    rc = he_exists (self->mDatastore, &item);
+    rc = lookupItem (self, buffer, item, pending);
+    timer.phase (PHASE_STORE);
     Py_END_ALLOW_THREADS
+    timer.phase (PHASE_GIL);
 
     if (rc != 0)
     {
+        timer.done (ENOENT);
         if (failobj == NULL)
         {
             PyErr_SetString (HeliumDbException, "key not found");
@@ -256,18 +557,18 @@ heliumdb_get (heliumdbPy *self, PyObject *args)
         return failobj;
     }
 
-    return heliumdb_subscript (self, k);
+    PyObject* obj = decodeValue (self, item, generation);
+    timer.phase (PHASE_DESERIALIZE);
+    timer.done ();
+
+    return obj;
 }
 
 static PyObject*
 heliumdb_del (heliumdbPy* self, PyObject *args)
 {
     PyObject *k;
-    PyObject *failobj = Py_None;
-
-    char* buffer[8096] = {0};
-    size_t rdSize = sizeof (buffer);
-    void* buf = NULL;
+    PyObject *failobj = NULL;
 
     if (!PyArg_UnpackTuple (args, "del", 1, 2, &k, &failobj))
     {
@@ -275,50 +576,67 @@ heliumdb_del (heliumdbPy* self, PyObject *args)
         return NULL;
     }
  
-    he_item item;
+    he_item         item = {};
+    heliumdbTimer   timer (self->mMetrics, OP_DELETE, &item);
+
     if (!self->mKeySerializer (k, item.key, item.key_len))
     {
         PyErr_SetString (HeliumDbException, "could not serialize key object");
         return NULL;
     }
-    item.val = (void*)buffer;
+    timer.phase (PHASE_SERIALIZE);
 
-    int rc;
-    for (;;)
+    if (heliumdbBloomMiss (self, item.key, item.key_len))
     {
-        Py_BEGIN_ALLOW_THREADS
-        rc = he_delete_lookup (self->mDatastore, &item, 0, rdSize);
-        Py_END_ALLOW_THREADS
-
-        if (rc != 0)
-        {
-            PyErr_SetString (HeliumDbException, he_strerror (errno));
-            Py_INCREF (failobj);
-            return failobj;
-        }
-        if (item.val_len > rdSize)
+        timer.phase (PHASE_STORE);
+        timer.done (ENOENT);
+        if (failobj == NULL)
         {
-            rdSize = item.val_len;
-            buf = malloc (rdSize);
-            item.val = buf;
+            PyErr_SetString (HeliumDbException, "key not found");
+            return NULL;
         }
+        Py_INCREF (failobj);
+        return failobj;
+    }
+
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    heliumdbInvalidate (self, item.key, item.key_len);
+
+    heliumdbBuffer buffer (self->mArena);
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = buffer.lookup (self->mDatastore, item, true);
+    timer.phase (PHASE_STORE);
+    Py_END_ALLOW_THREADS
+    timer.phase (PHASE_GIL);
+
+    // a read racing the delete may have cached the old value again
+    heliumdbInvalidate (self, item.key, item.key_len);
 
-        else
+    if (rc != 0)
+    {
+        timer.done (ENOENT);
+        if (failobj == NULL)
         {
-            break;
+            PyErr_SetString (HeliumDbException, "key not found");
+            return NULL;
         }
+        Py_INCREF (failobj);
+        return failobj;
     }
 
-    PyObject* obj = self->mKeyDeserializer (item.val, item.val_len);
+    PyObject* obj = self->mValDeserializer (item.val, item.val_len);
+    timer.phase (PHASE_DESERIALIZE);
+    timer.done ();
     if (obj == NULL)
     {
-        PyErr_SetString (HeliumDbException, "failed to deserialize key object");
+        PyErr_SetString (HeliumDbException, "failed to deserialize value object");
         return NULL;
     }
 
-    if (buf)
-        free (buf);
-
     return obj;
 }
 
@@ -326,29 +644,61 @@ int
 heliumdb_ass_sub (heliumdbPy* self, PyObject* k, PyObject* v)
 {
     char err[128];
-    he_item item;
+    he_item item = {};
     int rc;
 
+    heliumdbTimer timer (self->mMetrics, v ? OP_PUT : OP_DELETE, &item);
+
     if (!self->mKeySerializer (k, item.key, item.key_len))
     {
         PyErr_SetString (HeliumDbException, "could not serialize key object");
         return -1;
     }
 
+    heliumdbInvalidate (self, item.key, item.key_len);
+
+    if (v == NULL && self->mWriteBuffer)
+    {
+        timer.phase (PHASE_SERIALIZE);
+
+        // buffered deletes of missing keys fail like he_delete would
+        string pending;
+        Py_BEGIN_ALLOW_THREADS
+        rc = self->mWriteBuffer->find (item.key, item.key_len, pending);
+        if (rc < 0)
+            rc = self->mDatastore->exists (&item) == 0;
+        if (rc > 0)
+            self->mWriteBuffer->remove (item.key, item.key_len);
+        timer.phase (PHASE_STORE);
+        Py_END_ALLOW_THREADS
+        timer.phase (PHASE_GIL);
+        heliumdbInvalidate (self, item.key, item.key_len);
+        timer.done (rc ? 0 : ENOENT);
+
+        if (rc == 0)
+        {
+            PyErr_SetString (HeliumDbException, "he_delete failed: key not found");
+            return -1;
+        }
+        return 0;
+    }
+
     if (v == NULL)
     {
-        // delete
-        char buffer[2] = {0};
-        item.val = (void*)buffer;
-        item.val_len = sizeof (buffer);
+        timer.phase (PHASE_SERIALIZE);
 
+        // delete
         Py_BEGIN_ALLOW_THREADS
-        rc = he_delete_lookup (self->mDatastore, &item, 0, 1024);
+        rc = self->mDatastore->erase (&item);
+        timer.phase (PHASE_STORE);
         Py_END_ALLOW_THREADS
+        timer.phase (PHASE_GIL);
+        heliumdbInvalidate (self, item.key, item.key_len);
+        timer.done (rc ? errno : 0);
 
         if (rc != 0)
         {
-            snprintf (err, 128, "he_delete_lookup failed: %s", he_strerror (errno));
+            snprintf (err, 128, "he_delete failed: %s", he_strerror (errno));
             PyErr_SetString (HeliumDbException, err);
             return -1;
         }
@@ -360,10 +710,30 @@ heliumdb_ass_sub (heliumdbPy* self, PyObject* k, PyObject* v)
         PyErr_SetString (HeliumDbException, "could not serialize value object");
         return -1;
     }
+    timer.phase (PHASE_SERIALIZE);
+
+    heliumdbNoteKey (self, item.key, item.key_len);
+
+    if (self->mWriteBuffer)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        self->mWriteBuffer->put (item.key, item.key_len, item.val, item.val_len);
+        timer.phase (PHASE_STORE);
+        Py_END_ALLOW_THREADS
+        timer.phase (PHASE_GIL);
+        heliumdbInvalidate (self, item.key, item.key_len);
+        timer.done ();
+        return 0;
+    }
 
     Py_BEGIN_ALLOW_THREADS
-    rc = he_update (self->mDatastore, &item);
+    rc = self->mDatastore->update (&item);
+    timer.phase (PHASE_STORE);
     Py_END_ALLOW_THREADS
+    timer.phase (PHASE_GIL);
+    // reads racing the write may have cached the old value again
+    heliumdbInvalidate (self, item.key, item.key_len);
+    timer.done (rc ? errno : 0);
 
     if (rc)
     {
@@ -379,53 +749,45 @@ heliumdb_ass_sub (heliumdbPy* self, PyObject* k, PyObject* v)
 PyObject*
 heliumdb_subscript (heliumdbPy* self, PyObject* k)
 {
-    char*   buffer[8096] = {0};
-    size_t  rdSize = sizeof (buffer);
-    void*   buf = NULL;
-
-    he_item getItem;
-    getItem.val = (void*)buffer;
+    he_item         getItem = {};
+    heliumdbTimer   timer (self->mMetrics, OP_GET, &getItem);
 
     if (!self->mKeySerializer (k, getItem.key, getItem.key_len))
     {
         PyErr_SetString (HeliumDbException, "could not serialize key object");
         return NULL;
     }
+    timer.phase (PHASE_SERIALIZE);
 
-    int rc;
-    for (;;)
+    PyObject* cached = cachedValue (self, getItem);
+    if (cached)
     {
-		Py_BEGIN_ALLOW_THREADS
-        rc = he_lookup (self->mDatastore, &getItem, 0, rdSize);
-        Py_END_ALLOW_THREADS
+        timer.phase (PHASE_STORE);
+        timer.done ();
+        return cached;
+    }
 
-        if (rc != 0)
-        {
-            PyErr_SetString (HeliumDbException, "he_lookup failed");
-            return NULL;
-        }
+    heliumdbBuffer  buffer (self->mArena);
+    string          pending;
+    uint64_t        generation = cacheGeneration (self);
 
-        if (getItem.val_len > rdSize)
-        {
-            rdSize = getItem.val_len;
-            buf = malloc (rdSize);
-            getItem.val = buf;
-        }
-        else
-        {
-            break;
-        }
-    }
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = lookupItem (self, buffer, getItem, pending);
+    timer.phase (PHASE_STORE);
+    Py_END_ALLOW_THREADS
+    timer.phase (PHASE_GIL);
 
-    PyObject* obj = self->mValDeserializer (getItem.val, getItem.val_len);
-    if (obj == NULL)
+    if (rc != 0)
     {
-        PyErr_SetString (HeliumDbException, "failed to deserialize value object");
+        timer.done (ENOENT);
+        PyErr_SetString (HeliumDbException, "he_lookup failed");
         return NULL;
     }
 
-    if (buf)
-        free (buf);
+    PyObject* obj = decodeValue (self, getItem, generation);
+    timer.phase (PHASE_DESERIALIZE);
+    timer.done ();
 
     return obj;
 }
@@ -434,17 +796,20 @@ PyObject*
 heliumdb_keys (heliumdbPy* self)
 {
     vector<PyObject*>   keys;
-    he_iter_t           itr;
+    heliumdbCursor*     itr;
     const he_item*      item;
     PyObject*           k;
 
-    if (!(itr = he_iter_open (self->mDatastore, NULL, 0, 0, 0)))
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    if (!(itr = self->mDatastore->iterate (NULL, 0, 0)))
     {
         PyErr_SetString (HeliumDbException, "failed to open iterator");
         return NULL;
     }
 
-    while ((item = he_iter_next (itr)))
+    while ((item = itr->next ()))
     {
         k = self->mKeyDeserializer (item->key, item->key_len);
         if (k == NULL)
@@ -455,7 +820,7 @@ heliumdb_keys (heliumdbPy* self)
         keys.push_back (k);
     }
 
-    he_iter_close (itr);
+    delete itr;
 
     PyObject* keyList = PyList_New (keys.size ());
 
@@ -468,6 +833,19 @@ heliumdb_keys (heliumdbPy* self)
     return keyList;
 }
 
+static bool
+addStat (PyObject* res, const char* name, unsigned long long val)
+{
+    PyObject* v = PyLong_FromUnsignedLongLong (val);
+    if (v == NULL)
+        return false;
+
+    int rc = PyDict_SetItemString (res, name, v);
+    Py_DECREF (v);
+
+    return rc == 0;
+}
+
 PyObject*
 heliumdb_stats (heliumdbPy* self)
 {
@@ -476,15 +854,25 @@ heliumdb_stats (heliumdbPy* self)
     if (res == NULL)
         return NULL;
 
+    if (!heliumdbFlushWrites (self))
+    {
+        Py_DECREF (res);
+        return NULL;
+    }
+
     struct he_stats stats;
 
     int rc;
     Py_BEGIN_ALLOW_THREADS
-    rc = he_stats (self->mDatastore, &stats);
+    rc = self->mDatastore->stats (&stats);
     Py_END_ALLOW_THREADS
 
     if (rc != 0)
+    {
+        Py_DECREF (res);
+        PyErr_SetString (HeliumDbException, he_strerror (errno));
         return NULL;
+    }
 
     PyObject* name = PyUnicode_FromString (stats.name);
     if (PyDict_SetItemString (res, "name", name) < 0) 
@@ -591,18 +979,102 @@ heliumdb_stats (heliumdbPy* self)
         return NULL;
     }
 
+    if (!addStat (res, "arena_lookups", self->mArena->mLookups) ||
+        !addStat (res, "arena_retries", self->mArena->mRetries) ||
+        !addStat (res, "arena_allocations", self->mArena->mAllocations) ||
+        !addStat (res, "arena_size_class", self->mArena->sizeClass ()))
+    {
+        Py_DECREF (res);
+        return NULL;
+    }
+
+    if (self->mWriteBuffer &&
+        (!addStat (res, "write_buffer_pending", self->mWriteBuffer->pending ()) ||
+         !addStat (res, "write_buffer_flushes", self->mWriteBuffer->mFlushes) ||
+         !addStat (res, "write_buffer_flushed_items", self->mWriteBuffer->mFlushedItems) ||
+         !addStat (res, "write_buffer_errors", self->mWriteBuffer->mErrors)))
+    {
+        Py_DECREF (res);
+        return NULL;
+    }
+
+    if (self->mObjectCache &&
+        (!addStat (res, "object_cache_hits", self->mObjectCache->mHits) ||
+         !addStat (res, "object_cache_misses", self->mObjectCache->mMisses) ||
+         !addStat (res, "object_cache_evictions", self->mObjectCache->mEvictions) ||
+         !addStat (res, "object_cache_items", self->mObjectCache->size ()) ||
+         !addStat (res, "object_cache_bytes", self->mObjectCache->bytes ())))
+    {
+        Py_DECREF (res);
+        return NULL;
+    }
+
+    if (self->mBloom &&
+        (!addStat (res, "bloom_avoided", self->mBloom->mAvoided) ||
+         !addStat (res, "bloom_maybe", self->mBloom->mMaybe) ||
+         !addStat (res, "bloom_false_positives", self->mBloom->mFalsePositives) ||
+         !addStat (res, "bloom_bytes", self->mBloom->bytes ()) ||
+         !addStat (res, "bloom_loaded", self->mBloom->mLoaded)))
+    {
+        Py_DECREF (res);
+        return NULL;
+    }
+
     Py_INCREF (res);
     return res;
 }
 
+static heliumdbMetrics*
+metricsOf (heliumdbPy* self)
+{
+    if (self->mMetrics == NULL)
+        PyErr_SetString (HeliumDbException, "metrics not enabled, open with metrics=True");
+    return self->mMetrics;
+}
+
+static PyObject*
+heliumdb_metrics (heliumdbPy* self)
+{
+    heliumdbMetrics* metrics = metricsOf (self);
+    return metrics ? metrics->toDict () : NULL;
+}
+
+static PyObject*
+heliumdb_metrics_prometheus (heliumdbPy* self)
+{
+    heliumdbMetrics* metrics = metricsOf (self);
+    return metrics ? metrics->toPrometheus () : NULL;
+}
+
+static PyObject*
+heliumdb_reset_metrics (heliumdbPy* self)
+{
+    heliumdbMetrics* metrics = metricsOf (self);
+    if (metrics == NULL)
+        return NULL;
+
+    metrics->reset ();
+    Py_RETURN_NONE;
+}
+
 PyObject*
 heliumdb_commit (heliumdbPy* self)
 {
-    // TODO implement transaction handling
+    if (self->mParent)
+        return heliumdbEndTransaction (self, true);
+
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    heliumdbTimer timer (self->mMetrics, OP_COMMIT);
+
     int rc;
     Py_BEGIN_ALLOW_THREADS
-    rc = he_commit (self->mDatastore);
+    rc = self->mDatastore->commit ();
+    timer.phase (PHASE_STORE);
     Py_END_ALLOW_THREADS
+    timer.phase (PHASE_GIL);
+    timer.done (rc ? errno : 0);
 
     if (rc != 0)
     {
@@ -616,13 +1088,26 @@ heliumdb_commit (heliumdbPy* self)
     return Py_None;
 }
 
+static PyObject*
+heliumdb_flush (heliumdbPy* self)
+{
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
+
 Py_ssize_t
 heliumdb_len (heliumdbPy* self)
 {
+    if (!heliumdbFlushWrites (self))
+        return -1;
+
     struct he_stats stats;
     int rc;
     Py_BEGIN_ALLOW_THREADS
-    rc = he_stats (self->mDatastore, &stats);
+    rc = self->mDatastore->stats (&stats);
     Py_END_ALLOW_THREADS
 
     if (rc != 0)
@@ -634,11 +1119,14 @@ heliumdb_len (heliumdbPy* self)
 PyObject*
 heliumdb_sizeof (heliumdbPy* self)
 {
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
     struct he_stats stats;
     int rc;
 
     Py_BEGIN_ALLOW_THREADS
-    rc = he_stats (self->mDatastore, &stats);
+    rc = self->mDatastore->stats (&stats);
     Py_END_ALLOW_THREADS
 
     if (rc != 0)
@@ -654,20 +1142,61 @@ static PyMappingMethods heliumdb_as_mapping = {
     (objobjargproc)heliumdb_ass_sub,        /*mp_ass_subscript*/
 };
 
+/* in without falling back to iteration */
+static PySequenceMethods heliumdb_as_sequence = {
+    0,                                      /*sq_length*/
+    0,                                      /*sq_concat*/
+    0,                                      /*sq_repeat*/
+    0,                                      /*sq_item*/
+    0,                                      /*was_sq_slice*/
+    0,                                      /*sq_ass_item*/
+    0,                                      /*was_sq_ass_slice*/
+    (objobjproc)containsKey,                /*sq_contains*/
+};
+
 static PyMethodDef heliumdbPy_methods[] = {
     {"contains",  (PyCFunction)heliumdb_contains, METH_O | METH_COEXIST,
      "True if H has a key k, else False"},
     {"__contains__", (PyCFunction)heliumdb_contains, METH_O | METH_COEXIST, "True if H has a key K, else False"},
     {"__sizeof__", (PyCFunction)heliumdb_sizeof, METH_NOARGS, "returns number valid entries"},
-    {"commit", (PyCFunction)heliumdb_commit, METH_NOARGS, "commits a transaction to datastore"},
+    {"commit", (PyCFunction)heliumdb_commit, METH_NOARGS, "commits the datastore, or publishes the writes of a transaction atomically and ends it"},
+    {"transaction", (PyCFunction)heliumdb_transaction, METH_NOARGS, "handle whose writes are staged until commit, reads through it see them, use as a context manager to commit on success and discard on error"},
+    {"discard", (PyCFunction)heliumdb_discard, METH_NOARGS, "ends a transaction dropping its writes"},
+    {"__enter__", (PyCFunction)heliumdb_enter, METH_NOARGS, "returns the handle"},
+    {"__exit__", (PyCFunction)heliumdb_exit, METH_VARARGS, "commits, or discards a transaction left by an exception"},
+    {"flush", (PyCFunction)heliumdb_flush, METH_NOARGS, "block until writes buffered by write_buffer are applied"},
     {"get",  (PyCFunction)heliumdb_get, METH_VARARGS, "get value by key"},
+    {"get_view",  (PyCFunction)heliumdb_get_view, METH_VARARGS, "read-only memoryview of the stored value bytes of key"},
     {"cleanup",  (PyCFunction)heliumdb_cleanup, METH_NOARGS, "delete all entries in data store"},
     {"pop",  (PyCFunction)heliumdb_del, METH_VARARGS, "delete dict entry by key"},
     {"stats",  (PyCFunction)heliumdb_stats, METH_NOARGS, "retrieve datastore statistics"},
+    {"metrics", (PyCFunction)heliumdb_metrics, METH_NOARGS, "latency percentiles per operation and phase, needs metrics=True"},
+    {"metrics_prometheus", (PyCFunction)heliumdb_metrics_prometheus, METH_NOARGS, "latency summaries in prometheus text format, needs metrics=True"},
+    {"reset_metrics", (PyCFunction)heliumdb_reset_metrics, METH_NOARGS, "clear the latency histograms"},
 
     {"keys",  (PyCFunction)heliumdb_keys, METH_NOARGS, "return list of all keys"},
-    {"values",  (PyCFunction)heliumdb_itervalues, METH_NOARGS, "return list of all values"},
-    {"items", (PyCFunction)heliumdb_iteritems,    METH_NOARGS, "iterates items"},
+    {"iterkeys", (PyCFunction)heliumdb_iterkeys, METH_VARARGS | METH_KEYWORDS, "iterates keys, chunk=N buffers N items per GIL release, prefetch=True reads ahead in the background"},
+    {"values",  (PyCFunction)heliumdb_itervalues, METH_VARARGS | METH_KEYWORDS, "iterates values, takes chunk and prefetch like iterkeys"},
+    {"items", (PyCFunction)heliumdb_iteritems,    METH_VARARGS | METH_KEYWORDS, "iterates items, takes chunk and prefetch like iterkeys"},
+    {"range", (PyCFunction)heliumdb_range, METH_VARARGS | METH_KEYWORDS, "iterates items with start <= key < stop in key order, optionally reversed, takes chunk and prefetch like iterkeys"},
+    {"aggregate", (PyCFunction)heliumdb_aggregate, METH_VARARGS | METH_KEYWORDS, "count, sum, min, max, mean or histogram of 'i' or 'f' values natively, optionally limited to a key prefix or (start, stop) range and split over threads"},
+    {"parallel_scan", (PyCFunction)heliumdb_parallel_scan, METH_VARARGS | METH_KEYWORDS, "scans all items, or those under prefix, with one iterator per thread over sampled key ranges, returns a list of (key, value) or (keys, values) columns with out='arrays', or passes batches to callback"},
+    {"scan_where", (PyCFunction)heliumdb_scan_where, METH_VARARGS | METH_KEYWORDS, "iterates items, or keys with keys_only, whose 'i', 'f' or 's' value matches op (<, <=, >, >=, ==, !=, between, prefix, contains) against operand, filtering before decoding"},
+    {"iter_prefix", (PyCFunction)heliumdb_iter_prefix, METH_O, "iterates keys starting with prefix"},
+    {"items_prefix", (PyCFunction)heliumdb_items_prefix, METH_O, "iterates items whose key starts with prefix"},
+    {"count_prefix", (PyCFunction)heliumdb_count_prefix, METH_O, "number of keys starting with prefix"},
+    {"put_many", (PyCFunction)heliumdb_put_many, METH_O, "write an iterable of (key, value) pairs, returns list of (key, error) failures"},
+    {"update", (PyCFunction)heliumdb_update, METH_O, "write all entries of a mapping or iterable of pairs"},
+    {"put_arrays", (PyCFunction)heliumdb_put_arrays, METH_VARARGS, "write every row of two contiguous int64/float64/fixed width bytes arrays, returns rows written"},
+    {"get_many", (PyCFunction)heliumdb_get_many, METH_VARARGS | METH_KEYWORDS, "list of values for keys in input order, default for missing keys"},
+    {"execute", (PyCFunction)heliumdb_execute, METH_O, "run a sequence of get/put/del/exists operations in order, returns list of results"},
+    {"import_file", (PyCFunction)heliumdb_import_file, METH_VARARGS | METH_KEYWORDS, "load an ndjson, csv or binary file on background threads, returns throughput report, commit_every is ignored on transactions"},
+    {"aget", (PyCFunction)heliumdb_aget, METH_VARARGS, "awaitable get of key run on the native pool"},
+    {"aput", (PyCFunction)heliumdb_aput, METH_VARARGS, "awaitable write of key and value run on the native pool"},
+    {"adelete", (PyCFunction)heliumdb_adelete, METH_O, "awaitable delete of key run on the native pool"},
+    {"aget_many", (PyCFunction)heliumdb_aget_many, METH_VARARGS | METH_KEYWORDS, "awaitable get_many run on the native pool"},
+    {"copy_to", (PyCFunction)heliumdb_copy_to, METH_VARARGS | METH_KEYWORDS, "copy stored items to another handle in parallel key ranges without decoding, returns throughput report, commit_every is ignored when dst is a transaction"},
+    {"export_file", (PyCFunction)heliumdb_export_file, METH_VARARGS | METH_KEYWORDS, "write all items to an ndjson, csv or binary file, returns throughput report"},
     // placeholders
     // __eq__
     // __ne__
@@ -676,6 +1205,7 @@ static PyMethodDef heliumdbPy_methods[] = {
 };
 
 static PyMethodDef heliumdb_methods[] = {
+    {"set_pool_size", (PyCFunction)heliumdb_set_pool_size, METH_VARARGS, "number of native worker threads, must be called before the pool is first used"},
     { NULL, NULL, 0, NULL }
 };
 
@@ -696,7 +1226,7 @@ PyTypeObject heliumdbPyType = {
     0,                                          /*tp_as_sync*/
     0,                                          /*tp_repr*/
     0,                                          /*tp_as_number*/
-    0,                                          /*tp_as_sequence*/
+    &heliumdb_as_sequence,                      /*tp_as_sequence*/
     &heliumdb_as_mapping,                       /*tp_as_mapping*/
     0,                                          /*tp_hash */
     0,                                          /*tp_call*/
@@ -781,7 +1311,7 @@ initheliumdb (void)
     PyEval_InitThreads ();
 
     heliumdbPyType.tp_new = PyType_GenericNew;
-    if(PyType_Ready (&heliumdbPyType) < 0)
+    if(PyType_Ready (&heliumdbPyType) < 0 || !heliumdbiter_ready () || !heliumdbview_ready ())
 #if PY_MAJOR_VERSION >= 3
         return NULL;
 #else
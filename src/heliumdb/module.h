@@ -9,7 +9,15 @@
 #include "bytesobject.h"
 
 #include "utils.h"
+#include "backend.h"
 #include "exception.h"
+#include "arena.h"
+#include "writebuffer.h"
+#include "objcache.h"
+#include "bloom.h"
+#include "prefetch.h"
+#include "where.h"
+#include "metrics.h"
 
 extern PyTypeObject heliumdbPyType;
 
@@ -23,21 +31,62 @@ typedef bool (*serializer) (PyObject*, void*&, size_t&);
 
 typedef PyObject* (*deserializer) (void*, size_t);
 
-typedef struct 
+typedef struct heliumdbPy
 {
     PyObject_HEAD
-        he_t         mDatastore;
+        heliumdbBackend* mDatastore;
         serializer   mKeySerializer;
         deserializer mKeyDeserializer;
         serializer   mValSerializer;
         deserializer  mValDeserializer;
+        char         mKeyType;
+        char         mValType;
+        heliumdbArena* mArena;
+        /* set when opened with write_buffer=N */
+        heliumdbWriteBuffer* mWriteBuffer;
+        /* set when opened with object_cache=bytes */
+        heliumdbObjectCache* mObjectCache;
+        /* set when opened with bloom_filter=N */
+        heliumdbBloom* mBloom;
+        /* set when opened with metrics=True */
+        heliumdbMetrics* mMetrics;
+        /* set on transactions, which share the bloom filter and metrics
+         * of the handle they were started on */
+        struct heliumdbPy* mParent;
+        /* transaction backend once committed or discarded, mDatastore then
+         * fails every call. Kept until dealloc as iterators opened in the
+         * transaction may still use it */
+        heliumdbBackend* mFinished;
 } heliumdbPy;
 
 typedef struct 
 {
     PyObject_HEAD
         heliumdbPy* mHe;
-        he_iter_t   mItr;
+        heliumdbCursor* mItr;
+        size_t      mMaxValLen;
+        bool        mDone;
+        /* reverse iterators walk back from mCursor with he_prev */
+        bool        mReverse;
+        bool        mInclusive;
+        he_item     mItem;
+        void*       mValBuf;
+        size_t      mValBufLen;
+        size_t      mCursorLen;
+        char        mCursor[HE_MAX_KEY_LEN];
+        /* optional encoded [start, stop) bounds, with mPrefix set the
+         * iterator ends at the first key not starting with mStart */
+        size_t      mStartLen;
+        size_t      mStopLen;
+        bool        mHasStart;
+        bool        mHasStop;
+        bool        mPrefix;
+        char        mStart[HE_MAX_KEY_LEN];
+        char        mStop[HE_MAX_KEY_LEN];
+        /* set when opened with chunk > 1 or prefetch */
+        heliumdbPrefetch* mPrefetch;
+        /* scan_where iterators skip items whose value does not match */
+        heliumdbPredicate* mWhere;
 } heliumdbiter;
 
 PyObject* heliumdb_contains (heliumdbPy* self,
@@ -49,9 +98,73 @@ PyObject* heliumdb_sizeof (heliumdbPy* self);
 
 PyObject* heliumdb_iter (heliumdbPy* h);
 
-PyObject* heliumdb_iteritems (heliumdbPy* h);
+PyObject* heliumdb_iteritems (heliumdbPy* h, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_itervalues (heliumdbPy* h, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_iterkeys (heliumdbPy* h, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_scan_where (heliumdbPy* h, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_range (heliumdbPy* h, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_iter_prefix (heliumdbPy* h, PyObject* prefix);
+
+PyObject* heliumdb_items_prefix (heliumdbPy* h, PyObject* prefix);
+
+PyObject* heliumdb_count_prefix (heliumdbPy* h, PyObject* prefix);
+
+bool heliumdbiter_ready ();
+
+/* apply writes pending in the write-behind buffer before an operation that
+ * reads the datastore directly, false with an exception set on failure */
+bool heliumdbFlushWrites (heliumdbPy* self);
+
+/* drop decoded values cached for key, or every cached value when key is NULL */
+void heliumdbInvalidate (heliumdbPy* self, const void* key, size_t keyLen);
+
+/* record key in the bloom filter ahead of writing it, safe without the GIL */
+inline void
+heliumdbNoteKey (heliumdbPy* self, const void* key, size_t keyLen)
+{
+    if (self->mBloom)
+        self->mBloom->add (key, keyLen);
+}
+
+/* true when the bloom filter rules key out, safe without the GIL */
+bool heliumdbBloomMiss (heliumdbPy* self, const void* key, size_t keyLen);
+
+/* encode a key into buf of HE_MAX_KEY_LEN, sets an exception on failure */
+bool encodeKey (heliumdbPy* h, PyObject* k, char* buf, size_t& len);
+
+/* encode a prefix of an 's' or 'b' key, sets an exception on failure */
+bool encodePrefix (heliumdbPy* h, PyObject* prefix, char* buf, size_t& len);
+
+PyObject* heliumdb_aggregate (heliumdbPy* self, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_parallel_scan (heliumdbPy* self, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_copy_to (heliumdbPy* self, PyObject* args, PyObject* kwargs);
 
-PyObject* heliumdb_itervalues (heliumdbPy* h);
+PyObject* heliumdb_aget (heliumdbPy* self, PyObject* args);
+
+PyObject* heliumdb_aput (heliumdbPy* self, PyObject* args);
+
+PyObject* heliumdb_adelete (heliumdbPy* self, PyObject* k);
+
+PyObject* heliumdb_aget_many (heliumdbPy* self, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_set_pool_size (PyObject* self, PyObject* args);
+
+PyObject* heliumdb_get_view (heliumdbPy* self, PyObject* args);
+
+PyObject* heliumdb_put_arrays (heliumdbPy* self, PyObject* args);
+
+PyObject* heliumdb_import_file (heliumdbPy* self, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_export_file (heliumdbPy* self, PyObject* args, PyObject* kwargs);
+
+bool heliumdbview_ready ();
 
 int heliumdbPy_init (heliumdbPy* self,
                      PyObject* args,
@@ -62,3 +175,24 @@ PyObject* heliumdb_subscript (heliumdbPy* self, PyObject* k);
 int heliumdb_ass_sub (heliumdbPy* self, PyObject* k, PyObject* v);
 
 PyObject* heliumdb_keys (heliumdbPy* self);
+
+PyObject* heliumdb_put_many (heliumdbPy* self, PyObject* pairs);
+
+PyObject* heliumdb_update (heliumdbPy* self, PyObject* mapping);
+
+PyObject* heliumdb_get_many (heliumdbPy* self, PyObject* args, PyObject* kwargs);
+
+PyObject* heliumdb_execute (heliumdbPy* self, PyObject* ops);
+
+PyObject* heliumdb_commit (heliumdbPy* self);
+
+PyObject* heliumdb_transaction (heliumdbPy* self);
+
+PyObject* heliumdb_discard (heliumdbPy* self);
+
+PyObject* heliumdb_enter (heliumdbPy* self);
+
+PyObject* heliumdb_exit (heliumdbPy* self, PyObject* args);
+
+/* commit or discard the transaction self, sets an exception on failure */
+PyObject* heliumdbEndTransaction (heliumdbPy* self, bool commit);
@@ -0,0 +1,171 @@
+#include "objcache.h"
+
+using namespace std;
+
+/* bookkeeping charged per entry on top of the stored item size */
+#define OBJECT_CACHE_ENTRY_COST 64
+
+/* dropping a reference may run arbitrary python code, so values are
+ * released only once the cache is consistent again */
+static void
+release (vector<PyObject*>& released)
+{
+    for (size_t i = 0; i < released.size (); ++i)
+        Py_DECREF (released[i]);
+}
+
+heliumdbObjectCache::heliumdbObjectCache (size_t limit)
+    : mHits (0),
+      mMisses (0),
+      mEvictions (0),
+      mHand (0),
+      mBytes (0),
+      mLimit (limit),
+      mGeneration (0)
+{
+}
+
+heliumdbObjectCache::~heliumdbObjectCache ()
+{
+    clear ();
+}
+
+PyObject*
+heliumdbObjectCache::get (const void* key, size_t keyLen)
+{
+    unordered_map<string, size_t>::iterator itr =
+        mIndex.find (string ((const char*)key, keyLen));
+
+    if (itr == mIndex.end ())
+    {
+        mMisses++;
+        return NULL;
+    }
+
+    slot& s = mSlots[itr->second];
+    s.mReferenced = true;
+    mHits++;
+
+    Py_INCREF (s.mVal);
+    return s.mVal;
+}
+
+void
+heliumdbObjectCache::evict (size_t i, vector<PyObject*>& released)
+{
+    slot& s = mSlots[i];
+
+    mIndex.erase (s.mKey);
+    mBytes -= s.mCost;
+    released.push_back (s.mVal);
+
+    s.mKey.clear ();
+    s.mVal = NULL;
+    mFree.push_back (i);
+}
+
+void
+heliumdbObjectCache::put (const void* key, size_t keyLen, PyObject* val, size_t cost,
+                          uint64_t generation)
+{
+    if (generation != mGeneration)
+        return;
+
+    vector<PyObject*>   released;
+    string              k ((const char*)key, keyLen);
+
+    cost += keyLen + OBJECT_CACHE_ENTRY_COST;
+
+    unordered_map<string, size_t>::iterator itr = mIndex.find (k);
+    if (itr != mIndex.end ())
+        evict (itr->second, released);
+
+    if (cost > mLimit)
+    {
+        release (released);
+        return;
+    }
+
+    // clock sweep, referenced entries get a second chance
+    while (mBytes + cost > mLimit)
+    {
+        if (mHand >= mSlots.size ())
+            mHand = 0;
+
+        slot& s = mSlots[mHand];
+        if (s.mVal != NULL)
+        {
+            if (s.mReferenced)
+            {
+                s.mReferenced = false;
+            }
+            else
+            {
+                evict (mHand, released);
+                mEvictions++;
+            }
+        }
+        mHand++;
+    }
+
+    size_t i;
+    if (mFree.empty ())
+    {
+        i = mSlots.size ();
+        mSlots.push_back (slot ());
+    }
+    else
+    {
+        i = mFree.back ();
+        mFree.pop_back ();
+    }
+
+    slot& s = mSlots[i];
+    s.mKey.swap (k);
+    Py_INCREF (val);
+    s.mVal = val;
+    s.mCost = cost;
+    s.mReferenced = false;
+
+    mIndex[s.mKey] = i;
+    mBytes += cost;
+
+    release (released);
+}
+
+void
+heliumdbObjectCache::invalidate (const void* key, size_t keyLen)
+{
+    mGeneration++;
+
+    unordered_map<string, size_t>::iterator itr =
+        mIndex.find (string ((const char*)key, keyLen));
+
+    if (itr == mIndex.end ())
+        return;
+
+    vector<PyObject*> released;
+    evict (itr->second, released);
+    release (released);
+}
+
+void
+heliumdbObjectCache::clear ()
+{
+    mGeneration++;
+
+    vector<PyObject*> released;
+    for (size_t i = 0; i < mSlots.size (); ++i)
+    {
+        if (mSlots[i].mVal != NULL)
+            released.push_back (mSlots[i].mVal);
+    }
+
+    mSlots.clear ();
+    mFree.clear ();
+    mIndex.clear ();
+    mHand = 0;
+    mBytes = 0;
+
+    release (released);
+}
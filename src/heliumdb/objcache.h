@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Python.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Decoded value cache of a handle opened with object_cache=bytes.
+ *
+ * Values returned by get and [] are kept keyed by their encoded key and
+ * evicted with the clock algorithm once the stored size of the cached items
+ * exceeds the limit. Writes through the handle invalidate their keys, bulk
+ * writes clear the cache, writes from other handles are not seen. A read
+ * that ran the store lookup without the GIL only caches its value when no
+ * invalidation happened meanwhile, see generation (). Cached
+ * objects are shared between callers so they must not be mutated in place.
+ * Only used with the GIL held.
+ */
+class heliumdbObjectCache
+{
+public:
+    heliumdbObjectCache (size_t limit);
+
+    ~heliumdbObjectCache ();
+
+    /* new reference to the cached value of key or NULL */
+    PyObject* get (const void* key, size_t keyLen);
+
+    /* cache val, cost is the stored size of the item, skipped when the
+     * cache was invalidated since generation */
+    void put (const void* key, size_t keyLen, PyObject* val, size_t cost,
+              uint64_t generation);
+
+    void invalidate (const void* key, size_t keyLen);
+
+    void clear ();
+
+    /* bumped by every invalidate and clear, taken before a lookup and
+     * passed to put so a value read before a write is not cached after it */
+    uint64_t generation () const { return mGeneration; }
+
+    size_t bytes () const { return mBytes; }
+
+    size_t size () const { return mIndex.size (); }
+
+    uint64_t    mHits;
+    uint64_t    mMisses;
+    uint64_t    mEvictions;
+
+private:
+    typedef struct
+    {
+        std::string mKey;
+        PyObject*   mVal;
+        size_t      mCost;
+        bool        mReferenced;
+    } slot;
+
+    /* empties slot i, its value is appended to released */
+    void evict (size_t i, std::vector<PyObject*>& released);
+
+    std::vector<slot>                       mSlots;
+    std::vector<size_t>                     mFree;
+    std::unordered_map<std::string, size_t> mIndex;
+    size_t                                  mHand;
+    size_t                                  mBytes;
+    size_t                                  mLimit;
+    uint64_t                                mGeneration;
+};
@@ -0,0 +1,118 @@
+#include "pool.h"
+
+using namespace std;
+
+#define HELIUMDB_POOL_MAX_THREADS 8
+
+static size_t            sConfiguredThreads = 0;
+static bool              sStarted = false;
+static thread_local bool sWorker = false;
+
+heliumdbPool&
+heliumdbPool::instance ()
+{
+    static heliumdbPool pool (sConfiguredThreads ? sConfiguredThreads :
+                              min<size_t> (max<unsigned> (thread::hardware_concurrency (), 2),
+                                           HELIUMDB_POOL_MAX_THREADS));
+    sStarted = true;
+    return pool;
+}
+
+bool
+heliumdbPool::configure (size_t threads)
+{
+    if (sStarted)
+        return false;
+
+    sConfiguredThreads = threads;
+    return true;
+}
+
+heliumdbPool::heliumdbPool (size_t threads)
+    : mStop (false)
+{
+    for (size_t i = 0; i < threads; ++i)
+        mWorkers.push_back (thread (&heliumdbPool::run, this));
+}
+
+heliumdbPool::~heliumdbPool ()
+{
+    {
+        lock_guard<mutex> guard (mLock);
+        mStop = true;
+    }
+    mCond.notify_all ();
+
+    for (size_t i = 0; i < mWorkers.size (); ++i)
+        mWorkers[i].join ();
+}
+
+void
+heliumdbPool::run ()
+{
+    sWorker = true;
+
+    for (;;)
+    {
+        function<void ()> task;
+        {
+            unique_lock<mutex> guard (mLock);
+            mCond.wait (guard, [this] { return mStop || !mQueue.empty (); });
+            if (mStop && mQueue.empty ())
+                return;
+
+            task = mQueue.front ();
+            mQueue.pop_front ();
+        }
+        task ();
+    }
+}
+
+void
+heliumdbPool::parallelFor (size_t n, size_t minChunk, const rangeFunc& fn)
+{
+    // a task waiting on tasks queued behind it could deadlock the pool
+    size_t ranges = min (size () + 1, max<size_t> (n / max<size_t> (minChunk, 1), 1));
+    if (ranges <= 1 || sWorker)
+    {
+        fn (0, n);
+        return;
+    }
+
+    size_t              chunk = (n + ranges - 1) / ranges;
+    size_t              pending = 0;
+    mutex               doneLock;
+    condition_variable  doneCond;
+
+    {
+        lock_guard<mutex> guard (mLock);
+        for (size_t begin = chunk; begin < n; begin += chunk)
+        {
+            size_t end = min (begin + chunk, n);
+            pending++;
+            mQueue.push_back ([&, begin, end] {
+                fn (begin, end);
+
+                lock_guard<mutex> done (doneLock);
+                if (--pending == 0)
+                    doneCond.notify_one ();
+            });
+        }
+    }
+    mCond.notify_all ();
+
+    fn (0, min (chunk, n));
+
+    unique_lock<mutex> done (doneLock);
+    doneCond.wait (done, [&pending] { return pending == 0; });
+}
+
+void
+heliumdbPool::submit (const function<void ()>& task)
+{
+    {
+        lock_guard<mutex> guard (mLock);
+        mQueue.push_back (task);
+    }
+    mCond.notify_one ();
+}
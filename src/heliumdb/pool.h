@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+
+/*
+ * Process wide pool of native worker threads used to fan storage calls out
+ * across the device queue. Work submitted here must never touch python
+ * objects as the workers do not hold the GIL.
+ */
+class heliumdbPool
+{
+public:
+    typedef std::function<void (size_t, size_t)> rangeFunc;
+
+    static heliumdbPool& instance ();
+
+    /* number of threads for the process pool, only before first use */
+    static bool configure (size_t threads);
+
+    /* queue a single task */
+    void submit (const std::function<void ()>& task);
+
+    /* split [0, n) into ranges of at least minChunk and run fn over each,
+     * blocks until every range completed, the caller runs one range itself.
+     * Called from a pool task every range runs on the calling thread */
+    void parallelFor (size_t n, size_t minChunk, const rangeFunc& fn);
+
+    size_t size () const { return mWorkers.size (); }
+
+private:
+    heliumdbPool (size_t threads);
+
+    ~heliumdbPool ();
+
+    void run ();
+
+    std::vector<std::thread>            mWorkers;
+    std::deque<std::function<void ()> > mQueue;
+    std::mutex                          mLock;
+    std::condition_variable             mCond;
+    bool                                mStop;
+};
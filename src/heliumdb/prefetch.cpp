@@ -0,0 +1,172 @@
+#include "prefetch.h"
+
+using namespace std;
+
+/* chunks filled ahead of the one being consumed in background mode */
+#define PREFETCH_DEPTH 2
+
+/* a chunk ends early once it holds this many bytes of keys and values */
+#define PREFETCH_CHUNK_BYTES (4 << 20)
+
+heliumdbPrefetch::heliumdbPrefetch (size_t chunk,
+                                    bool background,
+                                    const function<const he_item* ()>& next)
+    : mChunk (chunk),
+      mBackground (background),
+      mNext (next),
+      mCurrent (new heliumdbPrefetch::chunk ()),
+      mPos (0),
+      mEnd (false),
+      mRunning (false),
+      mStop (false)
+{
+    mCurrent->mEnd = false;
+
+    if (mBackground)
+    {
+        for (int i = 0; i < PREFETCH_DEPTH; ++i)
+            mFree.push_back (new heliumdbPrefetch::chunk ());
+    }
+}
+
+heliumdbPrefetch::~heliumdbPrefetch ()
+{
+    reset ();
+
+    delete mCurrent;
+    for (size_t i = 0; i < mFree.size (); ++i)
+        delete mFree[i];
+}
+
+const he_item*
+heliumdbPrefetch::take ()
+{
+    if (mPos >= mCurrent->mEntries.size ())
+        return NULL;
+
+    const entry& e = mCurrent->mEntries[mPos++];
+    char* data = (char*)mCurrent->mData.data ();
+
+    mItem.key = data + e.mKeyOffset;
+    mItem.key_len = e.mKeyLen;
+    mItem.val = data + e.mValOffset;
+    mItem.val_len = e.mValLen;
+
+    return &mItem;
+}
+
+void
+heliumdbPrefetch::fill (chunk* c)
+{
+    c->mData.clear ();
+    c->mEntries.clear ();
+    c->mEnd = false;
+
+    while (c->mEntries.size () < mChunk && c->mData.size () < PREFETCH_CHUNK_BYTES)
+    {
+        const he_item* item = mNext ();
+        if (item == NULL)
+        {
+            c->mEnd = true;
+            break;
+        }
+
+        entry e;
+        e.mKeyOffset = c->mData.size ();
+        e.mKeyLen = item->key_len;
+        c->mData.append ((const char*)item->key, item->key_len);
+
+        e.mValOffset = c->mData.size ();
+        e.mValLen = item->val_len;
+        if (item->val_len > 0)
+            c->mData.append ((const char*)item->val, item->val_len);
+
+        c->mEntries.push_back (e);
+    }
+}
+
+void
+heliumdbPrefetch::run ()
+{
+    unique_lock<mutex> lock (mMutex);
+
+    while (true)
+    {
+        mCond.wait (lock, [this] { return mStop || !mFree.empty (); });
+        if (mStop)
+            break;
+
+        chunk* c = mFree.back ();
+        mFree.pop_back ();
+
+        lock.unlock ();
+        fill (c);
+        lock.lock ();
+
+        mReady.push_back (c);
+        mCond.notify_all ();
+
+        if (c->mEnd)
+            break;
+    }
+}
+
+bool
+heliumdbPrefetch::refill ()
+{
+    if (mEnd)
+        return false;
+
+    if (!mBackground)
+    {
+        fill (mCurrent);
+    }
+    else
+    {
+        unique_lock<mutex> lock (mMutex);
+
+        if (!mRunning)
+        {
+            mRunning = true;
+            mThread = thread (&heliumdbPrefetch::run, this);
+        }
+
+        mFree.push_back (mCurrent);
+        mCond.notify_all ();
+
+        mCond.wait (lock, [this] { return !mReady.empty (); });
+        mCurrent = mReady.front ();
+        mReady.pop_front ();
+    }
+
+    mPos = 0;
+    if (mCurrent->mEnd)
+        mEnd = true;
+
+    return !mCurrent->mEntries.empty ();
+}
+
+void
+heliumdbPrefetch::reset ()
+{
+    {
+        lock_guard<mutex> lock (mMutex);
+        mStop = true;
+        mCond.notify_all ();
+    }
+
+    if (mThread.joinable ())
+        mThread.join ();
+
+    while (!mReady.empty ())
+    {
+        mFree.push_back (mReady.front ());
+        mReady.pop_front ();
+    }
+
+    mRunning = false;
+    mStop = false;
+    mEnd = false;
+    mCurrent->mEntries.clear ();
+    mPos = 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include "he.h"
+
+/*
+ * Read-ahead buffer of an iterator opened with chunk=N.
+ *
+ * Raw items are copied out of the store N at a time so the GIL is released
+ * once per chunk instead of once per item. With prefetch set a background
+ * thread fills the next chunks while the current one is consumed. take is
+ * called with the GIL held, refill and reset may block and must be called
+ * without it.
+ */
+class heliumdbPrefetch
+{
+public:
+    /* next returns the following raw item or NULL at the end, it is only
+     * ever called from one thread at a time */
+    heliumdbPrefetch (size_t chunk,
+                      bool background,
+                      const std::function<const he_item* ()>& next);
+
+    ~heliumdbPrefetch ();
+
+    /* next buffered item or NULL once the current chunk is used up, valid
+     * until the following take or refill */
+    const he_item* take ();
+
+    /* load the next chunk, false at the end of the iteration */
+    bool refill ();
+
+    /* stop read-ahead and drop buffered items, used before repositioning */
+    void reset ();
+
+private:
+    typedef struct
+    {
+        size_t  mKeyOffset;
+        size_t  mKeyLen;
+        size_t  mValOffset;
+        size_t  mValLen;
+    } entry;
+
+    typedef struct
+    {
+        std::string         mData;
+        std::vector<entry>  mEntries;
+        bool                mEnd;
+    } chunk;
+
+    void fill (chunk* c);
+
+    void run ();
+
+    size_t                              mChunk;
+    bool                                mBackground;
+    std::function<const he_item* ()>    mNext;
+
+    chunk*                              mCurrent;
+    size_t                              mPos;
+    he_item                             mItem;
+    bool                                mEnd;
+
+    /* background mode, chunks cycle free -> filled by run -> ready ->
+     * current -> free */
+    std::vector<chunk*>                 mFree;
+    std::deque<chunk*>                  mReady;
+    std::mutex                          mMutex;
+    std::condition_variable             mCond;
+    std::thread                         mThread;
+    bool                                mRunning;
+    bool                                mStop;
+};
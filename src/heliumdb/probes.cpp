@@ -0,0 +1,22 @@
+#include "probes.h"
+
+#ifdef HELIUMDB_USDT
+
+/* bumped by the tracer when it attaches to the probe of the same name */
+#define HELIUMDB_DEFINE_SEMAPHORE(name) \
+    volatile unsigned short HELIUMDB_SEMAPHORE (name) \
+        __attribute__ ((section (".probes"))) = 0
+
+extern "C"
+{
+HELIUMDB_DEFINE_SEMAPHORE (get);
+HELIUMDB_DEFINE_SEMAPHORE (put);
+HELIUMDB_DEFINE_SEMAPHORE (delete);
+HELIUMDB_DEFINE_SEMAPHORE (exists);
+HELIUMDB_DEFINE_SEMAPHORE (iter_next);
+HELIUMDB_DEFINE_SEMAPHORE (commit);
+HELIUMDB_DEFINE_SEMAPHORE (serialize);
+HELIUMDB_DEFINE_SEMAPHORE (deserialize);
+}
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * USDT probes in the heliumdb provider, compiled in with cmake -DUSDT=ON.
+ * Every probe carries (op, key length, value length, rc, elapsed ns), op
+ * being a string and rc 0 on success or an errno value. Each probe has a semaphore so the clock is only read
+ * while a tracer is attached, otherwise a probe site is a nop behind an
+ * untaken branch.
+ */
+#ifdef HELIUMDB_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define HELIUMDB_SEMAPHORE(name) heliumdb_##name##_semaphore
+
+extern "C"
+{
+extern volatile unsigned short HELIUMDB_SEMAPHORE (get);
+extern volatile unsigned short HELIUMDB_SEMAPHORE (put);
+extern volatile unsigned short HELIUMDB_SEMAPHORE (delete);
+extern volatile unsigned short HELIUMDB_SEMAPHORE (exists);
+extern volatile unsigned short HELIUMDB_SEMAPHORE (iter_next);
+extern volatile unsigned short HELIUMDB_SEMAPHORE (commit);
+extern volatile unsigned short HELIUMDB_SEMAPHORE (serialize);
+extern volatile unsigned short HELIUMDB_SEMAPHORE (deserialize);
+}
+
+#define HELIUMDB_PROBE_ENABLED(name) \
+    __builtin_expect (HELIUMDB_SEMAPHORE (name) != 0, 0)
+
+#define HELIUMDB_PROBE(name, op, keyLen, valLen, rc, ns) \
+    DTRACE_PROBE5 (heliumdb, name, op, keyLen, valLen, rc, ns)
+
+#else
+
+#define HELIUMDB_PROBE_ENABLED(name) false
+#define HELIUMDB_PROBE(name, op, keyLen, valLen, rc, ns) do { } while (0)
+
+#endif
@@ -0,0 +1,490 @@
+#include "module.h"
+#include "keyrange.h"
+#include "job.h"
+
+#include <deque>
+#include <thread>
+
+/*
+ * Partitioned full scan. The key space is split at sampled boundary keys,
+ * every range is streamed by its own native thread and iterator into raw
+ * chunks and the python thread decodes the chunks as they arrive.
+ */
+
+using namespace std;
+
+/* chunks buffered per scanning thread before it waits for the decoder */
+#define SCAN_QUEUE_DEPTH 2
+
+/* largest batch=N accepted */
+#define SCAN_MAX_BATCH (1 << 20)
+
+typedef struct
+{
+    size_t  mKeyOffset;
+    size_t  mKeyLen;
+    size_t  mValOffset;
+    size_t  mValLen;
+} scanEntry;
+
+struct scanChunk
+{
+    size_t              mPart;
+    string              mData;
+    vector<scanEntry>   mEntries;
+};
+
+struct scanJob : heliumdbJob
+{
+    heliumdbPy*         mHe;
+    string              mPrefix;
+    vector<string>      mBounds;
+    size_t              mBatch;
+    size_t              mRunning;
+    deque<scanChunk*>   mChunks;
+    mutex               mQueueLock;
+    condition_variable  mReady;
+    condition_variable  mSpace;
+
+    ~scanJob ()
+    {
+        for (size_t i = 0; i < mChunks.size (); ++i)
+            delete mChunks[i];
+    }
+
+    /* false if cancelled while waiting for space */
+    bool push (scanChunk* c)
+    {
+        unique_lock<mutex> lock (mQueueLock);
+        while (mChunks.size () >= SCAN_QUEUE_DEPTH * mBounds.size ())
+        {
+            if (mCancel)
+            {
+                delete c;
+                return false;
+            }
+            mSpace.wait_for (lock, chrono::milliseconds (10));
+        }
+        mChunks.push_back (c);
+        mReady.notify_one ();
+        return true;
+    }
+
+    /* NULL once every range finished and the queue drained */
+    scanChunk* pop ()
+    {
+        unique_lock<mutex> lock (mQueueLock);
+        while (mChunks.empty () && mRunning > 0)
+            mReady.wait (lock);
+
+        if (mChunks.empty ())
+            return NULL;
+
+        scanChunk* c = mChunks.front ();
+        mChunks.pop_front ();
+        mSpace.notify_one ();
+        return c;
+    }
+
+    void rangeDone ()
+    {
+        lock_guard<mutex> lock (mQueueLock);
+        mRunning--;
+        mReady.notify_all ();
+    }
+};
+
+static void
+scanRange (scanJob& job, size_t part)
+{
+    const string&   start = job.mBounds[part];
+    const string*   stop = part + 1 < job.mBounds.size () ? &job.mBounds[part + 1] : NULL;
+    const string&   prefix = job.mPrefix;
+
+    heliumdbCursor* itr = job.mHe->mDatastore->iterate (start.data (), start.size (),
+                                                        HE_MAX_VAL_LEN);
+    if (itr == NULL)
+    {
+        job.fatal ("failed to open iterator");
+        job.rangeDone ();
+        return;
+    }
+
+    scanChunk*      c = new scanChunk ();
+    const he_item*  item;
+    bool            ok = true;
+
+    c->mPart = part;
+    while (ok && !job.mCancel && (item = itr->next ()))
+    {
+        if (stop && compareKey (item->key, item->key_len, stop->data (), stop->size ()) >= 0)
+            break;
+        if (!hasPrefix (item, prefix.data (), prefix.size ()))
+            break;
+
+        scanEntry e;
+        e.mKeyOffset = c->mData.size ();
+        e.mKeyLen = item->key_len;
+        c->mData.append ((const char*)item->key, item->key_len);
+        e.mValOffset = c->mData.size ();
+        e.mValLen = item->val_len;
+        c->mData.append ((const char*)item->val, item->val_len);
+        c->mEntries.push_back (e);
+
+        if (c->mEntries.size () == job.mBatch)
+        {
+            job.mRecords += c->mEntries.size ();
+            job.mBytes += c->mData.size ();
+            ok = job.push (c);
+
+            c = new scanChunk ();
+            c->mPart = part;
+        }
+    }
+    delete itr;
+
+    if (ok && !c->mEntries.empty ())
+    {
+        job.mRecords += c->mEntries.size ();
+        job.mBytes += c->mData.size ();
+        job.push (c);
+    }
+    else
+    {
+        delete c;
+    }
+
+    job.rangeDone ();
+}
+
+/* list of (key, value) tuples of the chunk */
+static PyObject*
+chunkItems (heliumdbPy* h, const scanChunk& c)
+{
+    PyObject* res = PyList_New (c.mEntries.size ());
+    if (res == NULL)
+        return NULL;
+
+    char* data = (char*)c.mData.data ();
+    for (size_t i = 0; i < c.mEntries.size (); ++i)
+    {
+        const scanEntry& e = c.mEntries[i];
+
+        PyObject* key = h->mKeyDeserializer (data + e.mKeyOffset, e.mKeyLen);
+        PyObject* val = key ? h->mValDeserializer (data + e.mValOffset, e.mValLen) : NULL;
+        PyObject* t = val ? PyTuple_New (2) : NULL;
+        if (t == NULL)
+        {
+            Py_XDECREF (key);
+            Py_XDECREF (val);
+            Py_DECREF (res);
+            if (!PyErr_Occurred ())
+                PyErr_SetString (HeliumDbException, "failed to deserialize item");
+            return NULL;
+        }
+
+        PyTuple_SET_ITEM (t, 0, key);
+        PyTuple_SET_ITEM (t, 1, val);
+        PyList_SET_ITEM (res, i, t);
+    }
+
+    return res;
+}
+
+/* array typecode of a column stored as 8 byte numbers, 0 for other types */
+static char
+columnCode (serializer s, bool& ordered)
+{
+    ordered = s == &serializeOrderedIntKey || s == &serializeOrderedFloatKey;
+
+    if (s == &serializeIntKey || s == &serializeIntVal || s == &serializeOrderedIntKey)
+        return 'q';
+    if (s == &serializeFloatKey || s == &serializeFloatVal || s == &serializeOrderedFloatKey)
+        return 'd';
+
+    return 0;
+}
+
+/* keys or values of the chunk as an array.array of int64 or float64, or a
+ * list of objects for types without a fixed width encoding */
+static PyObject*
+chunkColumn (heliumdbPy* h, const scanChunk& c, bool keys)
+{
+    static PyObject* arrayType = NULL;
+
+    bool    ordered;
+    char    code = columnCode (keys ? h->mKeySerializer : h->mValSerializer, ordered);
+    char*   data = (char*)c.mData.data ();
+    size_t  n = c.mEntries.size ();
+
+    if (code == 0)
+    {
+        deserializer d = keys ? h->mKeyDeserializer : h->mValDeserializer;
+
+        PyObject* res = PyList_New (n);
+        for (size_t i = 0; res && i < n; ++i)
+        {
+            const scanEntry& e = c.mEntries[i];
+            PyObject* o = keys ? d (data + e.mKeyOffset, e.mKeyLen)
+                               : d (data + e.mValOffset, e.mValLen);
+            if (o == NULL)
+            {
+                Py_CLEAR (res);
+                if (!PyErr_Occurred ())
+                    PyErr_SetString (HeliumDbException, "failed to deserialize item");
+                break;
+            }
+            PyList_SET_ITEM (res, i, o);
+        }
+        return res;
+    }
+
+    if (arrayType == NULL)
+    {
+        PyObject* module = PyImport_ImportModule ("array");
+        if (module == NULL)
+            return NULL;
+        arrayType = PyObject_GetAttrString (module, "array");
+        Py_DECREF (module);
+        if (arrayType == NULL)
+            return NULL;
+    }
+
+    PyObject* bytes = PyBytes_FromStringAndSize (NULL, n * sizeof (uint64_t));
+    if (bytes == NULL)
+        return NULL;
+
+    char* out = PyBytes_AS_STRING (bytes);
+    for (size_t i = 0; i < n; ++i)
+    {
+        const scanEntry& e = c.mEntries[i];
+        size_t len = keys ? e.mKeyLen : e.mValLen;
+        if (len != sizeof (uint64_t))
+        {
+            Py_DECREF (bytes);
+            PyErr_SetString (HeliumDbException, "stored item does not match the datastore type");
+            return NULL;
+        }
+
+        uint64_t bits;
+        memcpy (&bits, data + (keys ? e.mKeyOffset : e.mValOffset), sizeof (bits));
+        if (ordered && code == 'q')
+        {
+            int64_t v = decodeOrderedInt (bits);
+            memcpy (&bits, &v, sizeof (bits));
+        }
+        else if (ordered)
+        {
+            double v = decodeOrderedFloat (bits);
+            memcpy (&bits, &v, sizeof (bits));
+        }
+        memcpy (out + i * sizeof (bits), &bits, sizeof (bits));
+    }
+
+    return PyObject_CallFunction (arrayType, "sN", code == 'q' ? "q" : "d", bytes);
+}
+
+/* (keys, values) columns of the chunk */
+static PyObject*
+chunkArrays (heliumdbPy* h, const scanChunk& c)
+{
+    PyObject* keys = chunkColumn (h, c, true);
+    if (keys == NULL)
+        return NULL;
+
+    PyObject* vals = chunkColumn (h, c, false);
+    if (vals == NULL)
+    {
+        Py_DECREF (keys);
+        return NULL;
+    }
+
+    return Py_BuildValue ("(NN)", keys, vals);
+}
+
+/* append src to dst in place, both are (keys, values) pairs with arrays.
+ * dst is released and cleared on failure */
+static bool
+append (PyObject*& dst, PyObject* src, bool arrays)
+{
+    if (!arrays)
+    {
+        PyObject* r = PySequence_InPlaceConcat (dst, src);
+        Py_DECREF (dst);
+        dst = r;
+        return r != NULL;
+    }
+
+    for (Py_ssize_t i = 0; i < 2; ++i)
+    {
+        PyObject* col = PyTuple_GET_ITEM (dst, i);
+        PyObject* r = PySequence_InPlaceConcat (col, PyTuple_GET_ITEM (src, i));
+        if (r == NULL)
+        {
+            Py_CLEAR (dst);
+            return false;
+        }
+        // concatenating in place returns the same column
+        Py_DECREF (r);
+    }
+
+    return true;
+}
+
+PyObject*
+heliumdb_parallel_scan (heliumdbPy* self, PyObject* args, PyObject* kwargs)
+{
+    int         threads = 4;
+    PyObject*   callback = Py_None;
+    const char* out = "list";
+    PyObject*   filter = Py_None;
+    Py_ssize_t  batch = 4096;
+
+    char *kwlist[] = {(char*)"threads",
+                      (char*)"callback",
+                      (char*)"out",
+                      (char*)"prefix",
+                      (char*)"batch",
+                      NULL};
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwargs, "|iOsOn", kwlist,
+                                      &threads, &callback, &out, &filter, &batch))
+        return NULL;
+
+    bool arrays = strcmp (out, "arrays") == 0;
+    if (!arrays && strcmp (out, "list") != 0)
+    {
+        PyErr_SetString (HeliumDbException, "out must be 'list' or 'arrays'");
+        return NULL;
+    }
+
+    if (threads < 1 || threads > 64 || batch < 1 || batch > SCAN_MAX_BATCH)
+    {
+        PyErr_SetString (HeliumDbException, "threads must be 1-64 and batch 1-1048576");
+        return NULL;
+    }
+
+    if (callback != Py_None && !PyCallable_Check (callback))
+    {
+        PyErr_SetString (HeliumDbException, "callback must be callable");
+        return NULL;
+    }
+
+    scanJob job;
+    job.mHe = self;
+    job.mBatch = batch;
+
+    if (filter != Py_None)
+    {
+        char    prefix[HE_MAX_KEY_LEN];
+        size_t  len;
+        if (!encodePrefix (self, filter, prefix, len))
+            return NULL;
+        job.mPrefix.assign (prefix, len);
+    }
+
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    bool split;
+    Py_BEGIN_ALLOW_THREADS
+    split = heliumdbSplitKeys (self->mDatastore, job.mPrefix, threads, job.mBounds);
+    Py_END_ALLOW_THREADS
+
+    if (!split)
+    {
+        PyErr_SetString (HeliumDbException, "failed to open iterator");
+        return NULL;
+    }
+    if (job.mBounds.empty ())
+        job.mBounds.push_back (job.mPrefix);
+
+    job.mRunning = job.mBounds.size ();
+
+    // results of each range in order, so the merged output is in key order
+    vector<vector<PyObject*> > parts (job.mBounds.size ());
+    vector<thread>             workers;
+    for (size_t i = 0; i < job.mBounds.size (); ++i)
+        workers.push_back (thread (scanRange, ref (job), i));
+
+    // the handle stays referenced by the caller until we return
+    bool ok = true;
+    while (true)
+    {
+        scanChunk* c;
+        Py_BEGIN_ALLOW_THREADS
+        c = job.pop ();
+        Py_END_ALLOW_THREADS
+
+        if (c == NULL)
+            break;
+
+        // after a failure the remaining chunks are only drained
+        if (ok)
+        {
+            PyObject* res = arrays ? chunkArrays (self, *c) : chunkItems (self, *c);
+            if (res && callback != Py_None)
+            {
+                PyObject* rc = PyObject_CallFunctionObjArgs (callback, res, NULL);
+                Py_DECREF (res);
+                ok = rc != NULL;
+                Py_XDECREF (rc);
+            }
+            else if (res)
+            {
+                parts[c->mPart].push_back (res);
+            }
+            else
+            {
+                ok = false;
+            }
+
+            if (!ok)
+                job.mCancel = true;
+        }
+        delete c;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (size_t i = 0; i < workers.size (); ++i)
+        workers[i].join ();
+    Py_END_ALLOW_THREADS
+    job.finish ();
+
+    PyObject* result = NULL;
+    for (size_t i = 0; i < parts.size (); ++i)
+    {
+        for (size_t j = 0; j < parts[i].size (); ++j)
+        {
+            if (ok && result == NULL)
+                result = parts[i][j];
+            else if (ok)
+                ok = append (result, parts[i][j], arrays) && ok;
+            if (result != parts[i][j])
+                Py_DECREF (parts[i][j]);
+        }
+    }
+
+    if (!ok)
+    {
+        Py_XDECREF (result);
+        return NULL;
+    }
+
+    PyObject* report = job.report ();
+    if (report == NULL || callback != Py_None)
+    {
+        Py_XDECREF (result);
+        return report;
+    }
+    Py_DECREF (report);
+
+    if (result == NULL)
+    {
+        // an empty chunk decodes to the empty result of the right type
+        scanChunk empty;
+        result = arrays ? chunkArrays (self, empty) : chunkItems (self, empty);
+    }
+
+    return result;
+}
@@ -0,0 +1,906 @@
+#include "textcodec.h"
+#include "codec.h"
+#include "utils.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <strings.h>
+
+using namespace std;
+
+/* containers nested deeper than this are rejected */
+#define MAX_JSON_DEPTH 512
+
+static void
+skipSpace (const char*& p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+}
+
+static void
+putUtf8 (string& out, unsigned long cp)
+{
+    if (cp < 0x80)
+    {
+        out.push_back ((char)cp);
+    }
+    else if (cp < 0x800)
+    {
+        out.push_back ((char)(0xc0 | (cp >> 6)));
+        out.push_back ((char)(0x80 | (cp & 0x3f)));
+    }
+    else if (cp < 0x10000)
+    {
+        out.push_back ((char)(0xe0 | (cp >> 12)));
+        out.push_back ((char)(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back ((char)(0x80 | (cp & 0x3f)));
+    }
+    else
+    {
+        out.push_back ((char)(0xf0 | (cp >> 18)));
+        out.push_back ((char)(0x80 | ((cp >> 12) & 0x3f)));
+        out.push_back ((char)(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back ((char)(0x80 | (cp & 0x3f)));
+    }
+}
+
+static bool
+parseHex4 (const char*& p, const char* end, unsigned long& cp)
+{
+    if (end - p < 4)
+        return false;
+
+    cp = 0;
+    for (int i = 0; i < 4; ++i, ++p)
+    {
+        char c = *p;
+        cp <<= 4;
+        if (c >= '0' && c <= '9')
+            cp |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            cp |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            cp |= c - 'A' + 10;
+        else
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+parseString (const char*& p, const char* end, string& out)
+{
+    // p is past the opening quote
+    while (p < end)
+    {
+        char c = *p++;
+        if (c == '"')
+            return true;
+
+        if (c != '\\')
+        {
+            out.push_back (c);
+            continue;
+        }
+
+        if (p >= end)
+            return false;
+
+        switch (*p++)
+        {
+        case '"':  out.push_back ('"'); break;
+        case '\\': out.push_back ('\\'); break;
+        case '/':  out.push_back ('/'); break;
+        case 'b':  out.push_back ('\b'); break;
+        case 'f':  out.push_back ('\f'); break;
+        case 'n':  out.push_back ('\n'); break;
+        case 'r':  out.push_back ('\r'); break;
+        case 't':  out.push_back ('\t'); break;
+        case 'u':
+        {
+            unsigned long cp;
+            if (!parseHex4 (p, end, cp))
+                return false;
+
+            if (cp >= 0xd800 && cp < 0xdc00)
+            {
+                unsigned long lo;
+                if (end - p < 6 || p[0] != '\\' || p[1] != 'u')
+                    return false;
+
+                p += 2;
+                if (!parseHex4 (p, end, lo) || lo < 0xdc00 || lo >= 0xe000)
+                    return false;
+
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            putUtf8 (out, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static bool
+matchWord (const char*& p, const char* end, const char* word)
+{
+    size_t len = strlen (word);
+    if ((size_t)(end - p) < len || memcmp (p, word, len) != 0)
+        return false;
+
+    p += len;
+    return true;
+}
+
+static bool
+parseValue (const char*& p, const char* end, jsonValue& v, int depth)
+{
+    skipSpace (p, end);
+    if (p >= end || depth > MAX_JSON_DEPTH)
+        return false;
+
+    v.mText.clear ();
+    v.mItems.clear ();
+
+    switch (*p)
+    {
+    case '"':
+        p++;
+        v.mKind = jsonValue::JSON_STRING;
+        return parseString (p, end, v.mText);
+
+    case '{':
+    case '[':
+    {
+        bool object = *p++ == '{';
+        char close = object ? '}' : ']';
+
+        v.mKind = object ? jsonValue::JSON_OBJECT : jsonValue::JSON_ARRAY;
+        skipSpace (p, end);
+        if (p < end && *p == close)
+        {
+            p++;
+            return true;
+        }
+
+        for (;;)
+        {
+            if (object)
+            {
+                skipSpace (p, end);
+                if (p >= end || *p != '"')
+                    return false;
+
+                v.mItems.push_back (jsonValue ());
+                if (!parseValue (p, end, v.mItems.back (), depth + 1))
+                    return false;
+
+                skipSpace (p, end);
+                if (p >= end || *p++ != ':')
+                    return false;
+            }
+
+            v.mItems.push_back (jsonValue ());
+            if (!parseValue (p, end, v.mItems.back (), depth + 1))
+                return false;
+
+            skipSpace (p, end);
+            if (p >= end)
+                return false;
+
+            char c = *p++;
+            if (c == close)
+                return true;
+            if (c != ',')
+                return false;
+        }
+    }
+
+    case 't':
+        v.mKind = jsonValue::JSON_TRUE;
+        return matchWord (p, end, "true");
+
+    case 'f':
+        v.mKind = jsonValue::JSON_FALSE;
+        return matchWord (p, end, "false");
+
+    case 'n':
+        v.mKind = jsonValue::JSON_NULL;
+        return matchWord (p, end, "null");
+    }
+
+    // numbers, including the NaN/Infinity extensions python's json writes
+    const char* start = p;
+    while (p < end && (strchr ("+-.eE", *p) || (*p >= '0' && *p <= '9') ||
+                       strchr ("NaInfity", *p)))
+        p++;
+
+    if (p == start)
+        return false;
+
+    v.mKind = jsonValue::JSON_NUMBER;
+    v.mText.assign (start, p - start);
+
+    return true;
+}
+
+bool
+jsonParse (const char*& p, const char* end, jsonValue& v)
+{
+    return parseValue (p, end, v, 0);
+}
+
+void
+jsonWriteString (const char* s, size_t len, string& out)
+{
+    static const char* hex = "0123456789abcdef";
+
+    out.push_back ('"');
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = s[i];
+        switch (c)
+        {
+        case '"':  out.append ("\\\""); break;
+        case '\\': out.append ("\\\\"); break;
+        case '\n': out.append ("\\n"); break;
+        case '\r': out.append ("\\r"); break;
+        case '\t': out.append ("\\t"); break;
+        default:
+            if (c < 0x20)
+            {
+                out.append ("\\u00");
+                out.push_back (hex[c >> 4]);
+                out.push_back (hex[c & 0xf]);
+            }
+            else
+            {
+                out.push_back (c);
+            }
+        }
+    }
+    out.push_back ('"');
+}
+
+/* bytes as a json string of code points 0-255 */
+static void
+writeLatin1 (const char* s, size_t len, string& out)
+{
+    string utf8;
+    for (size_t i = 0; i < len; ++i)
+        putUtf8 (utf8, (unsigned char)s[i]);
+
+    jsonWriteString (utf8.data (), utf8.size (), out);
+}
+
+void
+jsonWrite (const jsonValue& v, string& out)
+{
+    switch (v.mKind)
+    {
+    case jsonValue::JSON_NULL:   out.append ("null"); break;
+    case jsonValue::JSON_FALSE:  out.append ("false"); break;
+    case jsonValue::JSON_TRUE:   out.append ("true"); break;
+    case jsonValue::JSON_NUMBER: out.append (v.mText); break;
+    case jsonValue::JSON_STRING:
+        jsonWriteString (v.mText.data (), v.mText.size (), out);
+        break;
+    case jsonValue::JSON_ARRAY:
+    case jsonValue::JSON_OBJECT:
+    {
+        bool object = v.mKind == jsonValue::JSON_OBJECT;
+        out.push_back (object ? '{' : '[');
+        for (size_t i = 0; i < v.mItems.size (); ++i)
+        {
+            if (i > 0)
+                out.push_back (object && (i & 1) ? ':' : ',');
+            jsonWrite (v.mItems[i], out);
+        }
+        out.push_back (object ? '}' : ']');
+        break;
+    }
+    }
+}
+
+const jsonValue*
+jsonMember (const jsonValue& obj, const string& name)
+{
+    if (obj.mKind != jsonValue::JSON_OBJECT)
+        return NULL;
+
+    for (size_t i = 0; i + 1 < obj.mItems.size (); i += 2)
+    {
+        if (obj.mItems[i].mText == name)
+            return &obj.mItems[i + 1];
+    }
+
+    return NULL;
+}
+
+bool
+textTypeSupported (char type)
+{
+    return type != '\0' && strchr ("sbiIfFN", type) != NULL;
+}
+
+static bool
+parseInt (const string& text, int64_t& v)
+{
+    if (text.empty ())
+        return false;
+
+    char* end;
+    errno = 0;
+    v = strtoll (text.c_str (), &end, 10);
+
+    return errno == 0 && *end == '\0';
+}
+
+/* strtod reads the decimal point of the current locale, the classic one
+ * is used instead so a locale set by the application changes nothing */
+static bool
+parseDouble (const string& text, double& v)
+{
+    if (text.empty ())
+        return false;
+
+    const char* name = text.c_str () + (text[0] == '-' || text[0] == '+');
+    if (strcasecmp (name, "nan") == 0)
+    {
+        v = NAN;
+        return true;
+    }
+    if (strcasecmp (name, "inf") == 0 || strcasecmp (name, "infinity") == 0)
+    {
+        v = text[0] == '-' ? -HUGE_VAL : HUGE_VAL;
+        return true;
+    }
+
+    istringstream in (text);
+    in.imbue (locale::classic ());
+    in >> v;
+
+    // out of range values fail with the largest finite one, strtod's inf
+    bool ok = !in.fail () ||
+              fabs (v) == numeric_limits<double>::max ();
+    if (ok && in.fail ())
+        v = copysign (HUGE_VAL, v);
+
+    in.clear ();
+    return ok && in.peek () == EOF;
+}
+
+/* an integer literal too large for int64 as little endian two's
+ * complement, sized like the native codec sizes python ints */
+static bool
+parseBigInt (const string& text, string& bytes)
+{
+    bool    negative = !text.empty () && text[0] == '-';
+    size_t  i = negative;
+
+    if (i == text.size ())
+        return false;
+
+    vector<unsigned char> mag (1, 0);
+    for (; i < text.size (); ++i)
+    {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+
+        int carry = text[i] - '0';
+        for (size_t j = 0; j < mag.size (); ++j)
+        {
+            int cur = mag[j] * 10 + carry;
+            mag[j] = cur & 0xff;
+            carry = cur >> 8;
+        }
+        if (carry)
+            mag.push_back (carry);
+    }
+
+    // bit length / 8 + 1 bytes always leaves room for the sign bit
+    size_t bits = 0;
+    for (size_t j = mag.size (); j-- > 0;)
+    {
+        if (mag[j])
+        {
+            bits = j * 8;
+            for (int b = mag[j]; b; b >>= 1)
+                bits++;
+            break;
+        }
+    }
+    mag.resize (bits / 8 + 1, 0);
+
+    if (negative)
+    {
+        int carry = 1;
+        for (size_t j = 0; j < mag.size (); ++j)
+        {
+            int b = (unsigned char)~mag[j] + carry;
+            mag[j] = b & 0xff;
+            carry = b >> 8;
+        }
+    }
+
+    bytes.assign (mag.begin (), mag.end ());
+    return true;
+}
+
+static void
+appendBits (string& out, const void* v)
+{
+    out.append ((const char*)v, 8);
+}
+
+static void
+putNativeStr (string& out, unsigned char tag, const string& s)
+{
+    out.push_back (tag);
+    nativePutVarint (out, s.size ());
+    out.append (s);
+}
+
+static bool
+encodeNative (const jsonValue& v, string& out, string& err)
+{
+    switch (v.mKind)
+    {
+    case jsonValue::JSON_NULL:
+        out.push_back (TAG_NONE);
+        return true;
+    case jsonValue::JSON_FALSE:
+        out.push_back (TAG_FALSE);
+        return true;
+    case jsonValue::JSON_TRUE:
+        out.push_back (TAG_TRUE);
+        return true;
+    case jsonValue::JSON_STRING:
+        putNativeStr (out, TAG_STR, v.mText);
+        return true;
+    case jsonValue::JSON_NUMBER:
+    {
+        int64_t i;
+        double  d;
+        string  bytes;
+        if (parseInt (v.mText, i))
+        {
+            out.push_back (TAG_INT);
+            nativePutVarint (out, nativeZigzag (i));
+            return true;
+        }
+
+        // python reads integers of any size exactly, so keep them exact
+        if (parseBigInt (v.mText, bytes))
+        {
+            putNativeStr (out, TAG_BIGINT, bytes);
+            return true;
+        }
+
+        if (!parseDouble (v.mText, d))
+        {
+            err = "invalid number " + v.mText;
+            return false;
+        }
+        out.push_back (TAG_FLOAT);
+        appendBits (out, &d);
+        return true;
+    }
+    case jsonValue::JSON_ARRAY:
+    case jsonValue::JSON_OBJECT:
+    {
+        bool object = v.mKind == jsonValue::JSON_OBJECT;
+        out.push_back (object ? TAG_DICT : TAG_LIST);
+        nativePutVarint (out, object ? v.mItems.size () / 2 : v.mItems.size ());
+        for (size_t i = 0; i < v.mItems.size (); ++i)
+        {
+            if (!encodeNative (v.mItems[i], out, err))
+                return false;
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+/* utf8 json string back to the bytes of its code points */
+static bool
+latin1Bytes (const string& utf8, string& out)
+{
+    const unsigned char* p = (const unsigned char*)utf8.data ();
+    const unsigned char* end = p + utf8.size ();
+
+    while (p < end)
+    {
+        if (*p < 0x80)
+        {
+            out.push_back (*p++);
+        }
+        else if ((*p & 0xe0) == 0xc0 && end - p >= 2 && *p <= 0xc3)
+        {
+            out.push_back ((char)(((p[0] & 0x1f) << 6) | (p[1] & 0x3f)));
+            p += 2;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+encodeScalar (const string& text, char type, string& out, string& err)
+{
+    int64_t     i;
+    double      d;
+    uint64_t    bits;
+
+    switch (type)
+    {
+    case 's':
+    case 'b':
+        out.append (text);
+        return true;
+
+    case 'i':
+    case 'I':
+        if (!parseInt (text, i))
+        {
+            err = "invalid int64 " + text;
+            return false;
+        }
+        if (type == 'I')
+        {
+            bits = encodeOrderedInt (i);
+            appendBits (out, &bits);
+        }
+        else
+        {
+            appendBits (out, &i);
+        }
+        return true;
+
+    case 'f':
+    case 'F':
+        if (!parseDouble (text, d))
+        {
+            err = "invalid float " + text;
+            return false;
+        }
+        if (type == 'F')
+        {
+            bits = encodeOrderedFloat (d);
+            appendBits (out, &bits);
+        }
+        else
+        {
+            appendBits (out, &d);
+        }
+        return true;
+
+    case 'N':
+        putNativeStr (out, TAG_STR, text);
+        return true;
+    }
+
+    err = "type has no native text encoding";
+    return false;
+}
+
+bool
+encodeJsonAs (const jsonValue& v, char type, string& out, string& err)
+{
+    if (type == 'N')
+        return encodeNative (v, out, err);
+
+    if (type == 'b')
+    {
+        if (v.mKind != jsonValue::JSON_STRING || !latin1Bytes (v.mText, out))
+        {
+            err = "bytes fields must be strings of code points below 256";
+            return false;
+        }
+        return true;
+    }
+
+    if (v.mKind == jsonValue::JSON_STRING || v.mKind == jsonValue::JSON_NUMBER)
+        return encodeScalar (v.mText, type, out, err);
+
+    if (type == 's')
+    {
+        jsonWrite (v, out);
+        return true;
+    }
+
+    err = "json value does not match field type";
+    return false;
+}
+
+bool
+encodeTextAs (const char* s, size_t len, char type, string& out, string& err)
+{
+    return encodeScalar (string (s, len), type, out, err);
+}
+
+static void
+writeInt (int64_t v, string& out)
+{
+    char buf[32];
+    snprintf (buf, sizeof (buf), "%lld", (long long)v);
+    out.append (buf);
+}
+
+/* shortest representation that reads back as the same double */
+static void
+writeDouble (double v, string& out)
+{
+    if (std::isnan (v))
+    {
+        out.append ("NaN");
+        return;
+    }
+
+    if (std::isinf (v))
+    {
+        out.append (v > 0 ? "Infinity" : "-Infinity");
+        return;
+    }
+
+    // printf, like strtod, writes the decimal point of the current locale
+    string  text;
+    double  back;
+    for (int precision = 15; precision <= 17; ++precision)
+    {
+        ostringstream s;
+        s.imbue (locale::classic ());
+        s.precision (precision);
+        s << v;
+        text = s.str ();
+        if (parseDouble (text, back) && back == v)
+            break;
+    }
+    out.append (text);
+
+    // keep floats distinguishable from ints
+    if (text.find_first_of (".eE") == string::npos)
+        out.append (".0");
+}
+
+/* little endian two's complement integer to decimal */
+static void
+writeBigInt (const unsigned char* data, size_t len, string& out)
+{
+    vector<unsigned char>   mag (data, data + len);
+    bool                    negative = len && (mag[len - 1] & 0x80);
+
+    if (negative)
+    {
+        int carry = 1;
+        for (size_t i = 0; i < len; ++i)
+        {
+            int b = (unsigned char)~mag[i] + carry;
+            mag[i] = b & 0xff;
+            carry = b >> 8;
+        }
+    }
+
+    string digits;
+    for (;;)
+    {
+        bool    zero = true;
+        int     rem = 0;
+        for (size_t i = len; i-- > 0;)
+        {
+            int cur = (rem << 8) | mag[i];
+            mag[i] = cur / 10;
+            rem = cur % 10;
+            zero = zero && mag[i] == 0;
+        }
+        digits.push_back ('0' + rem);
+        if (zero)
+            break;
+    }
+
+    if (negative)
+        out.push_back ('-');
+    out.append (digits.rbegin (), digits.rend ());
+}
+
+static bool
+nativeToJson (const unsigned char*& p, const unsigned char* end, string& out, string& err)
+{
+    if (p >= end)
+        return false;
+
+    uint64_t        len;
+    unsigned char   tag = *p++;
+
+    switch (tag)
+    {
+    case TAG_NONE:  out.append ("null"); return true;
+    case TAG_FALSE: out.append ("false"); return true;
+    case TAG_TRUE:  out.append ("true"); return true;
+
+    case TAG_INT:
+        if (!nativeGetVarint (p, end, len))
+            return false;
+        writeInt (nativeUnzigzag (len), out);
+        return true;
+
+    case TAG_FLOAT:
+    {
+        double d;
+        if ((size_t)(end - p) < sizeof (d))
+            return false;
+        memcpy (&d, p, sizeof (d));
+        p += sizeof (d);
+        writeDouble (d, out);
+        return true;
+    }
+
+    case TAG_BIGINT:
+    case TAG_STR:
+    case TAG_BYTES:
+        if (!nativeGetVarint (p, end, len) || (uint64_t)(end - p) < len)
+            return false;
+
+        if (tag == TAG_BIGINT)
+            writeBigInt (p, len, out);
+        else if (tag == TAG_STR)
+            jsonWriteString ((const char*)p, len, out);
+        else
+            writeLatin1 ((const char*)p, len, out);
+        p += len;
+        return true;
+
+    case TAG_TUPLE:
+    case TAG_LIST:
+        if (!nativeGetVarint (p, end, len))
+            return false;
+
+        out.push_back ('[');
+        for (uint64_t i = 0; i < len; ++i)
+        {
+            if (i > 0)
+                out.push_back (',');
+            if (!nativeToJson (p, end, out, err))
+                return false;
+        }
+        out.push_back (']');
+        return true;
+
+    case TAG_DICT:
+        if (!nativeGetVarint (p, end, len))
+            return false;
+
+        out.push_back ('{');
+        for (uint64_t i = 0; i < len; ++i)
+        {
+            if (i > 0)
+                out.push_back (',');
+
+            // json keys are strings, other keys are written as their json text
+            if (p < end && *p == TAG_STR)
+            {
+                if (!nativeToJson (p, end, out, err))
+                    return false;
+            }
+            else
+            {
+                string key;
+                if (!nativeToJson (p, end, key, err))
+                    return false;
+                jsonWriteString (key.data (), key.size (), out);
+            }
+
+            out.push_back (':');
+            if (!nativeToJson (p, end, out, err))
+                return false;
+        }
+        out.push_back ('}');
+        return true;
+
+    case TAG_PICKLE:
+        err = "pickled objects cannot be exported as text";
+        return false;
+    }
+
+    return false;
+}
+
+bool
+decodeToJson (const char* data, size_t len, char type, string& out, string& err)
+{
+    uint64_t bits = 0;
+    if ((type == 'i' || type == 'I' || type == 'f' || type == 'F'))
+    {
+        if (len != sizeof (bits))
+        {
+            err = "stored value is not 8 bytes";
+            return false;
+        }
+        memcpy (&bits, data, sizeof (bits));
+    }
+
+    switch (type)
+    {
+    case 's':
+        jsonWriteString (data, len, out);
+        return true;
+    case 'b':
+        writeLatin1 (data, len, out);
+        return true;
+    case 'i':
+        writeInt ((int64_t)bits, out);
+        return true;
+    case 'I':
+        writeInt (decodeOrderedInt (bits), out);
+        return true;
+    case 'f':
+    {
+        double d;
+        memcpy (&d, &bits, sizeof (d));
+        writeDouble (d, out);
+        return true;
+    }
+    case 'F':
+        writeDouble (decodeOrderedFloat (bits), out);
+        return true;
+    case 'N':
+    {
+        const unsigned char* p = (const unsigned char*)data;
+        const unsigned char* end = p + len;
+        if (!nativeToJson (p, end, out, err) || p != end)
+        {
+            if (err.empty ())
+                err = "malformed native encoded object";
+            return false;
+        }
+        return true;
+    }
+    }
+
+    err = "type has no native text encoding";
+    return false;
+}
+
+bool
+decodeToText (const char* data, size_t len, char type, string& out, string& err)
+{
+    if (type == 's' || type == 'b')
+    {
+        out.append (data, len);
+        return true;
+    }
+
+    if (type == 'N' && len > 0 && (unsigned char)data[0] == TAG_STR)
+    {
+        const unsigned char* p = (const unsigned char*)data + 1;
+        const unsigned char* end = (const unsigned char*)data + len;
+        uint64_t n;
+        if (!nativeGetVarint (p, end, n) || (uint64_t)(end - p) != n)
+        {
+            err = "malformed native encoded object";
+            return false;
+        }
+        out.append ((const char*)p, n);
+        return true;
+    }
+
+    return decodeToJson (data, len, type, out, err);
+}
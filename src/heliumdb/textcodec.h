@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/*
+ * Native conversion between text records (json, csv fields) and the storage
+ * encoding of the key/val type codes, used by the file import/export
+ * pipeline so records never become python objects. Only the types with a
+ * native encoding are supported: 's', 'b', 'i', 'I', 'f', 'F' and 'N'.
+ */
+
+/* parsed json value, strings are unescaped utf8 and numbers keep their
+ * source token */
+struct jsonValue
+{
+    enum kind
+    {
+        JSON_NULL,
+        JSON_FALSE,
+        JSON_TRUE,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT
+    };
+
+    kind                    mKind;
+    std::string             mText;
+    /* array items, or object members as alternating key and value */
+    std::vector<jsonValue>  mItems;
+};
+
+bool jsonParse (const char*& p, const char* end, jsonValue& v);
+
+void jsonWrite (const jsonValue& v, std::string& out);
+
+void jsonWriteString (const char* s, size_t len, std::string& out);
+
+const jsonValue* jsonMember (const jsonValue& obj, const std::string& name);
+
+/* true if type has a native text conversion */
+bool textTypeSupported (char type);
+
+/* append the storage encoding of v / a plain text field for type */
+bool encodeJsonAs (const jsonValue& v, char type, std::string& out, std::string& err);
+
+bool encodeTextAs (const char* s, size_t len, char type, std::string& out, std::string& err);
+
+/* append stored bytes of type as json, or as plain text for csv fields */
+bool decodeToJson (const char* data, size_t len, char type, std::string& out, std::string& err);
+
+bool decodeToText (const char* data, size_t len, char type, std::string& out, std::string& err);
@@ -0,0 +1,173 @@
+#include "module.h"
+
+/*
+ * Transactions are handles of the same type as the one they were started
+ * on, so every read and write method works on them unchanged. Their
+ * backend stages writes, reads through it see them, and commit publishes
+ * them atomically with he_commit on the transaction handle. The handle is
+ * single use, once committed or discarded every call raises.
+ */
+
+using namespace std;
+
+static bool
+checkOpen (heliumdbPy* self)
+{
+    if (self->mParent == NULL)
+    {
+        PyErr_SetString (HeliumDbException, "handle is not a transaction");
+        return false;
+    }
+
+    if (self->mFinished)
+    {
+        PyErr_SetString (HeliumDbException, "transaction already finished");
+        return false;
+    }
+
+    return true;
+}
+
+PyObject*
+heliumdb_transaction (heliumdbPy* self)
+{
+    if (self->mParent)
+    {
+        PyErr_SetString (HeliumDbException, "transactions do not nest");
+        return NULL;
+    }
+
+    /* writes made before the transaction are not part of it */
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    heliumdbBackend* backend;
+    Py_BEGIN_ALLOW_THREADS
+    backend = self->mDatastore->transaction ();
+    Py_END_ALLOW_THREADS
+
+    if (backend == NULL)
+    {
+        char buffer[128];
+        snprintf (buffer, 128, "failed to start transaction: %s", he_strerror (errno));
+        PyErr_SetString (HeliumDbException, buffer);
+        return NULL;
+    }
+
+    heliumdbPy* txn = (heliumdbPy*)heliumdbPyType.tp_alloc (&heliumdbPyType, 0);
+    if (txn == NULL)
+    {
+        delete backend;
+        return NULL;
+    }
+
+    txn->mDatastore = backend;
+    txn->mKeySerializer = self->mKeySerializer;
+    txn->mKeyDeserializer = self->mKeyDeserializer;
+    txn->mValSerializer = self->mValSerializer;
+    txn->mValDeserializer = self->mValDeserializer;
+    txn->mKeyType = self->mKeyType;
+    txn->mValType = self->mValType;
+    txn->mArena = new heliumdbArena ();
+    /* staged keys only add bloom false positives if the transaction is
+     * discarded */
+    txn->mBloom = self->mBloom;
+    txn->mMetrics = self->mMetrics;
+
+    Py_INCREF (self);
+    txn->mParent = self;
+
+    return (PyObject*)txn;
+}
+
+PyObject*
+heliumdbEndTransaction (heliumdbPy* self, bool commit)
+{
+    if (!checkOpen (self))
+        return NULL;
+
+    heliumdbTimer timer (commit ? self->mMetrics : NULL, OP_COMMIT);
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = commit ? self->mDatastore->commit () : self->mDatastore->discard ();
+    timer.phase (PHASE_STORE);
+    Py_END_ALLOW_THREADS
+    timer.phase (PHASE_GIL);
+    timer.done (rc ? errno : 0);
+
+    int err = errno;
+    if (rc != 0 && err == EBUSY)
+    {
+        PyErr_SetString (HeliumDbException,
+                         "transaction has open iterators, finish or delete them first");
+        return NULL;
+    }
+
+    /* he_commit and he_discard release the transaction even on failure */
+    self->mFinished = self->mDatastore;
+    self->mDatastore = heliumdbEndedBackend ();
+
+    /* values cached by the parent may be stale now */
+    if (commit && rc == 0)
+        heliumdbInvalidate (self->mParent, NULL, 0);
+
+    if (rc != 0)
+    {
+        char buffer[128];
+        snprintf (buffer, 128, "%s failed: %s", commit ? "commit" : "discard",
+                  he_strerror (err));
+        PyErr_SetString (HeliumDbException, buffer);
+        return NULL;
+    }
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
+
+PyObject*
+heliumdb_discard (heliumdbPy* self)
+{
+    return heliumdbEndTransaction (self, false);
+}
+
+PyObject*
+heliumdb_enter (heliumdbPy* self)
+{
+    Py_INCREF (self);
+    return (PyObject*)self;
+}
+
+PyObject*
+heliumdb_exit (heliumdbPy* self, PyObject* args)
+{
+    PyObject* type;
+    PyObject* value;
+    PyObject* traceback;
+
+    if (!PyArg_ParseTuple (args, "OOO", &type, &value, &traceback))
+        return NULL;
+
+    PyObject* res;
+    if (self->mParent == NULL)
+    {
+        /* plain handles commit on success and leave errors to the caller */
+        if (type != Py_None)
+            Py_RETURN_FALSE;
+        res = heliumdb_commit (self);
+    }
+    else if (self->mFinished)
+    {
+        /* committed or discarded within the block */
+        Py_RETURN_FALSE;
+    }
+    else
+        res = heliumdbEndTransaction (self, type == Py_None);
+
+    if (res == NULL)
+        return NULL;
+    Py_DECREF (res);
+
+    /* never swallow the exception that ended the block */
+    Py_RETURN_FALSE;
+}
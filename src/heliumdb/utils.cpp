@@ -4,16 +4,32 @@
 #include "bytesobject.h"
 
 static PyObject* PICKLE_MODULE = NULL;
+static PyObject* PICKLE_DUMPS = NULL;
+static PyObject* PICKLE_LOADS = NULL;
+
+static bool
+pickleInit ()
+{
+    if (PICKLE_MODULE != NULL)
+        return true;
+
+    if ((PICKLE_MODULE = PyImport_ImportModuleNoBlock ("pickle")) == NULL)
+        return false;
+
+    PICKLE_DUMPS = PyUnicode_InternFromString ("dumps");
+    PICKLE_LOADS = PyUnicode_InternFromString ("loads");
+
+    return true;
+}
 
 PyObject*
 pickleDumps (PyObject* obj)
 {
-    if (PICKLE_MODULE == NULL &&
-        (PICKLE_MODULE = PyImport_ImportModuleNoBlock ("pickle")) == NULL)
+    if (!pickleInit ())
         return NULL;
 
     return PyObject_CallMethodObjArgs (PICKLE_MODULE,
-                                       PyUnicode_FromString ("dumps"),
+                                       PICKLE_DUMPS,
                                        obj,
                                        NULL);
 }
@@ -22,22 +38,32 @@ pickleDumps (PyObject* obj)
 PyObject*
 pickleLoads (const char* buf, size_t len)
 {
+    if (!pickleInit ())
+        return NULL;
+
 #if PY_MAJOR_VERSION >= 3
     PyObject* pickedByteObj = PyBytes_FromStringAndSize (buf, len);
 #else
     PyObject* pickedByteObj = PyString_FromStringAndSize (buf, len);
 #endif
+    if (pickedByteObj == NULL)
+        return NULL;
 
-    return PyObject_CallMethodObjArgs (PICKLE_MODULE,
-                                       PyUnicode_FromString("loads"),
-                                       pickedByteObj,
-                                       NULL);
+    PyObject* res = PyObject_CallMethodObjArgs (PICKLE_MODULE,
+                                                PICKLE_LOADS,
+                                                pickedByteObj,
+                                                NULL);
+    Py_DECREF (pickedByteObj);
+
+    return res;
 }
 
 bool
 serializeObject (PyObject* o, void*& v, size_t& l)
 {
     PyObject* pickledObj = pickleDumps (o);
+    if (pickledObj == NULL)
+        return false;
 
     char* obj;
     Py_ssize_t objLen;
@@ -125,6 +151,99 @@ serializeFloatVal (PyObject* o, void*& v, size_t& l)
     return true;
 }
 
+/* order preserving encodings, big endian so helium's byte wise key order
+ * matches numeric order */
+static inline uint64_t
+toBigEndian (uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64 (v);
+#else
+    return v;
+#endif
+}
+
+uint64_t
+encodeOrderedInt (int64_t i)
+{
+    // flip the sign bit so negative numbers sort first
+    return toBigEndian ((uint64_t)i ^ 0x8000000000000000ULL);
+}
+
+uint64_t
+encodeOrderedFloat (double d)
+{
+    uint64_t bits;
+    memcpy (&bits, &d, sizeof (bits));
+
+    // ieee total order, negatives are inverted, positives get the sign bit
+    if (bits & 0x8000000000000000ULL)
+        bits = ~bits;
+    else
+        bits ^= 0x8000000000000000ULL;
+
+    return toBigEndian (bits);
+}
+
+int64_t
+decodeOrderedInt (uint64_t bits)
+{
+    return (int64_t)(toBigEndian (bits) ^ 0x8000000000000000ULL);
+}
+
+double
+decodeOrderedFloat (uint64_t bits)
+{
+    bits = toBigEndian (bits);
+    if (bits & 0x8000000000000000ULL)
+        bits ^= 0x8000000000000000ULL;
+    else
+        bits = ~bits;
+
+    double d;
+    memcpy (&d, &bits, sizeof (d));
+
+    return d;
+}
+
+bool
+serializeOrderedIntKey (PyObject* o, void*& v, size_t& l)
+{
+    static __thread uint64_t res;
+
+    if (!PyLong_Check (o))
+    {
+        PyErr_SetString (HeliumDbException, "value not an int");
+        return false;
+    }
+
+    int64_t i = PyLong_AsLongLong (o);
+    if (i == -1 && PyErr_Occurred ())
+        return false;
+
+    res = encodeOrderedInt (i);
+
+    v = &res;
+    l = sizeof (res);
+
+    return true;
+}
+
+bool
+serializeOrderedFloatKey (PyObject* o, void*& v, size_t& l)
+{
+    static __thread uint64_t res;
+    if (!PyFloat_Check (o))
+        return false;
+
+    res = encodeOrderedFloat (PyFloat_AsDouble (o));
+
+    v = &res;
+    l = sizeof (res);
+
+    return true;
+}
+
 bool
 serializeString (PyObject* o, void*& v, size_t& l)
 {
@@ -148,23 +267,39 @@ serializeString (PyObject* o, void*& v, size_t& l)
     return true;
 }
 
-bool
-serializeBytes (PyObject* o, void*& v, size_t& l)
+static bool
+serializeBuffer (PyObject* o, std::string& buffer, void*& v, size_t& l)
 {
     char* res;
     Py_ssize_t objLen;
 
 #if PY_MAJOR_VERSION >= 3
-    if (!PyBytes_Check (o))
+    if (PyBytes_Check (o))
+    {
+        if (PyBytes_AsStringAndSize (o, &res, &objLen) == -1)
+            return false;
+
+        v = (void*)res;
+        l = objLen;
+        return true;
+    }
+
+    // any other contiguous buffer (bytearray, memoryview, numpy arrays) is
+    // copied into native storage so no export is held past the call
+    Py_buffer view;
+    if (PyObject_GetBuffer (o, &view, PyBUF_SIMPLE) == -1)
         return false;
 
-    if (PyBytes_AsStringAndSize (o, &res, &objLen) == -1)
+    buffer.assign ((const char*)view.buf, view.len);
+    PyBuffer_Release (&view);
+
+    v = (void*)buffer.data ();
+    l = buffer.size ();
 #else
     if (!PyString_Check (o))
         return false;
 
     if (PyString_AsStringAndSize (o, &res, &objLen) == -1)
-#endif
     {
         printf ("failed to serialize bytes object");
         return false;
@@ -172,24 +307,31 @@ serializeBytes (PyObject* o, void*& v, size_t& l)
 
     v = (void*)res;
     l = objLen;
+#endif
 
     return true;
 }
 
+bool
+serializeBytesKey (PyObject* o, void*& v, size_t& l)
+{
+    static thread_local std::string res;
+
+    return serializeBuffer (o, res, v, l);
+}
+
+bool
+serializeBytesVal (PyObject* o, void*& v, size_t& l)
+{
+    static thread_local std::string res;
+
+    return serializeBuffer (o, res, v, l);
+}
+
 PyObject*
 deserializeObject (void* buf, size_t len)
 {
-    const char* d = reinterpret_cast <const char*> (buf);
-#if PY_MAJOR_VERSION >= 3
-    PyObject* pickedByteObj = PyBytes_FromStringAndSize (d, len);
-#else
-    PyObject* pickedByteObj = PyString_FromStringAndSize (d, len);
-#endif
-
-    return PyObject_CallMethodObjArgs (PICKLE_MODULE,
-                                       PyUnicode_FromString("loads"),
-                                       pickedByteObj,
-                                       NULL);
+    return pickleLoads (reinterpret_cast <const char*> (buf), len);
 }
 
 PyObject*
@@ -201,6 +343,24 @@ deserializeInt (void* buf, size_t len)
     return res;
 }
 
+PyObject*
+deserializeOrderedInt (void* buf, size_t len)
+{
+    uint64_t bits;
+    memcpy (&bits, buf, sizeof (bits));
+
+    return PyLong_FromLongLong (decodeOrderedInt (bits));
+}
+
+PyObject*
+deserializeOrderedFloat (void* buf, size_t len)
+{
+    uint64_t bits;
+    memcpy (&bits, buf, sizeof (bits));
+
+    return PyFloat_FromDouble (decodeOrderedFloat (bits));
+}
+
 PyObject*
 deserializeString (void* buf, size_t len)
 {
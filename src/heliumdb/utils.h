@@ -11,16 +11,30 @@ bool serializeKeyObject (PyObject* k, he_item& item);
 
 bool serializeValueObject (PyObject* k, he_item& item);
 
+/* big endian encodings whose byte order matches numeric order */
+uint64_t encodeOrderedInt (int64_t i);
+uint64_t encodeOrderedFloat (double d);
+int64_t decodeOrderedInt (uint64_t bits);
+double decodeOrderedFloat (uint64_t bits);
+
 bool serializeObject (PyObject* o, void*& v, size_t& l);
 bool serializeIntKey (PyObject* o, void*& v, size_t& l);
 bool serializeIntVal (PyObject* o, void*& v, size_t& l);
+bool serializeOrderedIntKey (PyObject* o, void*& v, size_t& l);
 bool serializeString (PyObject* o, void*& v, size_t& l);
 bool serializeFloatKey (PyObject* o, void*& v, size_t& l);
 bool serializeFloatVal (PyObject* o, void*& v, size_t& l);
-bool serializeBytes (PyObject* o, void*& v, size_t& l);
+bool serializeOrderedFloatKey (PyObject* o, void*& v, size_t& l);
+bool serializeBytesKey (PyObject* o, void*& v, size_t& l);
+bool serializeBytesVal (PyObject* o, void*& v, size_t& l);
+bool serializeNativeKey (PyObject* o, void*& v, size_t& l);
+bool serializeNativeVal (PyObject* o, void*& v, size_t& l);
 
 PyObject* deserializeObject (void* v, size_t l);
 PyObject* deserializeInt (void* v, size_t l);
+PyObject* deserializeOrderedInt (void* v, size_t l);
 PyObject* deserializeString (void* v, size_t l);
 PyObject* deserializeFloat (void* v, size_t l);
+PyObject* deserializeOrderedFloat (void* v, size_t l);
 PyObject* deserializeBytes (void* v, size_t l);
+PyObject* deserializeNative (void* v, size_t l);
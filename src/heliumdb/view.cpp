@@ -0,0 +1,138 @@
+#include "module.h"
+
+/*
+ * Owner of a pooled arena block exposed read-only through the buffer
+ * protocol, get_view wraps it in a memoryview so the value is never copied
+ * into a python bytes object. The block returns to the handle's pool once
+ * the last view is released.
+ */
+typedef struct
+{
+    PyObject_HEAD
+        heliumdbPy*         mHe;
+        std::vector<char>*  mBlock;
+        size_t              mLen;
+} heliumdbview;
+
+static void
+heliumdbview_dealloc (heliumdbview* v)
+{
+    if (v->mBlock)
+        v->mHe->mArena->releaseBlock (v->mBlock);
+
+    Py_XDECREF (v->mHe);
+    PyObject_Del (v);
+}
+
+static int
+heliumdbview_getbuffer (heliumdbview* v, Py_buffer* view, int flags)
+{
+    return PyBuffer_FillInfo (view,
+                              (PyObject*)v,
+                              v->mLen ? &(*v->mBlock)[0] : NULL,
+                              v->mLen,
+                              1,
+                              flags);
+}
+
+static PyBufferProcs heliumdbview_as_buffer = {
+    (getbufferproc)heliumdbview_getbuffer,      /* bf_getbuffer */
+    0                                           /* bf_releasebuffer */
+};
+
+PyTypeObject heliumdbViewType = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "heliumdb-view",                            /* tp_name */
+    sizeof(heliumdbview),                       /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    /* methods */
+    (destructor)heliumdbview_dealloc,           /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    &heliumdbview_as_buffer,                    /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    0,                                          /* tp_doc */
+};
+
+PyObject*
+heliumdb_get_view (heliumdbPy* self, PyObject* args)
+{
+    if (!heliumdbFlushWrites (self))
+        return NULL;
+
+    PyObject* k = NULL;
+    PyObject* failobj = NULL;
+
+    if (!PyArg_UnpackTuple (args, "get_view", 1, 2, &k, &failobj))
+        return NULL;
+
+    he_item item;
+    if (!self->mKeySerializer (k, item.key, item.key_len))
+    {
+        PyErr_SetString (HeliumDbException, "could not serialize key object");
+        return NULL;
+    }
+
+    if (heliumdbBloomMiss (self, item.key, item.key_len))
+    {
+        if (failobj == NULL)
+        {
+            PyErr_SetString (HeliumDbException, "key not found");
+            return NULL;
+        }
+        Py_INCREF (failobj);
+        return failobj;
+    }
+
+    heliumdbview* v = PyObject_New (heliumdbview, &heliumdbViewType);
+    if (v == NULL)
+        return NULL;
+
+    Py_INCREF (self);
+    v->mHe = self;
+    v->mBlock = self->mArena->acquireBlock ();
+    v->mLen = 0;
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    {
+        heliumdbBuffer buffer (self->mArena, *v->mBlock);
+        rc = buffer.lookup (self->mDatastore, item, false);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (rc != 0)
+    {
+        Py_DECREF (v);
+        if (failobj == NULL)
+        {
+            PyErr_SetString (HeliumDbException, "key not found");
+            return NULL;
+        }
+        Py_INCREF (failobj);
+        return failobj;
+    }
+    v->mLen = item.val_len;
+
+    PyObject* res = PyMemoryView_FromObject ((PyObject*)v);
+    Py_DECREF (v);
+
+    return res;
+}
+
+bool
+heliumdbview_ready ()
+{
+    return PyType_Ready (&heliumdbViewType) == 0;
+}
@@ -0,0 +1,183 @@
+#include "where.h"
+#include "exception.h"
+
+#include <cstring>
+
+using namespace std;
+
+heliumdbPredicate*
+heliumdbPredicate::create (char valType, const char* op, PyObject* operand)
+{
+    if (valType != 'i' && valType != 'f' && valType != 's')
+    {
+        PyErr_SetString (HeliumDbException, "scan_where requires val_type 'i', 'f' or 's'");
+        return NULL;
+    }
+
+    whereOp o;
+    if (strcmp (op, "<") == 0)
+        o = WHERE_LT;
+    else if (strcmp (op, "<=") == 0)
+        o = WHERE_LE;
+    else if (strcmp (op, ">") == 0)
+        o = WHERE_GT;
+    else if (strcmp (op, ">=") == 0)
+        o = WHERE_GE;
+    else if (strcmp (op, "==") == 0)
+        o = WHERE_EQ;
+    else if (strcmp (op, "!=") == 0)
+        o = WHERE_NE;
+    else if (strcmp (op, "between") == 0)
+        o = WHERE_BETWEEN;
+    else if (strcmp (op, "prefix") == 0)
+        o = WHERE_PREFIX;
+    else if (strcmp (op, "contains") == 0)
+        o = WHERE_CONTAINS;
+    else
+    {
+        PyErr_SetString (HeliumDbException,
+                         "op must be one of <, <=, >, >=, ==, !=, between, prefix, contains");
+        return NULL;
+    }
+
+    if ((o == WHERE_PREFIX || o == WHERE_CONTAINS) && valType != 's')
+    {
+        PyErr_SetString (HeliumDbException, "prefix and contains require val_type 's'");
+        return NULL;
+    }
+
+    heliumdbPredicate* p = new heliumdbPredicate (valType, o);
+
+    bool ok;
+    if (o == WHERE_BETWEEN)
+    {
+        ok = PyTuple_Check (operand) && PyTuple_GET_SIZE (operand) == 2;
+        if (!ok)
+            PyErr_SetString (HeliumDbException, "between takes a (low, high) tuple");
+        else
+            ok = p->setOperand (0, PyTuple_GET_ITEM (operand, 0)) &&
+                 p->setOperand (1, PyTuple_GET_ITEM (operand, 1));
+    }
+    else
+    {
+        ok = p->setOperand (0, operand);
+    }
+
+    if (!ok)
+    {
+        delete p;
+        return NULL;
+    }
+
+    return p;
+}
+
+bool
+heliumdbPredicate::setOperand (int i, PyObject* o)
+{
+    switch (mType)
+    {
+    case 'i':
+        if (!PyLong_Check (o))
+        {
+            PyErr_SetString (HeliumDbException, "operand not an int");
+            return false;
+        }
+        mInt[i] = PyLong_AsLongLong (o);
+        return !PyErr_Occurred ();
+    case 'f':
+        if (!PyFloat_Check (o) && !PyLong_Check (o))
+        {
+            PyErr_SetString (HeliumDbException, "operand not a float");
+            return false;
+        }
+        mFloat[i] = PyFloat_AsDouble (o);
+        return !PyErr_Occurred ();
+    default:
+    {
+        if (!PyUnicode_Check (o))
+        {
+            PyErr_SetString (HeliumDbException, "operand not a str");
+            return false;
+        }
+        Py_ssize_t  len;
+        const char* s = PyUnicode_AsUTF8AndSize (o, &len);
+        if (s == NULL)
+            return false;
+        mStr[i].assign (s, len);
+        return true;
+    }
+    }
+}
+
+int
+heliumdbPredicate::compare (const void* val, size_t len, int i) const
+{
+    switch (mType)
+    {
+    case 'i':
+    {
+        int64_t v;
+        memcpy (&v, val, sizeof (v));
+        return v < mInt[i] ? -1 : v > mInt[i];
+    }
+    case 'f':
+    {
+        double v;
+        memcpy (&v, val, sizeof (v));
+        return v < mFloat[i] ? -1 : v > mFloat[i];
+    }
+    default:
+    {
+        const string&   s = mStr[i];
+        int             rc = memcmp (val, s.data (), min (len, s.size ()));
+        if (rc != 0)
+            return rc;
+        return len < s.size () ? -1 : len > s.size ();
+    }
+    }
+}
+
+bool
+heliumdbPredicate::match (const void* val, size_t len) const
+{
+    // stored values of the wrong width were not written by this val_type
+    if (mType != 's' && len != 8)
+        return false;
+
+    // nan matches nothing but !=, as in python
+    if (mType == 'f')
+    {
+        double v;
+        memcpy (&v, val, sizeof (v));
+        if (v != v || mFloat[0] != mFloat[0] ||
+            (mOp == WHERE_BETWEEN && mFloat[1] != mFloat[1]))
+            return mOp == WHERE_NE;
+    }
+
+    switch (mOp)
+    {
+    case WHERE_LT:
+        return compare (val, len, 0) < 0;
+    case WHERE_LE:
+        return compare (val, len, 0) <= 0;
+    case WHERE_GT:
+        return compare (val, len, 0) > 0;
+    case WHERE_GE:
+        return compare (val, len, 0) >= 0;
+    case WHERE_EQ:
+        return compare (val, len, 0) == 0;
+    case WHERE_NE:
+        return compare (val, len, 0) != 0;
+    case WHERE_BETWEEN:
+        return compare (val, len, 0) >= 0 && compare (val, len, 1) <= 0;
+    case WHERE_PREFIX:
+        return len >= mStr[0].size () && memcmp (val, mStr[0].data (), mStr[0].size ()) == 0;
+    case WHERE_CONTAINS:
+        return mStr[0].empty () ||
+               (len >= mStr[0].size () &&
+                memmem (val, len, mStr[0].data (), mStr[0].size ()) != NULL);
+    }
+
+    return false;
+}
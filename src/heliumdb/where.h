@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Python.h>
+
+#include <string>
+#include <stdint.h>
+
+/*
+ * Value predicate of scan_where, evaluated on the stored bytes of 'i', 'f'
+ * and 's' typed values so rows that do not match are never decoded.
+ * Strings compare byte wise, which for utf-8 is code point order. match is
+ * called without the GIL.
+ */
+class heliumdbPredicate
+{
+public:
+    /* NULL with an exception set if op or operand do not suit valType */
+    static heliumdbPredicate* create (char valType, const char* op, PyObject* operand);
+
+    bool match (const void* val, size_t len) const;
+
+private:
+    enum whereOp
+    {
+        WHERE_LT,
+        WHERE_LE,
+        WHERE_GT,
+        WHERE_GE,
+        WHERE_EQ,
+        WHERE_NE,
+        WHERE_BETWEEN,
+        WHERE_PREFIX,
+        WHERE_CONTAINS
+    };
+
+    heliumdbPredicate (char valType, whereOp op) : mType (valType), mOp (op) {}
+
+    bool setOperand (int i, PyObject* o);
+
+    /* negative, zero or positive as val sorts before, at or after operand i */
+    int compare (const void* val, size_t len, int i) const;
+
+    char        mType;
+    whereOp     mOp;
+    int64_t     mInt[2];
+    double      mFloat[2];
+    std::string mStr[2];
+};
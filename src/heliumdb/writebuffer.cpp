@@ -0,0 +1,195 @@
+#include "writebuffer.h"
+
+#include <cerrno>
+#include <chrono>
+
+using namespace std;
+
+heliumdbWriteBuffer::heliumdbWriteBuffer (heliumdbBackend* ds, size_t limit, double interval)
+    : mFlushes (0),
+      mFlushedItems (0),
+      mErrors (0),
+      mDatastore (ds),
+      mLimit (limit),
+      mInterval (interval),
+      mRequested (0),
+      mCompleted (0),
+      mStop (false)
+{
+    mThread = thread (&heliumdbWriteBuffer::run, this);
+}
+
+heliumdbWriteBuffer::~heliumdbWriteBuffer ()
+{
+    {
+        lock_guard<mutex> lock (mLock);
+        mStop = true;
+    }
+    mWake.notify_one ();
+    mThread.join ();
+}
+
+void
+heliumdbWriteBuffer::store (const void* key, size_t keyLen, const entry& e)
+{
+    unique_lock<mutex> lock (mLock);
+
+    // both maps full, wait for the running flush
+    while (mPending.size () >= mLimit && !mFlushing.empty ())
+        mFlushed.wait (lock);
+
+    mPending[string ((const char*)key, keyLen)] = e;
+
+    if (mPending.size () >= mLimit)
+        mWake.notify_one ();
+}
+
+void
+heliumdbWriteBuffer::put (const void* key, size_t keyLen, const void* val, size_t valLen)
+{
+    entry e;
+    e.mVal.assign ((const char*)val, valLen);
+    e.mDelete = false;
+
+    store (key, keyLen, e);
+}
+
+void
+heliumdbWriteBuffer::remove (const void* key, size_t keyLen)
+{
+    entry e;
+    e.mDelete = true;
+
+    store (key, keyLen, e);
+}
+
+int
+heliumdbWriteBuffer::find (const void* key, size_t keyLen, string& val)
+{
+    string              k ((const char*)key, keyLen);
+    lock_guard<mutex>   lock (mLock);
+
+    entryMap::const_iterator itr = mPending.find (k);
+    if (itr == mPending.end ())
+    {
+        itr = mFlushing.find (k);
+        if (itr == mFlushing.end ())
+            return -1;
+    }
+
+    if (itr->second.mDelete)
+        return 0;
+
+    val = itr->second.mVal;
+    return 1;
+}
+
+bool
+heliumdbWriteBuffer::flush (string& err)
+{
+    unique_lock<mutex> lock (mLock);
+
+    if (!mPending.empty () || !mFlushing.empty ())
+    {
+        uint64_t generation = ++mRequested;
+        mWake.notify_one ();
+        while (mCompleted < generation)
+            mFlushed.wait (lock);
+    }
+
+    if (mError.empty ())
+        return true;
+
+    err.swap (mError);
+    mError.clear ();
+    return false;
+}
+
+void
+heliumdbWriteBuffer::discard ()
+{
+    unique_lock<mutex> lock (mLock);
+
+    mPending.clear ();
+    while (!mFlushing.empty ())
+        mFlushed.wait (lock);
+}
+
+size_t
+heliumdbWriteBuffer::pending ()
+{
+    lock_guard<mutex> lock (mLock);
+    return mPending.size () + mFlushing.size ();
+}
+
+/* called by the flusher without the lock, mFlushing is only read meanwhile */
+void
+heliumdbWriteBuffer::apply (const entryMap& entries)
+{
+    he_item item;
+    string  error;
+
+    for (entryMap::const_iterator itr = entries.begin (); itr != entries.end (); ++itr)
+    {
+        item.key = (void*)itr->first.data ();
+        item.key_len = itr->first.size ();
+
+        // a buffered delete of a key that was never written is not an error
+        if (itr->second.mDelete)
+        {
+            mDatastore->erase (&item);
+            continue;
+        }
+
+        item.val = (void*)itr->second.mVal.data ();
+        item.val_len = itr->second.mVal.size ();
+        if (mDatastore->update (&item) != 0)
+        {
+            mErrors++;
+            if (error.empty ())
+                error = string ("he_update failed: ") + he_strerror (errno);
+        }
+    }
+
+    if (mDatastore->commit () != 0 && error.empty ())
+        error = string ("he_commit failed: ") + he_strerror (errno);
+
+    mFlushes++;
+    mFlushedItems += entries.size ();
+
+    if (!error.empty ())
+    {
+        lock_guard<mutex> lock (mLock);
+        if (mError.empty ())
+            mError = error;
+    }
+}
+
+void
+heliumdbWriteBuffer::run ()
+{
+    unique_lock<mutex> lock (mLock);
+
+    for (;;)
+    {
+        mWake.wait_for (lock, chrono::duration<double> (mInterval), [this] {
+            return mStop || mRequested > mCompleted || mPending.size () >= mLimit;
+        });
+
+        uint64_t generation = mRequested;
+        if (!mPending.empty ())
+        {
+            mFlushing.swap (mPending);
+            lock.unlock ();
+            apply (mFlushing);
+            lock.lock ();
+            mFlushing.clear ();
+        }
+
+        mCompleted = generation;
+        mFlushed.notify_all ();
+
+        if (mStop && mPending.empty ())
+            return;
+    }
+}
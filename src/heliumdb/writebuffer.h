@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "backend.h"
+
+/*
+ * Write-behind buffer of a handle opened with write_buffer=N.
+ *
+ * Writes and deletes of encoded keys are coalesced in memory, the last one
+ * to a key wins, and applied by a background thread once N keys are pending
+ * or flush_interval elapsed, followed by he_commit. While a flush runs new
+ * writes go to a second map so writers only block when that one fills up
+ * too. Every method may block and must be called without the GIL.
+ */
+class heliumdbWriteBuffer
+{
+public:
+    heliumdbWriteBuffer (heliumdbBackend* ds, size_t limit, double interval);
+
+    /* applies everything still buffered */
+    ~heliumdbWriteBuffer ();
+
+    void put (const void* key, size_t keyLen, const void* val, size_t valLen);
+
+    void remove (const void* key, size_t keyLen);
+
+    /* 1 with val set if key has a buffered write, 0 if it has a buffered
+     * delete, -1 if it is not buffered */
+    int find (const void* key, size_t keyLen, std::string& val);
+
+    /* wait until every write buffered so far is applied, false with err set
+     * if a flush failed since the last call */
+    bool flush (std::string& err);
+
+    /* drop buffered writes not yet being applied */
+    void discard ();
+
+    size_t pending ();
+
+    std::atomic<uint64_t>   mFlushes;
+    std::atomic<uint64_t>   mFlushedItems;
+    std::atomic<uint64_t>   mErrors;
+
+private:
+    typedef struct
+    {
+        std::string mVal;
+        bool        mDelete;
+    } entry;
+
+    typedef std::unordered_map<std::string, entry> entryMap;
+
+    void store (const void* key, size_t keyLen, const entry& e);
+
+    void apply (const entryMap& entries);
+
+    void run ();
+
+    heliumdbBackend*        mDatastore;
+    size_t                  mLimit;
+    double                  mInterval;
+    std::mutex              mLock;
+    std::condition_variable mWake;
+    std::condition_variable mFlushed;
+    entryMap                mPending;
+    entryMap                mFlushing;
+    uint64_t                mRequested;
+    uint64_t                mCompleted;
+    bool                    mStop;
+    std::string             mError;
+    std::thread             mThread;
+};
@@ -0,0 +1,536 @@
+/*
+ * In-process microbenchmarks of the binding layer: the serializers, the
+ * lookup and update paths and iteration, run against whichever libhe the
+ * binary links (heliumdb_bench_libhe or the in-memory heliumdb_bench_mem).
+ * Prints json with the median ns/op and allocations/op of each benchmark,
+ * allocations being C++ new plus the python object and mem allocators.
+ *
+ *   heliumdb_bench_mem [-n iterations] [-r rounds] [-u url] [-f filter]
+ */
+#include "module.h"
+#include "metrics.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#ifndef HELIUMDB_BENCH_BACKEND
+#define HELIUMDB_BENCH_BACKEND "libhe"
+#endif
+
+/* distinct keys and values, benchmarks cycle through them */
+#define BENCH_KEYS      65536
+
+PyMODINIT_FUNC PyInit_heliumdb (void);
+
+static atomic<uint64_t> allocs (0);
+
+void*
+operator new (size_t n)
+{
+    allocs.fetch_add (1, memory_order_relaxed);
+    void* p = malloc (n ? n : 1);
+    if (p == NULL)
+        throw bad_alloc ();
+    return p;
+}
+
+void
+operator delete (void* p) noexcept
+{
+    free (p);
+}
+
+void
+operator delete (void* p, size_t) noexcept
+{
+    free (p);
+}
+
+/* counting hooks over the python allocators, the original is the ctx */
+static PyMemAllocatorEx memAllocator;
+static PyMemAllocatorEx objAllocator;
+
+static void*
+countingMalloc (void* ctx, size_t n)
+{
+    PyMemAllocatorEx* a = (PyMemAllocatorEx*)ctx;
+    allocs.fetch_add (1, memory_order_relaxed);
+    return a->malloc (a->ctx, n);
+}
+
+static void*
+countingCalloc (void* ctx, size_t nelem, size_t elsize)
+{
+    PyMemAllocatorEx* a = (PyMemAllocatorEx*)ctx;
+    allocs.fetch_add (1, memory_order_relaxed);
+    return a->calloc (a->ctx, nelem, elsize);
+}
+
+static void*
+countingRealloc (void* ctx, void* p, size_t n)
+{
+    PyMemAllocatorEx* a = (PyMemAllocatorEx*)ctx;
+    allocs.fetch_add (1, memory_order_relaxed);
+    return a->realloc (a->ctx, p, n);
+}
+
+static void
+countingFree (void* ctx, void* p)
+{
+    PyMemAllocatorEx* a = (PyMemAllocatorEx*)ctx;
+    a->free (a->ctx, p);
+}
+
+static void
+hookAllocator (PyMemAllocatorDomain domain, PyMemAllocatorEx* orig)
+{
+    PyMem_GetAllocator (domain, orig);
+
+    PyMemAllocatorEx hook = {orig, countingMalloc, countingCalloc, countingRealloc, countingFree};
+    PyMem_SetAllocator (domain, &hook);
+}
+
+typedef struct
+{
+    heliumdbPy*         mInts;      /* 'i' keys, 's' values */
+    heliumdbPy*         mObjects;   /* 's' keys, 'O' values */
+    vector<PyObject*>   mIntKeys;
+    vector<PyObject*>   mStrings;
+    vector<PyObject*>   mObjectVals;
+    vector<string>      mIntBytes;
+    vector<string>      mStringBytes;
+    vector<string>      mObjectBytes;
+} benchContext;
+
+typedef bool (*benchFn) (benchContext& ctx, uint64_t n);
+
+typedef struct
+{
+    const char* mName;
+    benchFn     mRun;
+} benchmark;
+
+static bool
+serializeIntKeyBench (benchContext& ctx, uint64_t n)
+{
+    void*   v;
+    size_t  l;
+
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (!serializeIntKey (ctx.mIntKeys[i % BENCH_KEYS], v, l))
+            return false;
+    }
+    return true;
+}
+
+static bool
+serializeStringBench (benchContext& ctx, uint64_t n)
+{
+    void*   v;
+    size_t  l;
+
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (!serializeString (ctx.mStrings[i % BENCH_KEYS], v, l))
+            return false;
+    }
+    return true;
+}
+
+static bool
+serializeObjectBench (benchContext& ctx, uint64_t n)
+{
+    void*   v;
+    size_t  l;
+
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (!serializeObject (ctx.mObjectVals[i % BENCH_KEYS], v, l))
+            return false;
+    }
+    return true;
+}
+
+static bool
+deserializeLoop (const vector<string>& bytes, deserializer fn, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        const string&   b = bytes[i % BENCH_KEYS];
+        PyObject*       o = fn ((void*)b.data (), b.size ());
+        if (o == NULL)
+            return false;
+        Py_DECREF (o);
+    }
+    return true;
+}
+
+static bool
+deserializeIntBench (benchContext& ctx, uint64_t n)
+{
+    return deserializeLoop (ctx.mIntBytes, deserializeInt, n);
+}
+
+static bool
+deserializeStringBench (benchContext& ctx, uint64_t n)
+{
+    return deserializeLoop (ctx.mStringBytes, deserializeString, n);
+}
+
+static bool
+deserializeObjectBench (benchContext& ctx, uint64_t n)
+{
+    return deserializeLoop (ctx.mObjectBytes, deserializeObject, n);
+}
+
+static bool
+updateBench (benchContext& ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        size_t j = i % BENCH_KEYS;
+        if (heliumdb_ass_sub (ctx.mInts, ctx.mIntKeys[j], ctx.mStrings[j]) != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool
+lookupBench (benchContext& ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        PyObject* v = heliumdb_subscript (ctx.mInts, ctx.mIntKeys[i % BENCH_KEYS]);
+        if (v == NULL)
+            return false;
+        Py_DECREF (v);
+    }
+    return true;
+}
+
+static bool
+containsBench (benchContext& ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        PyObject* v = heliumdb_contains (ctx.mInts, ctx.mIntKeys[i % BENCH_KEYS]);
+        if (v == NULL)
+            return false;
+        Py_DECREF (v);
+    }
+    return true;
+}
+
+static bool
+updateObjectBench (benchContext& ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        size_t j = i % BENCH_KEYS;
+        if (heliumdb_ass_sub (ctx.mObjects, ctx.mStrings[j], ctx.mObjectVals[j]) != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool
+lookupObjectBench (benchContext& ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        PyObject* v = heliumdb_subscript (ctx.mObjects, ctx.mStrings[i % BENCH_KEYS]);
+        if (v == NULL)
+            return false;
+        Py_DECREF (v);
+    }
+    return true;
+}
+
+/* n items from items (chunk=chunk), reopening the iterator at the end */
+static bool
+iterateLoop (benchContext& ctx, uint64_t n, long chunk)
+{
+    PyObject* args = PyTuple_New (0);
+    PyObject* kwargs = Py_BuildValue ("{s:l}", "chunk", chunk);
+    PyObject* itr = NULL;
+    bool      ok = args && kwargs;
+
+    for (uint64_t i = 0; ok && i < n; )
+    {
+        if (itr == NULL && !(itr = heliumdb_iteritems (ctx.mInts, args, kwargs)))
+        {
+            ok = false;
+            break;
+        }
+
+        PyObject* item = PyIter_Next (itr);
+        if (item == NULL)
+        {
+            ok = !PyErr_Occurred ();
+            Py_CLEAR (itr);
+            continue;
+        }
+        Py_DECREF (item);
+        ++i;
+    }
+
+    Py_XDECREF (itr);
+    Py_XDECREF (kwargs);
+    Py_XDECREF (args);
+    return ok;
+}
+
+static bool
+iterateBench (benchContext& ctx, uint64_t n)
+{
+    return iterateLoop (ctx, n, 1);
+}
+
+static bool
+iterateChunkedBench (benchContext& ctx, uint64_t n)
+{
+    return iterateLoop (ctx, n, 256);
+}
+
+static const benchmark benchmarks[] = {
+    {"serialize_int_key", serializeIntKeyBench},
+    {"serialize_string", serializeStringBench},
+    {"serialize_object", serializeObjectBench},
+    {"deserialize_int", deserializeIntBench},
+    {"deserialize_string", deserializeStringBench},
+    {"deserialize_object", deserializeObjectBench},
+    {"update_int_string", updateBench},
+    {"lookup_int_string", lookupBench},
+    {"contains_int", containsBench},
+    {"update_string_object", updateObjectBench},
+    {"lookup_string_object", lookupObjectBench},
+    {"iterate_items", iterateBench},
+    {"iterate_items_chunk_256", iterateChunkedBench},
+};
+
+static heliumdbPy*
+openHandle (PyObject* type, const char* url, const char* datastore,
+            const char* keyType, const char* valType)
+{
+    PyObject* args = PyTuple_New (0);
+    PyObject* kwargs = Py_BuildValue ("{s:s,s:s,s:s,s:s,s:i}",
+                                      "url", url,
+                                      "datastore", datastore,
+                                      "key_type", keyType,
+                                      "val_type", valType,
+                                      "flags", HE_O_CREATE | HE_O_VOLUME_CREATE);
+    PyObject* h = args && kwargs ? PyObject_Call (type, args, kwargs) : NULL;
+
+    Py_XDECREF (kwargs);
+    Py_XDECREF (args);
+    return (heliumdbPy*)h;
+}
+
+static bool
+storedBytes (serializer fn, PyObject* o, string& out)
+{
+    void*   v;
+    size_t  l;
+
+    if (!fn (o, v, l))
+        return false;
+    out.assign ((const char*)v, l);
+    return true;
+}
+
+static bool
+setup (benchContext& ctx, PyObject* type, const char* url)
+{
+    if (!(ctx.mInts = openHandle (type, url, "bench-ints", "i", "s")) ||
+        !(ctx.mObjects = openHandle (type, url, "bench-objects", "s", "O")))
+        return false;
+
+    char buf[64];
+    for (int i = 0; i < BENCH_KEYS; ++i)
+    {
+        snprintf (buf, sizeof (buf), "value-%08d", i);
+
+        PyObject* k = PyLong_FromLong (i);
+        PyObject* s = PyUnicode_FromString (buf);
+        PyObject* o = Py_BuildValue ("{s:i,s:s,s:d}", "id", i, "name", buf, "score", i * 0.5);
+        if (k == NULL || s == NULL || o == NULL)
+            return false;
+
+        ctx.mIntKeys.push_back (k);
+        ctx.mStrings.push_back (s);
+        ctx.mObjectVals.push_back (o);
+
+        ctx.mIntBytes.push_back (string ());
+        ctx.mStringBytes.push_back (string ());
+        ctx.mObjectBytes.push_back (string ());
+        if (!storedBytes (serializeIntVal, k, ctx.mIntBytes.back ()) ||
+            !storedBytes (serializeString, s, ctx.mStringBytes.back ()) ||
+            !storedBytes (serializeObject, o, ctx.mObjectBytes.back ()))
+            return false;
+    }
+
+    // lookups and iteration run against a populated datastore whatever
+    // the filter selects
+    return updateBench (ctx, BENCH_KEYS) && updateObjectBench (ctx, BENCH_KEYS);
+}
+
+static void
+teardown (benchContext& ctx)
+{
+    PyObject* res;
+
+    if (ctx.mInts)
+    {
+        if ((res = PyObject_CallMethod ((PyObject*)ctx.mInts, "cleanup", NULL)))
+            Py_DECREF (res);
+        Py_DECREF (ctx.mInts);
+    }
+    if (ctx.mObjects)
+    {
+        if ((res = PyObject_CallMethod ((PyObject*)ctx.mObjects, "cleanup", NULL)))
+            Py_DECREF (res);
+        Py_DECREF (ctx.mObjects);
+    }
+    PyErr_Clear ();
+
+    for (size_t i = 0; i < ctx.mIntKeys.size (); ++i)
+    {
+        Py_DECREF (ctx.mIntKeys[i]);
+        Py_DECREF (ctx.mStrings[i]);
+        Py_DECREF (ctx.mObjectVals[i]);
+    }
+}
+
+/* he://.//path urls need the volume file to exist */
+static void
+createVolume (const char* url)
+{
+    const char* prefix = "he://./";
+    if (strncmp (url, prefix, strlen (prefix)) != 0)
+        return;
+
+    const char* path = url + strlen (prefix);
+    int fd = open (path, O_CREAT | O_WRONLY, 0644);
+    if (fd < 0)
+        return;
+    if (lseek (fd, 0, SEEK_END) == 0 && ftruncate (fd, 2LL << 30) != 0)
+        fprintf (stderr, "failed to size volume %s\n", path);
+    close (fd);
+}
+
+static void
+usage (const char* prog)
+{
+    fprintf (stderr, "usage: %s [-n iterations] [-r rounds] [-u url] [-f filter]\n", prog);
+    exit (1);
+}
+
+int
+main (int argc, char** argv)
+{
+    uint64_t    iterations = 200000;
+    int         rounds = 5;
+    const char* url = "he://.//tmp/heliumdb-bench";
+    const char* filter = NULL;
+    int         opt;
+
+    while ((opt = getopt (argc, argv, "n:r:u:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': iterations = strtoull (optarg, NULL, 10); break;
+        case 'r': rounds = atoi (optarg); break;
+        case 'u': url = optarg; break;
+        case 'f': filter = optarg; break;
+        default: usage (argv[0]);
+        }
+    }
+    if (iterations == 0 || rounds <= 0)
+        usage (argv[0]);
+
+    createVolume (url);
+
+    PyImport_AppendInittab ("heliumdb", PyInit_heliumdb);
+    Py_Initialize ();
+
+    hookAllocator (PYMEM_DOMAIN_MEM, &memAllocator);
+    hookAllocator (PYMEM_DOMAIN_OBJ, &objAllocator);
+
+    benchContext    ctx;
+    PyObject*       module = PyImport_ImportModule ("heliumdb");
+    PyObject*       type = module ? PyObject_GetAttrString (module, "Heliumdb") : NULL;
+
+    ctx.mInts = ctx.mObjects = NULL;
+    if (type == NULL || !setup (ctx, type, url))
+    {
+        PyErr_Print ();
+        return 1;
+    }
+
+    printf ("{\n  \"backend\": \"%s\",\n  \"python\": \"%s\",\n"
+            "  \"iterations\": %llu,\n  \"rounds\": %d,\n  \"results\": [",
+            HELIUMDB_BENCH_BACKEND, PY_VERSION, (unsigned long long)iterations, rounds);
+
+    bool    ok = true;
+    bool    first = true;
+    for (size_t b = 0; ok && b < sizeof (benchmarks) / sizeof (benchmarks[0]); ++b)
+    {
+        const benchmark& bench = benchmarks[b];
+        if (filter && !strstr (bench.mName, filter))
+            continue;
+
+        vector<double>  nsPerOp;
+        vector<double>  allocsPerOp;
+
+        ok = bench.mRun (ctx, min<uint64_t> (iterations, 1000));
+        for (int r = 0; ok && r < rounds; ++r)
+        {
+            uint64_t allocsStart = allocs.load ();
+            uint64_t start = heliumdbNow ();
+
+            ok = bench.mRun (ctx, iterations);
+
+            uint64_t elapsed = heliumdbNow () - start;
+            nsPerOp.push_back ((double)elapsed / iterations);
+            allocsPerOp.push_back ((double)(allocs.load () - allocsStart) / iterations);
+        }
+        if (!ok)
+        {
+            fprintf (stderr, "%s failed\n", bench.mName);
+            break;
+        }
+
+        sort (nsPerOp.begin (), nsPerOp.end ());
+        sort (allocsPerOp.begin (), allocsPerOp.end ());
+
+        printf ("%s\n    {\"name\": \"%s\", \"ns_per_op\": %.1f, \"ns_per_op_min\": %.1f, "
+                "\"allocs_per_op\": %.2f}",
+                first ? "" : ",", bench.mName, nsPerOp[rounds / 2], nsPerOp[0],
+                allocsPerOp[rounds / 2]);
+        first = false;
+        fflush (stdout);
+    }
+    printf ("\n  ]\n}\n");
+
+    if (!ok)
+        PyErr_Print ();
+
+    teardown (ctx);
+    Py_DECREF (type);
+    Py_DECREF (module);
+    Py_Finalize ();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+ * The subset of the helium API used by heliumdb, implemented in memory by
+ * memhe.cpp so benchmarks can run without libhe or a volume. Declarations
+ * and flag values follow he.h.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HE_MAX_KEY_LEN          255
+#define HE_MAX_VAL_LEN          (16 * 1024 * 1024)
+
+#define HE_O_CREATE             1
+#define HE_O_TRUNCATE           2
+#define HE_O_VOLUME_CREATE      4
+#define HE_O_VOLUME_TRUNCATE    8
+#define HE_O_VOLUME_NOTRIM      16
+#define HE_O_NOSORT             32
+#define HE_O_SCAN               64
+#define HE_O_CLEAN              128
+#define HE_O_COMPRESS           256
+#define HE_O_READONLY           512
+#define HE_O_ERR_EXISTS         1024
+
+typedef struct he* he_t;
+typedef struct he_iter* he_iter_t;
+
+typedef struct he_item
+{
+    void*   key;
+    void*   val;
+    size_t  key_len;
+    size_t  val_len;
+} he_item;
+
+typedef struct he_env
+{
+    uint64_t    fanout;
+    uint64_t    gc_fanout;
+    uint64_t    write_cache;
+    uint64_t    read_cache;
+    uint64_t    auto_commit_period;
+    uint64_t    auto_clean_period;
+    uint64_t    clean_util_pct;
+    uint64_t    clean_dirty_pct;
+    uint64_t    retry_count;
+    uint64_t    retry_delay;
+    uint64_t    compress_threshold;
+} he_env;
+
+struct he_stats
+{
+    const char* name;
+    uint64_t    valid_items;
+    uint64_t    deleted_items;
+    uint64_t    utilized;
+    uint64_t    capacity;
+    uint64_t    buffered_writes;
+    uint64_t    buffered_reads;
+    uint64_t    dirty_writes;
+    uint64_t    device_writes;
+    uint64_t    device_reads;
+    uint64_t    auto_commits;
+    uint64_t    auto_cleans;
+    uint64_t    clean_bytes;
+    uint64_t    cache_hits;
+    uint64_t    cache_misses;
+};
+
+he_t he_open (const char* url, const char* name, int flags, struct he_env* env);
+int he_close (he_t he);
+int he_remove (he_t he);
+int he_stats (he_t he, struct he_stats* stats);
+
+int he_update (he_t he, const struct he_item* item);
+int he_delete (he_t he, const struct he_item* item);
+int he_delete_lookup (he_t he, struct he_item* item, size_t off, size_t len);
+int he_exists (he_t he, const struct he_item* item);
+int he_lookup (he_t he, struct he_item* item, size_t off, size_t len);
+int he_prev (he_t he, struct he_item* item, size_t off, size_t len);
+int he_commit (he_t he);
+he_t he_transaction (he_t he);
+int he_discard (he_t he);
+
+he_iter_t he_iter_open (he_t he, const void* key, size_t key_len, size_t max_val_len, int flags);
+const struct he_item* he_iter_next (he_iter_t itr);
+int he_iter_close (he_iter_t itr);
+
+const char* he_strerror (int err);
+
+#ifdef __cplusplus
+}
+#endif
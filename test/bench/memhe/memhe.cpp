@@ -0,0 +1,268 @@
+#include "he.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+/*
+ * Datastores are ordered maps that live until the process exits, so a
+ * datastore reopened with the same url and name sees earlier writes like
+ * it would on a volume. Writes are visible immediately, commit is a nop.
+ */
+typedef struct
+{
+    mutex               mLock;
+    map<string, string> mItems;
+} memStore;
+
+struct he
+{
+    memStore*   mStore;
+    string      mName;
+};
+
+struct he_iter
+{
+    memStore*   mStore;
+    string      mKey;
+    string      mVal;
+    size_t      mMaxValLen;
+    bool        mStarted;
+    he_item     mItem;
+};
+
+static mutex                    storesLock;
+static map<string, memStore*>   stores;
+
+static inline string
+keyOf (const he_item* item)
+{
+    return string ((const char*)item->key, item->key_len);
+}
+
+/* copies len bytes of val from off into item, val_len gets the full size */
+static int
+copyVal (he_item* item, const string& val, size_t off, size_t len)
+{
+    size_t avail = off < val.size () ? val.size () - off : 0;
+    if (len > avail)
+        len = avail;
+    if (len > 0)
+        memcpy (item->val, val.data () + off, len);
+    item->val_len = val.size ();
+    return 0;
+}
+
+static int
+notFound ()
+{
+    errno = ENOENT;
+    return -1;
+}
+
+he_t
+he_open (const char* url, const char* name, int flags, struct he_env* env)
+{
+    if (url == NULL || name == NULL)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    lock_guard<mutex>   guard (storesLock);
+    string              path = string (url) + "/" + name;
+    memStore*&          store = stores[path];
+
+    if (store == NULL)
+    {
+        if (!(flags & HE_O_CREATE))
+        {
+            stores.erase (path);
+            errno = ENOENT;
+            return NULL;
+        }
+        store = new memStore ();
+    }
+    else if (flags & HE_O_TRUNCATE)
+    {
+        lock_guard<mutex> storeGuard (store->mLock);
+        store->mItems.clear ();
+    }
+
+    he_t he = new struct he ();
+    he->mStore = store;
+    he->mName = name;
+    return he;
+}
+
+int
+he_close (he_t he)
+{
+    delete he;
+    return 0;
+}
+
+int
+he_remove (he_t he)
+{
+    lock_guard<mutex> guard (he->mStore->mLock);
+    he->mStore->mItems.clear ();
+    return 0;
+}
+
+int
+he_stats (he_t he, struct he_stats* stats)
+{
+    lock_guard<mutex> guard (he->mStore->mLock);
+
+    memset (stats, 0, sizeof (*stats));
+    stats->name = he->mName.c_str ();
+    stats->valid_items = he->mStore->mItems.size ();
+    for (map<string, string>::const_iterator it = he->mStore->mItems.begin ();
+         it != he->mStore->mItems.end ();
+         ++it)
+        stats->utilized += it->first.size () + it->second.size ();
+    return 0;
+}
+
+int
+he_update (he_t he, const struct he_item* item)
+{
+    lock_guard<mutex> guard (he->mStore->mLock);
+    he->mStore->mItems[keyOf (item)].assign ((const char*)item->val, item->val_len);
+    return 0;
+}
+
+int
+he_delete (he_t he, const struct he_item* item)
+{
+    lock_guard<mutex> guard (he->mStore->mLock);
+    return he->mStore->mItems.erase (keyOf (item)) ? 0 : notFound ();
+}
+
+int
+he_delete_lookup (he_t he, struct he_item* item, size_t off, size_t len)
+{
+    lock_guard<mutex>               guard (he->mStore->mLock);
+    map<string, string>::iterator   it = he->mStore->mItems.find (keyOf (item));
+
+    if (it == he->mStore->mItems.end ())
+        return notFound ();
+
+    copyVal (item, it->second, off, len);
+    he->mStore->mItems.erase (it);
+    return 0;
+}
+
+int
+he_exists (he_t he, const struct he_item* item)
+{
+    lock_guard<mutex> guard (he->mStore->mLock);
+    return he->mStore->mItems.count (keyOf (item)) ? 0 : notFound ();
+}
+
+int
+he_lookup (he_t he, struct he_item* item, size_t off, size_t len)
+{
+    lock_guard<mutex>               guard (he->mStore->mLock);
+    map<string, string>::iterator   it = he->mStore->mItems.find (keyOf (item));
+
+    if (it == he->mStore->mItems.end ())
+        return notFound ();
+
+    return copyVal (item, it->second, off, len);
+}
+
+/* item before the key of item, the last item when key_len is 0 */
+int
+he_prev (he_t he, struct he_item* item, size_t off, size_t len)
+{
+    lock_guard<mutex>               guard (he->mStore->mLock);
+    map<string, string>&            items = he->mStore->mItems;
+    map<string, string>::iterator   it = item->key_len ? items.lower_bound (keyOf (item))
+                                                       : items.end ();
+
+    if (it == items.begin ())
+        return notFound ();
+
+    --it;
+    memcpy (item->key, it->first.data (), it->first.size ());
+    item->key_len = it->first.size ();
+    return copyVal (item, it->second, off, len);
+}
+
+int
+he_commit (he_t he)
+{
+    return 0;
+}
+
+/* transactions are not modelled, benchmark them against mem:// instead */
+he_t
+he_transaction (he_t he)
+{
+    errno = ENOTSUP;
+    return NULL;
+}
+
+int
+he_discard (he_t he)
+{
+    errno = EINVAL;
+    return -1;
+}
+
+he_iter_t
+he_iter_open (he_t he, const void* key, size_t key_len, size_t max_val_len, int flags)
+{
+    he_iter_t itr = new struct he_iter ();
+
+    itr->mStore = he->mStore;
+    itr->mKey.assign ((const char*)key, key ? key_len : 0);
+    itr->mMaxValLen = max_val_len;
+    itr->mStarted = false;
+    return itr;
+}
+
+/* walks the live map from the last key returned, so items written during
+ * iteration may or may not be seen like on a volume */
+const struct he_item*
+he_iter_next (he_iter_t itr)
+{
+    lock_guard<mutex>               guard (itr->mStore->mLock);
+    map<string, string>&            items = itr->mStore->mItems;
+    map<string, string>::iterator   it = itr->mStarted ? items.upper_bound (itr->mKey)
+                                                       : items.lower_bound (itr->mKey);
+
+    if (it == items.end ())
+        return NULL;
+
+    itr->mStarted = true;
+    itr->mKey = it->first;
+    itr->mVal.assign (it->second, 0, min (it->second.size (), itr->mMaxValLen));
+
+    itr->mItem.key = (void*)itr->mKey.data ();
+    itr->mItem.key_len = itr->mKey.size ();
+    itr->mItem.val = (void*)itr->mVal.data ();
+    itr->mItem.val_len = itr->mVal.size ();
+    return &itr->mItem;
+}
+
+int
+he_iter_close (he_iter_t itr)
+{
+    delete itr;
+    return 0;
+}
+
+const char*
+he_strerror (int err)
+{
+    return strerror (err);
+}
@@ -1,146 +1,494 @@
-import time
-import sys
-from heliumdb import Heliumdb
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+# YCSB style workload driver.
+#
+#   python3 perf_test.py --workloads A,C --modes i,s --clients 4 --out run.json
+#   python3 perf_test.py --workloads A --compare run.json
+#
+# Every (workload, mode, commit batch) combination loads --records records,
+# then runs --operations operations split over --clients threads, or
+# processes with --processes, each with its own handle. Throughput and
+# p50/p99/p999 latency per op type are printed and written as json.
+#
+from heliumdb import Heliumdb, HE_O_CREATE, HE_O_VOLUME_CREATE
+from itertools import islice
+from queue import Empty
+import argparse
+import bisect
+import json
+import multiprocessing
 import os
-
-
-def setup_trunc_file(f):
-    os.system('truncate -s 2g {0}'.format(f))
-
-
-def cleanup(hdb, f):
+import random
+import sys
+import threading
+import time
+import traceback
+
+
+# read, update, insert, scan, read-modify-write proportions and key
+# distribution of the core workloads
+WORKLOADS = {
+    'A': ({'read': 0.5, 'update': 0.5}, 'zipfian'),
+    'B': ({'read': 0.95, 'update': 0.05}, 'zipfian'),
+    'C': ({'read': 1.0}, 'zipfian'),
+    'D': ({'read': 0.95, 'insert': 0.05}, 'latest'),
+    'E': ({'scan': 0.95, 'insert': 0.05}, 'zipfian'),
+    'F': ({'read': 0.5, 'rmw': 0.5}, 'zipfian'),
+}
+
+MODES = ['O', 'i', 's', 'b', 'f']
+
+ZIPFIAN_CONSTANT = 0.99
+
+
+class Zipfian(object):
+    """zipfian ranks over [0, n) after Gray et al, as used by YCSB"""
+
+    def __init__(self, n, theta=ZIPFIAN_CONSTANT, rng=random):
+        self.rng = rng
+        self.theta = theta
+        self.zeta2 = self.zeta(2, theta)
+        self.alpha = 1.0 / (1.0 - theta)
+        self.n = 0
+        self.zetan = 0.0
+        self.resize(n)
+
+    @staticmethod
+    def zeta(n, theta, start=0, initial=0.0):
+        total = initial
+        for i in range(start, n):
+            total += 1.0 / ((i + 1) ** theta)
+        return total
+
+    def resize(self, n):
+        # zeta grows incrementally as inserts extend the key space
+        if n > self.n:
+            self.zetan = self.zeta(n, self.theta, self.n, self.zetan)
+            self.n = n
+            self.eta = ((1 - (2.0 / n) ** (1 - self.theta)) /
+                        (1 - self.zeta2 / self.zetan))
+
+    def next(self):
+        u = self.rng.random()
+        uz = u * self.zetan
+        if uz < 1.0:
+            return 0
+        if uz < 1.0 + 0.5 ** self.theta:
+            return 1
+        return int(self.n * (self.eta * u - self.eta + 1) ** self.alpha)
+
+
+class KeyChooser(object):
+    def __init__(self, distribution, records, rng):
+        self.distribution = distribution
+        self.rng = rng
+        self.count = records
+        if distribution != 'uniform':
+            self.zipfian = Zipfian(records, rng=rng)
+
+    def inserted(self, count):
+        self.count = count
+        if self.distribution == 'latest':
+            self.zipfian.resize(count)
+
+    def next(self):
+        if self.distribution == 'uniform':
+            return self.rng.randrange(self.count)
+        rank = self.zipfian.next()
+        if self.distribution == 'latest':
+            return max(self.count - 1 - rank, 0)
+        # scatter popular ranks over the key space like YCSB's scrambled
+        # zipfian, so hot keys are not neighbours
+        return hash((rank, 0x5bd1e995)) % self.count
+
+
+def make_key(mode, n):
+    if mode == 'i':
+        return n
+    if mode == 'f':
+        return float(n)
+    if mode == 'b':
+        return b'user%012d' % n
+    return 'user%012d' % n
+
+
+def make_value(mode, size, rng):
+    if mode == 'i':
+        return rng.getrandbits(63)
+    if mode == 'f':
+        return rng.random()
+    payload = '%x' % rng.getrandbits(size * 4) if size else ''
+    payload = payload.rjust(size, '0')[:size]
+    if mode == 'b':
+        return payload.encode()
+    if mode == 's':
+        return payload
+    return {'field0': payload[:size // 2], 'field1': payload[size // 2:]}
+
+
+def open_db(args, mode, flags=0):
+    return Heliumdb(url=args.url,
+                    datastore='ycsb-' + mode,
+                    key_type=mode,
+                    val_type=mode,
+                    flags=flags)
+
+
+def setup_volume(url):
+    """creates the file of a he://.//path url, returns it if created"""
+    prefix = 'he://./'
+    if url.startswith(prefix):
+        path = url[len(prefix):]
+        if not os.path.exists(path):
+            os.system('truncate -s 2g {0}'.format(path))
+            return path
+    return None
+
+
+class Client(object):
+    """runs its share of operations, recording latencies in ns per op"""
+
+    def __init__(self, args, hdb, workload, mode, commit_batch, seed, counter):
+        mix, distribution = WORKLOADS[workload]
+        self.args = args
+        self.hdb = hdb
+        self.mode = mode
+        self.commit_batch = commit_batch
+        self.rng = random.Random(seed)
+        self.counter = counter
+        self.ops = []
+        self.cumulative = []
+        total = 0.0
+        for op, share in sorted(mix.items()):
+            total += share
+            self.ops.append(op)
+            self.cumulative.append(total)
+        self.keys = KeyChooser(distribution, args.records, self.rng)
+        self.latencies = dict((op, []) for op in self.ops)
+        self.writes = 0
+        if commit_batch:
+            self.latencies['commit'] = []
+
+    def choose(self):
+        i = bisect.bisect_left(self.cumulative, self.rng.random() * self.cumulative[-1])
+        return self.ops[min(i, len(self.ops) - 1)]
+
+    def wrote(self):
+        self.writes += 1
+        if self.commit_batch and self.writes % self.commit_batch == 0:
+            start = time.perf_counter_ns()
+            self.hdb.commit()
+            self.latencies['commit'].append(time.perf_counter_ns() - start)
+
+    def run(self, operations):
+        hdb = self.hdb
+        mode = self.mode
+        size = self.args.value_size
+        scan_length = self.args.scan_length
+
+        for _ in range(operations):
+            op = self.choose()
+            if op == 'insert':
+                self.keys.inserted(self.counter.next())
+                n = self.keys.count - 1
+            else:
+                self.keys.inserted(self.counter.value())
+                n = self.keys.next()
+            key = make_key(mode, n)
+
+            start = time.perf_counter_ns()
+            if op == 'read':
+                hdb.get(key, None)
+            elif op == 'update' or op == 'insert':
+                hdb[key] = make_value(mode, size, self.rng)
+            elif op == 'scan':
+                count = self.rng.randint(1, scan_length)
+                for _ in islice(hdb.range(start=key, chunk=min(count, 256)), count):
+                    pass
+            elif op == 'rmw':
+                hdb.get(key, None)
+                hdb[key] = make_value(mode, size, self.rng)
+            self.latencies[op].append(time.perf_counter_ns() - start)
+
+            if op != 'read' and op != 'scan':
+                self.wrote()
+
+
+class ThreadCounter(object):
+    """record count shared by the clients, grown by inserts"""
+
+    def __init__(self, value):
+        self.lock = threading.Lock()
+        self.count = value
+
+    def next(self):
+        with self.lock:
+            self.count += 1
+            return self.count
+
+    def value(self):
+        return self.count
+
+
+class ProcessCounter(object):
+    def __init__(self, shared):
+        self.shared = shared
+
+    def next(self):
+        with self.shared.get_lock():
+            self.shared.value += 1
+            return self.shared.value
+
+    def value(self):
+        return self.shared.value
+
+
+def percentile(ordered, q):
+    if not ordered:
+        return 0.0
+    return ordered[min(int(q * len(ordered)), len(ordered) - 1)]
+
+
+def summarize(latencies, elapsed):
+    res = {}
+    for op, samples in sorted(latencies.items()):
+        if not samples:
+            continue
+        ordered = sorted(samples)
+        res[op] = {'count': len(ordered),
+                   'ops_per_sec': len(ordered) / elapsed,
+                   'mean_us': sum(ordered) / len(ordered) / 1e3,
+                   'p50_us': percentile(ordered, 0.5) / 1e3,
+                   'p99_us': percentile(ordered, 0.99) / 1e3,
+                   'p999_us': percentile(ordered, 0.999) / 1e3}
+    return res
+
+
+def merge(target, latencies):
+    for op, samples in latencies.items():
+        target.setdefault(op, []).extend(samples)
+
+
+def load(args, mode, commit_batch):
+    hdb = open_db(args, mode, HE_O_CREATE | HE_O_VOLUME_CREATE)
     hdb.cleanup()
-    if os.path.exists(f):
-        os.remove(f)
-
-
-def string_batch_iters(x, iterations, batch=None):
-    if not batch:
-        batch = iterations + 1
-
-    for i in range(0, iterations):
-        x[str(i)] = str(i)
-        if i % batch == 0:
-            x.commit()
-
-
-def int_batch_iters(x, iterations, batch=None):
-    if not batch:
-        batch = iterations + 1
-
-    for i in range(0, iterations):
-        x[i] = i
-        if i % batch == 0:
-            x.commit()
-
-
-def string_iters(x, iterations):
-    for i in range(0, iterations):
-        x[str(i)] = str(i)
-
-
-def int_iters(x, iterations, batch=None):
-    for i in range(0, iterations):
-        x[i] = i
-
-
-def string_read_benchmark(x, iterations):
-    for i in range(iterations):
-        y = x[str(i)]
-
-
-def read_benchmark(x, iterations):
-    for i in range(iterations):
-        y = x[i]
-
-
-def dictionary_baseline(iterations, string=False):
-    x = {}
-
-    start = time.time()
-    if string:
-        string_iters(x, iterations)
-    else:
-        int_iters(x, iterations)
-    end = time.time()
-
-    write = (end - start)
-
-    start = time.time()
-    if string:
-        string_read_benchmark(x, iterations)
-    else:
-        read_benchmark(x, iterations)
-    end = time.time()
-
-    read = (end - start)
-
-    return (write, read)
-
-
-def helium_benchmark(iterations, key_type='O',
-                     val_type='O', batch=None, string=False):
-    setup_trunc_file('/tmp/test-obj')
-    hdb = Heliumdb(url="he://.//tmp/test-obj",
-                   datastore='helium',
-                   key_type=key_type,
-                   val_type=val_type)
-
-    start = time.time()
-
-    if string and batch:
-        string_batch_iters(hdb, iterations, batch=batch)
-    elif string:
-        string_iters(hdb, iterations)
-    elif not string and batch:
-        int_batch_iters(hdb, iterations, batch=batch)
-    else:
-        int_iters(hdb, iterations)
-
+    rng = random.Random(args.seed)
+    start = time.perf_counter()
+    for n in range(args.records):
+        hdb[make_key(mode, n)] = make_value(mode, args.value_size, rng)
+        if commit_batch and (n + 1) % commit_batch == 0:
+            hdb.commit()
     hdb.commit()
-    end = time.time()
-
-    write = end - start
-
-    rstart = time.time()
-    if string:
-        string_read_benchmark(hdb, iterations)
+    elapsed = time.perf_counter() - start
+    return hdb, {'records': args.records, 'ops_per_sec': args.records / elapsed}
+
+
+def process_client(args, workload, mode, commit_batch, seed, shared, operations, queue):
+    # every client reports, (None, latencies) or (traceback, None)
+    try:
+        hdb = open_db(args, mode)
+        client = Client(args, hdb, workload, mode, commit_batch, seed, ProcessCounter(shared))
+        client.run(operations)
+        hdb.commit()
+        queue.put((None, client.latencies))
+    except Exception:
+        queue.put((traceback.format_exc(), None))
+
+
+def collect(procs, queue, latencies):
+    """merges the latencies reported by procs, raises if a client failed or
+    died without reporting"""
+    pending = len(procs)
+    while pending:
+        try:
+            error, res = queue.get(timeout=1)
+        except Empty:
+            for p in procs:
+                if p.exitcode not in (None, 0):
+                    raise RuntimeError('client process exited with code {0}'.format(p.exitcode))
+            continue
+        if error:
+            raise RuntimeError('client process failed:\n' + error)
+        merge(latencies, res)
+        pending -= 1
+
+
+def run_workload(args, workload, mode, commit_batch):
+    hdb, loaded = load(args, mode, commit_batch)
+    clients = args.processes or args.clients
+    shares = [args.operations // clients + (1 if i < args.operations % clients else 0)
+              for i in range(clients)]
+    latencies = {}
+
+    start = time.perf_counter()
+    if args.processes:
+        # spawn rather than fork, the parent runs native pool threads
+        ctx = multiprocessing.get_context('spawn')
+        shared = ctx.Value('q', args.records)
+        queue = ctx.Queue()
+        procs = [ctx.Process(target=process_client,
+                                         args=(args, workload, mode, commit_batch,
+                                               args.seed + i + 1, shared, shares[i], queue))
+                 for i in range(clients)]
+        for p in procs:
+            p.start()
+        try:
+            collect(procs, queue, latencies)
+        except Exception:
+            for p in procs:
+                p.terminate()
+            raise
+        finally:
+            for p in procs:
+                p.join()
     else:
-        read_benchmark(hdb, iterations)
-    rend = time.time()
-
-
-    cleanup(hdb, '/tmp/test-obj')
-
-    x = (write, rend - rstart)
-    return x
-
-
-if len(sys.argv) != 2:
-    print('require iters')
-    sys.exit(1)
-
-iterations = int(sys.argv[1])
-
-baseline_w, baseline_r= dictionary_baseline(iterations)
-pickle_w, pickle_r = helium_benchmark(iterations)
-typed_w, typed_r = helium_benchmark(iterations, key_type='i', val_type='i')
-batched_w, batched_r = helium_benchmark(iterations, key_type='i', val_type='i', batch=1024)
+        counter = ThreadCounter(args.records)
+        workers = [Client(args, hdb, workload, mode, commit_batch, args.seed + i + 1, counter)
+                   for i in range(clients)]
+        threads = [threading.Thread(target=w.run, args=(shares[i],))
+                   for i, w in enumerate(workers)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        for w in workers:
+            merge(latencies, w.latencies)
+    hdb.commit()
+    elapsed = time.perf_counter() - start
 
-print('{0} {1:^20} {2}'.format('-' * 10, 'integer results (write/read)', '-' * 10))
-print('dictionary baseline       -> {0:.09f}/{1:.09f}'.format(baseline_w, baseline_r))
-print('helium typed object       -> {0:.09f}/{1:.09f}'.format(typed_w, typed_r))
-print('helium pickled object     -> {0:.09f}/{1:.09f}'.format(pickle_w, pickle_r))
-print('helium typed 1024 batch   -> {0:.09f}/{1:.09f}'.format(batched_w, batched_r))
+    hdb.cleanup()
 
-baseline_w, baseline_r = dictionary_baseline(iterations, string=True)
-pickle_w, pickle_r = helium_benchmark(iterations, string=True)
-typed_w, typed_r = helium_benchmark(iterations, key_type='s', val_type='s',
-                                    string=True)
-batched_w, batched_r = helium_benchmark(iterations, key_type='s', val_type='s',
-                                        string=True, batch=1024)
-print('{0} {1:^20} {2}'.format('-' * 10, 'string results (write/read)', '-' * 10))
-print('dictionary baseline       -> {0:.09f}/{1:.09f}'.format(baseline_w, baseline_r))
-print('helium typed object       -> {0:.09f}/{1:.09f}'.format(typed_w, typed_r))
-print('helium pickled object     -> {0:.09f}/{1:.09f}'.format(pickle_w, pickle_r))
-print('helium typed 1024 batch   -> {0:.09f}/{1:.09f}'.format(batched_w, batched_r))
+    return {'workload': workload,
+            'mode': mode,
+            'commit_batch': commit_batch,
+            'clients': clients,
+            'processes': bool(args.processes),
+            'load': loaded,
+            'operations': args.operations,
+            'ops_per_sec': args.operations / elapsed,
+            'ops': summarize(latencies, elapsed)}
+
+
+def result_key(r):
+    return (r['workload'], r['mode'], r['commit_batch'], r['clients'], r['processes'])
+
+
+def compare(results, baseline_file, threshold):
+    """prints throughput and p99 changes against baseline_file, returns
+    False if any throughput dropped or p99 grew by more than threshold %"""
+    with open(baseline_file) as f:
+        baseline = dict((result_key(r), r) for r in json.load(f)['results'])
+
+    ok = True
+    print('{0:<28} {1:>12} {2:>9} {3:>12} {4:>9}'.format(
+        'run', 'ops/sec', 'change', 'worst p99', 'change'))
+    for r in results:
+        base = baseline.get(result_key(r))
+        name = '{0} mode={1} batch={2} clients={3}'.format(*result_key(r))
+        if base is None:
+            print('{0:<28} {1:>12.0f} {2:>9}'.format(name, r['ops_per_sec'], 'new'))
+            continue
+
+        tput = 100.0 * (r['ops_per_sec'] - base['ops_per_sec']) / base['ops_per_sec']
+        p99 = max(s['p99_us'] for s in r['ops'].values())
+        base_p99 = max(s['p99_us'] for s in base['ops'].values()) or 1e-9
+        p99_change = 100.0 * (p99 - base_p99) / base_p99
+        regressed = tput < -threshold or p99_change > threshold
+        ok = ok and not regressed
+
+        print('{0:<28} {1:>12.0f} {2:>+8.1f}% {3:>10.1f}us {4:>+8.1f}%{5}'.format(
+            name, r['ops_per_sec'], tput, p99, p99_change, '  REGRESSED' if regressed else ''))
+    return ok
+
+
+def print_result(r):
+    print('{0} mode={1} batch={2} clients={3}: load {4:.0f} ops/sec, run {5:.0f} ops/sec'.format(
+        r['workload'], r['mode'], r['commit_batch'], r['clients'],
+        r['load']['ops_per_sec'], r['ops_per_sec']))
+    for op, s in sorted(r['ops'].items()):
+        print('    {0:<7} {1:>8} ops  p50 {2:>9.1f}us  p99 {3:>9.1f}us  p999 {4:>9.1f}us'.format(
+            op, s['count'], s['p50_us'], s['p99_us'], s['p999_us']))
+
+
+def csv_list(value):
+    return [v for v in value.split(',') if v]
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(description='YCSB style heliumdb workloads')
+    parser.add_argument('--url', default='he://.//tmp/test-ycsb')
+    parser.add_argument('--workloads', type=lambda v: [w.upper() for w in csv_list(v)],
+                        default=sorted(WORKLOADS),
+                        help='comma separated subset of A-F')
+    parser.add_argument('--modes', type=csv_list, default=MODES,
+                        help='key_type/val_type modes, comma separated subset of O,i,s,b,f')
+    parser.add_argument('--distribution', choices=['zipfian', 'uniform', 'latest'],
+                        help='key distribution overriding the workload default')
+    parser.add_argument('--records', type=int, default=10000)
+    parser.add_argument('--operations', type=int, default=10000)
+    parser.add_argument('--value-size', type=int, default=100,
+                        help='bytes of s, b and O values')
+    parser.add_argument('--scan-length', type=int, default=100,
+                        help='maximum items read by a workload E scan')
+    parser.add_argument('--commit-batch', type=lambda v: [int(b) for b in csv_list(v)],
+                        default=[0, 1024],
+                        help='writes per commit, comma separated, 0 commits only at the end')
+    parser.add_argument('--clients', type=int, default=1, help='client threads')
+    parser.add_argument('--processes', type=int, default=0,
+                        help='client processes instead of threads')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--out', help='write results as json')
+    parser.add_argument('--compare', metavar='BASELINE',
+                        help='compare against a json file written by --out')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='percent change counted as a regression by --compare')
+    args = parser.parse_args(argv)
+
+    for w in args.workloads:
+        if w not in WORKLOADS:
+            parser.error('unknown workload {0}'.format(w))
+    for m in args.modes:
+        if m not in MODES:
+            parser.error('unknown mode {0}'.format(m))
+    if args.records <= 0 or args.clients <= 0 or args.processes < 0:
+        parser.error('records and clients must be positive')
+    if args.processes and args.url.startswith('mem://'):
+        parser.error('mem:// datastores are not shared between processes')
+    return args
+
+
+def main(argv):
+    args = parse_args(argv)
+    if args.distribution:
+        for w in args.workloads:
+            WORKLOADS[w] = (WORKLOADS[w][0], args.distribution)
+
+    created = setup_volume(args.url)
+
+    results = []
+    for workload in args.workloads:
+        for mode in args.modes:
+            if workload == 'E' and mode == 'O':
+                # pickled keys have no meaningful order to scan
+                continue
+            for batch in args.commit_batch:
+                r = run_workload(args, workload, mode, batch)
+                print_result(r)
+                results.append(r)
+
+    if created and os.path.exists(created):
+        os.remove(created)
+
+    if args.out:
+        config = dict((k, v) for k, v in vars(args).items() if k not in ('out', 'compare'))
+        with open(args.out, 'w') as f:
+            json.dump({'config': config, 'results': results}, f, indent=2, sort_keys=True)
+
+    if args.compare and not compare(results, args.compare, args.threshold):
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,87 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestAggregate(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-aggregate')
+        self.url = "he://.//tmp/test-aggregate"
+
+    def open(self, datastore, key_type, val_type):
+        return Heliumdb(url=self.url,
+                        datastore=datastore,
+                        key_type=key_type,
+                        val_type=val_type,
+                        flags=HE_O_CREATE | HE_O_VOLUME_CREATE)
+
+    def tearDown(self):
+        self.open('ints', 'I', 'i').cleanup()
+        self.open('floats', 's', 'f').cleanup()
+        if os.path.exists('/tmp/test-aggregate'):
+            os.remove('/tmp/test-aggregate')
+
+    def test_ints(self):
+        hdb = self.open('ints', 'I', 'i')
+        values = [i * 7 - 3000 for i in range(500)]
+        hdb.put_many(list(enumerate(values)))
+
+        for threads in (1, 4):
+            self.assertEqual(hdb.aggregate('count', threads=threads), 500)
+            self.assertEqual(hdb.aggregate('sum', threads=threads), sum(values))
+            self.assertEqual(hdb.aggregate('min', threads=threads), min(values))
+            self.assertEqual(hdb.aggregate('max', threads=threads), max(values))
+            self.assertAlmostEqual(hdb.aggregate('mean', threads=threads),
+                                   sum(values) / len(values))
+
+        self.assertEqual(hdb.aggregate('sum', range=(10, 20)), sum(values[10:20]))
+        self.assertEqual(hdb.aggregate('count', range=(None, 100), threads=3), 100)
+        self.assertEqual(hdb.aggregate('max', range=(490, None)), values[-1])
+
+    def test_overflow(self):
+        hdb = self.open('ints', 'I', 'i')
+        big = 2 ** 63 - 1
+        hdb.put_many([(i, big) for i in range(3000)])
+        hdb[3000] = -2 ** 63
+        self.assertEqual(hdb.aggregate('sum'), big * 3000 - 2 ** 63)
+
+    def test_floats(self):
+        hdb = self.open('floats', 's', 'f')
+        for i in range(100):
+            hdb['a%03d' % i] = i / 2.0
+        hdb['b'] = float('nan')
+
+        self.assertEqual(hdb.aggregate('sum', prefix='a'), sum(i / 2.0 for i in range(100)))
+        self.assertEqual(hdb.aggregate('min'), 0.0)
+        self.assertEqual(hdb.aggregate('max', threads=2), 49.5)
+        self.assertEqual(hdb.aggregate('count', prefix='b'), 1)
+        self.assertIsNone(hdb.aggregate('mean', prefix='c'))
+        self.assertIsNone(hdb.aggregate('min', prefix='b'))
+
+    def test_histogram(self):
+        hdb = self.open('floats', 's', 'f')
+        for i in range(100):
+            hdb['a%03d' % i] = float(i)
+
+        h = hdb.aggregate('histogram', bins=4)
+        self.assertEqual(h['edges'], [0.0, 24.75, 49.5, 74.25, 99.0])
+        self.assertEqual(h['counts'], [25, 25, 25, 25])
+
+        h = hdb.aggregate('histogram', bins=2, bounds=(0, 10), threads=4)
+        self.assertEqual(h['counts'], [5, 6])
+
+    def test_errors(self):
+        hdb = self.open('floats', 's', 'f')
+        with self.assertRaises(HeliumdbException):
+            hdb.aggregate('median')
+        with self.assertRaises(HeliumdbException):
+            hdb.aggregate('histogram', bins=0)
+        with self.assertRaises(HeliumdbException):
+            hdb.aggregate('sum', range=1)
+
+
+if __name__ == '__main__':
+    unittest.main()
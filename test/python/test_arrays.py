@@ -0,0 +1,58 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import array
+import os
+
+
+class TestArrays(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-arrays')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.url = "he://.//tmp/test-arrays"
+        self.hdb = Heliumdb(url=self.url,
+                            datastore='helium',
+                            key_type='i',
+                            val_type='f',
+                            flags=flags)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-arrays'):
+            os.remove('/tmp/test-arrays')
+
+    def test_int_float(self):
+        keys = array.array('q', range(1000))
+        vals = array.array('d', (i / 2.0 for i in range(1000)))
+
+        self.assertEqual(self.hdb.put_arrays(keys, vals), 1000)
+        self.assertEqual(self.hdb[10], 5.0)
+        self.assertEqual(self.hdb[999], 499.5)
+
+    def test_ordered_keys(self):
+        hdb = Heliumdb(url=self.url, datastore='ordered',
+                       key_type='I', val_type='f', flags=HE_O_CREATE)
+        hdb.put_arrays(array.array('q', [3, -1, 2]),
+                       array.array('d', [3.0, -1.0, 2.0]))
+
+        self.assertEqual(list(hdb.items()), [(-1, -1.0), (2, 2.0), (3, 3.0)])
+        hdb.cleanup()
+
+    def test_bytes_matrix(self):
+        hdb = Heliumdb(url=self.url, datastore='bytes',
+                       key_type='b', val_type='b', flags=HE_O_CREATE)
+        keys = memoryview(b'aaaabbbbcccc').cast('B', (3, 4))
+        vals = memoryview(b'112233').cast('B', (3, 2))
+        hdb.put_arrays(keys, vals)
+
+        self.assertEqual(hdb[b'bbbb'], b'22')
+        hdb.cleanup()
+
+    def test_invalid(self):
+        with self.assertRaises(HeliumdbException):
+            self.hdb.put_arrays(array.array('i', [1]), array.array('d', [1.0]))
+
+        with self.assertRaises(HeliumdbException):
+            self.hdb.put_arrays(array.array('q', [1, 2]), array.array('d', [1.0]))
@@ -0,0 +1,51 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import asyncio
+import os
+
+
+class TestAsync(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-async')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.url = "he://.//tmp/test-async"
+        self.hdb = Heliumdb(url=self.url,
+                            datastore='helium',
+                            key_type='i',
+                            val_type='O',
+                            flags=flags)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-async'):
+            os.remove('/tmp/test-async')
+
+    def test_put_get_delete(self):
+        async def run():
+            await asyncio.gather(*(self.hdb.aput(i, [i]) for i in range(200)))
+            values = await asyncio.gather(*(self.hdb.aget(i) for i in range(200)))
+            self.assertEqual(values, [[i] for i in range(200)])
+
+            await self.hdb.adelete(5)
+            self.assertEqual(await self.hdb.aget(5, 'missing'), 'missing')
+            with self.assertRaises(HeliumdbException):
+                await self.hdb.aget(5)
+
+        asyncio.run(run())
+        self.assertEqual(len(self.hdb), 199)
+
+    def test_get_many(self):
+        self.hdb.update({1: 'a', 2: 'b'})
+
+        async def run():
+            return await self.hdb.aget_many([2, 3, 1], default='-')
+
+        self.assertEqual(asyncio.run(run()), ['b', '-', 'a'])
+        # a second loop gets its own completion channel
+        self.assertEqual(asyncio.run(run()), ['b', '-', 'a'])
+
+    def test_no_loop(self):
+        self.assertRaises(RuntimeError, self.hdb.aget, 1)
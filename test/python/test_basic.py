@@ -51,3 +51,28 @@ class TestBasic(unittest.TestCase):
         self.hdb['345'] = 'c'
         keys = Heliumdb.keys(self.hdb)
         self.assertEqual(keys, [1, 2, '345'])
+
+    def test_pop_default(self):
+        self.assertEqual(self.hdb.pop('missing', 'd'), 'd')
+
+    def test_large_values(self):
+        v = 'x' * 100000
+        self.hdb['big'] = v
+        self.assertEqual(self.hdb['big'], v)
+        self.assertEqual(self.hdb['big'], v)
+
+        stats = self.hdb.stats()
+        self.assertEqual(stats['arena_retries'], 1)
+        self.assertGreaterEqual(stats['arena_size_class'], len(v))
+
+        self.assertEqual(self.hdb.pop('big'), v)
+        self.assertEqual(self.hdb.get('big', None), None)
+        # the learned size class fits, so the pop needed no retry
+        self.assertEqual(self.hdb.stats()['arena_retries'], 1)
+
+        # a value larger than the size class is sized before it is deleted
+        bigger = 'y' * 300000
+        self.hdb['bigger'] = bigger
+        self.assertEqual(self.hdb.pop('bigger'), bigger)
+        self.assertFalse('bigger' in self.hdb)
+        self.assertEqual(self.hdb.stats()['arena_retries'], 2)
@@ -0,0 +1,95 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestBatch(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-batch')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.hdb = Heliumdb(url="he://.//tmp/test-batch",
+                            datastore='helium',
+                            key_type='i',
+                            val_type='i',
+                            flags=flags)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-batch'):
+            os.remove('/tmp/test-batch')
+
+    def test_put_many(self):
+        errors = self.hdb.put_many((i, i * 2) for i in range(100))
+        self.assertEqual(errors, [])
+
+        for i in range(100):
+            self.assertEqual(self.hdb[i], i * 2)
+
+    def test_put_many_errors(self):
+        errors = self.hdb.put_many([(1, 10), ('x', 20), (3, 'y'), (4, 40)])
+        self.assertEqual([k for k, _ in errors], ['x', 3])
+
+        self.assertEqual(self.hdb[1], 10)
+        self.assertEqual(self.hdb[4], 40)
+        self.assertEqual(self.hdb.get(3, None), None)
+
+    def test_update(self):
+        self.hdb.update({1: 163, 2: 164})
+        self.hdb.update([(3, 165)])
+
+        self.assertEqual(self.hdb[1], 163)
+        self.assertEqual(self.hdb[2], 164)
+        self.assertEqual(self.hdb[3], 165)
+
+    def test_update_errors(self):
+        with self.assertRaises(HeliumdbException):
+            self.hdb.update({1: 163, 2: 'x'})
+
+        self.assertEqual(self.hdb[1], 163)
+
+    def test_get_many(self):
+        self.hdb.put_many((i, i * 2) for i in range(0, 1000, 2))
+
+        res = self.hdb.get_many(range(1000))
+        self.assertEqual(len(res), 1000)
+        for i, v in enumerate(res):
+            self.assertEqual(v, i * 2 if i % 2 == 0 else None)
+
+        self.assertEqual(self.hdb.get_many([1, 2], default=-1), [-1, 4])
+
+    def test_get_many_errors(self):
+        pulled = []
+
+        def keys():
+            for k in [1, 'x', 2]:
+                pulled.append(k)
+                yield k
+
+        # stops at the key that cannot be serialized, before any lookup
+        self.assertRaises(HeliumdbException, self.hdb.get_many, keys())
+        self.assertEqual(pulled, [1, 'x'])
+
+    def test_execute(self):
+        self.hdb[1] = 10
+
+        res = self.hdb.execute([('get', 1),
+                                ('put', 1, 11),
+                                ('get', 1),
+                                ('exists', 2),
+                                ('put', 2, 20),
+                                ('del', 1),
+                                ('exists', 1),
+                                ('get', 2)])
+        self.assertEqual(res, [10, True, 11, False, True, 11, False, 20])
+
+    def test_execute_invalid(self):
+        with self.assertRaises(ValueError):
+            self.hdb.execute([('put', 1)])
+
+        with self.assertRaises(HeliumdbException):
+            self.hdb.execute([('put', 1, 1), ('get', 'x')])
+
+        self.assertEqual(self.hdb.get(1, None), None)
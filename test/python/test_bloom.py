@@ -0,0 +1,105 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestBloom(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-bloom')
+        self.url = "he://.//tmp/test-bloom"
+        self.sidecar = '/tmp/test-bloom.filter'
+        self.hdb = self.open(bloom_filter=1000)
+
+    def open(self, **kwargs):
+        return Heliumdb(url=self.url,
+                        datastore='helium',
+                        key_type='i',
+                        val_type='i',
+                        flags=HE_O_CREATE | HE_O_VOLUME_CREATE,
+                        **kwargs)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-bloom'):
+            os.remove('/tmp/test-bloom')
+        if os.path.exists(self.sidecar):
+            os.remove(self.sidecar)
+
+    def test_lookups(self):
+        for i in range(100):
+            self.hdb[i] = i * 2
+
+        for i in range(100):
+            self.assertEqual(self.hdb[i], i * 2)
+            self.assertTrue(i in self.hdb)
+
+        for i in range(1000, 2000):
+            self.assertIsNone(self.hdb.get(i, None))
+            self.assertFalse(i in self.hdb)
+        self.assertEqual(self.hdb.pop(1000, 'x'), 'x')
+
+        stats = self.hdb.stats()
+        self.assertEqual(stats['bloom_maybe'] - stats['bloom_false_positives'], 200)
+        self.assertGreater(stats['bloom_avoided'], 1900)
+        self.assertEqual(stats['bloom_avoided'] + stats['bloom_false_positives'], 2001)
+
+    def test_bulk_writes(self):
+        self.hdb.put_many([(i, i) for i in range(50)])
+        self.assertEqual(self.hdb.get_many(list(range(60))),
+                         list(range(50)) + [None] * 10)
+
+    def test_existing_keys(self):
+        self.hdb[7] = 70
+        other = self.open(bloom_filter=10)
+        self.assertEqual(other[7], 70)
+        self.assertEqual(other.stats()['bloom_loaded'], 0)
+
+    def test_cleanup(self):
+        self.hdb[1] = 1
+        self.hdb.cleanup()
+        self.assertFalse(1 in self.hdb)
+        self.assertEqual(self.hdb.stats()['bloom_avoided'], 1)
+
+    def test_sidecar(self):
+        store = self.open(bloom_filter=100, bloom_file=self.sidecar)
+        store[1] = 10
+        store[2] = 20
+        del store
+        self.assertTrue(os.path.exists(self.sidecar))
+
+        store = self.open(bloom_filter=100, bloom_file=self.sidecar)
+        self.assertEqual(store.stats()['bloom_loaded'], 1)
+        self.assertEqual(store[2], 20)
+        self.assertFalse(3 in store)
+
+        # a sidecar saved for another item count is rebuilt from the store
+        store[3] = 30
+        other = self.open(bloom_filter=100, bloom_file=self.sidecar)
+        self.assertEqual(other.stats()['bloom_loaded'], 0)
+        self.assertEqual(other[3], 30)
+        del store
+
+    def test_sidecar_other_writer(self):
+        store = self.open(bloom_filter=100, bloom_file=self.sidecar)
+        store[1] = 10
+        store[2] = 20
+        del store
+
+        # same item count, but the saved filter has never seen key 3
+        other = self.open()
+        del other[1]
+        other[3] = 30
+        del other
+
+        store = self.open(bloom_filter=100, bloom_file=self.sidecar)
+        self.assertEqual(store.stats()['bloom_loaded'], 0)
+        self.assertTrue(3 in store)
+        self.assertEqual(store[3], 30)
+        del store
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,42 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestBytes(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-bytes')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.hdb = Heliumdb(url="he://.//tmp/test-bytes",
+                            datastore='helium',
+                            key_type='b',
+                            val_type='b',
+                            flags=flags)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-bytes'):
+            os.remove('/tmp/test-bytes')
+
+    def test_buffer_protocol(self):
+        self.hdb[bytearray(b'k1')] = memoryview(b'v1')
+        self.hdb[memoryview(b'k2')] = bytearray(b'v2')
+
+        self.assertEqual(self.hdb[b'k1'], b'v1')
+        self.assertEqual(self.hdb[b'k2'], b'v2')
+
+    def test_get_view(self):
+        blob = bytes(range(256)) * 1024
+        self.hdb[b'blob'] = blob
+
+        view = self.hdb.get_view(b'blob')
+        self.assertTrue(view.readonly)
+        self.assertEqual(view.tobytes(), blob)
+        view.release()
+
+        self.assertEqual(self.hdb.get_view(b'missing', None), None)
+        with self.assertRaises(HeliumdbException):
+            self.hdb.get_view(b'missing')
@@ -0,0 +1,63 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestChunkedIter(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-chunked-iter')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.hdb = Heliumdb(url="he://.//tmp/test-chunked-iter",
+                            datastore='helium',
+                            key_type='I',
+                            val_type='i',
+                            flags=flags)
+        self.hdb.put_many([(i, i * 3) for i in range(1000)])
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-chunked-iter'):
+            os.remove('/tmp/test-chunked-iter')
+
+    def test_chunks(self):
+        expected = [(i, i * 3) for i in range(1000)]
+        for chunk in (1, 7, 1000, 4096):
+            self.assertEqual(list(self.hdb.items(chunk=chunk)), expected)
+            self.assertEqual(list(self.hdb.iterkeys(chunk=chunk)), list(range(1000)))
+            self.assertEqual(list(self.hdb.values(chunk=chunk)),
+                             [v for _, v in expected])
+
+    def test_prefetch(self):
+        expected = [(i, i * 3) for i in range(1000)]
+        self.assertEqual(list(self.hdb.items(chunk=64, prefetch=True)), expected)
+        self.assertEqual(list(self.hdb.items(prefetch=True)), expected)
+
+        # abandoning a prefetching iterator stops its reader
+        itr = self.hdb.items(chunk=16, prefetch=True)
+        self.assertEqual(next(itr), (0, 0))
+        del itr
+
+    def test_range(self):
+        self.assertEqual(list(self.hdb.range(10, 20, chunk=3, prefetch=True)),
+                         [(i, i * 3) for i in range(10, 20)])
+        self.assertEqual([k for k, _ in self.hdb.range(990, reverse=True, chunk=4)],
+                         list(range(999, 989, -1)))
+
+    def test_seek(self):
+        itr = self.hdb.range(chunk=50, prefetch=True)
+        self.assertEqual(next(itr), (0, 0))
+        itr.seek(500)
+        self.assertEqual(next(itr), (500, 1500))
+        itr.seek(5)
+        self.assertEqual([k for k, _ in itr][:3], [5, 6, 7])
+
+    def test_bad_chunk(self):
+        with self.assertRaises(HeliumdbException):
+            self.hdb.items(chunk=0)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,48 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestCopy(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-copy')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.url = "he://.//tmp/test-copy"
+        self.src = Heliumdb(url=self.url, datastore='src',
+                            key_type='s', val_type='O', flags=flags)
+        self.dst = Heliumdb(url=self.url, datastore='dst',
+                            key_type='s', val_type='O', flags=flags)
+
+    def tearDown(self):
+        self.src.cleanup()
+        self.dst.cleanup()
+        if os.path.exists('/tmp/test-copy'):
+            os.remove('/tmp/test-copy')
+
+    def test_copy_all(self):
+        data = {'%s%d' % (p, i): [i, {p}] for p in 'abcxyz' for i in range(50)}
+        data[''] = 'empty'
+        self.src.update(data)
+
+        report = self.src.copy_to(self.dst, threads=4, commit_every=10)
+        self.assertEqual(report['records'], len(data))
+        self.assertEqual(report['errors'], 0)
+        self.assertEqual(dict(self.dst.items()), data)
+
+    def test_copy_prefix(self):
+        self.src.update({'user:1': 1, 'user:2': 2, 'item:1': 3, 'user': 4})
+
+        report = self.src.copy_to(self.dst, filter_prefix='user:', threads=8)
+        self.assertEqual(report['records'], 2)
+        self.assertEqual(dict(self.dst.items()), {'user:1': 1, 'user:2': 2})
+
+    def test_mismatched_types(self):
+        other = Heliumdb(url=self.url, datastore='other',
+                         key_type='i', val_type='O', flags=HE_O_CREATE)
+        self.assertRaises(HeliumdbException, self.src.copy_to, other)
+        self.assertRaises(HeliumdbException, self.src.copy_to, self.src)
+        self.assertRaises(TypeError, self.src.copy_to, {})
+        other.cleanup()
@@ -0,0 +1,107 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import json
+import os
+
+
+class TestIo(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-io')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.url = "he://.//tmp/test-io"
+        self.path = '/tmp/test-io.data'
+        self.hdb = Heliumdb(url=self.url,
+                            datastore='helium',
+                            key_type='s',
+                            val_type='N',
+                            flags=flags)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        for path in ('/tmp/test-io', self.path):
+            if os.path.exists(path):
+                os.remove(path)
+
+    def write(self, text):
+        with open(self.path, 'w') as f:
+            f.write(text)
+
+    def test_ndjson_roundtrip(self):
+        docs = {'a': {'x': 1, 'y': [1.5, None, True]}, 'b': 'text "quoted"',
+                'c': -2 ** 70}
+        self.write(''.join(json.dumps({'key': k, 'value': v}) + '\n'
+                           for k, v in docs.items()) + 'not json\n')
+
+        report = self.hdb.import_file(self.path, threads=3, commit_every=2)
+        self.assertEqual(report['records'], 3)
+        self.assertEqual(report['errors'], 1)
+        self.assertTrue(report['first_error'].startswith('record 4'))
+        self.assertEqual(dict(self.hdb.items()), docs)
+
+        self.hdb.export_file(self.path)
+        with open(self.path) as f:
+            lines = [json.loads(line) for line in f]
+        self.assertEqual({d['key']: d['value'] for d in lines}, docs)
+
+    def test_ndjson_big_ints(self):
+        docs = {'a': 2 ** 63, 'b': -2 ** 63 - 1, 'c': 3 ** 50,
+                'd': [-(2 ** 64), 255, 2 ** 64 - 1], 'e': 1e300, 'f': -0.5}
+        self.write(''.join(json.dumps({'key': k, 'value': v}) + '\n'
+                           for k, v in docs.items()))
+
+        report = self.hdb.import_file(self.path)
+        self.assertEqual(report['records'], 6)
+        items = dict(self.hdb.items())
+        self.assertEqual(items, docs)
+        self.assertEqual(type(items['c']), int)
+        self.assertEqual(type(items['e']), float)
+
+        self.hdb.export_file(self.path)
+        with open(self.path) as f:
+            lines = [json.loads(line) for line in f]
+        self.assertEqual({d['key']: d['value'] for d in lines}, docs)
+
+    def test_csv_typed(self):
+        hdb = Heliumdb(url=self.url, datastore='csv',
+                       key_type='I', val_type='f', flags=HE_O_CREATE)
+        self.write('id,name,score\n3,"c, d",1.5\n-1,a,2\n2,b,0.1\n')
+
+        report = hdb.import_file(self.path, format='csv', key_field='id',
+                                 value_field='score')
+        self.assertEqual(report['records'], 3)
+        self.assertEqual(list(hdb.items()), [(-1, 2.0), (2, 0.1), (3, 1.5)])
+
+        hdb.export_file(self.path, format='csv', key_field='id',
+                        value_field='score')
+        with open(self.path) as f:
+            self.assertEqual(f.read(), 'id,score\n-1,2.0\n2,0.1\n3,1.5\n')
+        hdb.cleanup()
+
+    def test_binary_pickle(self):
+        hdb = Heliumdb(url=self.url, datastore='binary', flags=HE_O_CREATE)
+        hdb[(1, 2)] = {'set': {1, 2}}
+        hdb['x'] = None
+
+        report = hdb.export_file(self.path, format='binary')
+        self.assertEqual(report['records'], 2)
+        hdb.cleanup()
+
+        hdb.import_file(self.path, format='binary', threads=1)
+        self.assertEqual(hdb[(1, 2)], {'set': {1, 2}})
+        self.assertIsNone(hdb['x'])
+
+        self.assertRaises(HeliumdbException, hdb.export_file, self.path)
+        hdb.cleanup()
+
+    def test_progress_cancel(self):
+        self.write(''.join('{"key": "k%d", "value": %d}\n' % (i, i)
+                           for i in range(20000)))
+
+        def stop(records, nbytes):
+            raise KeyboardInterrupt
+
+        self.assertRaises(KeyboardInterrupt, self.hdb.import_file, self.path,
+                          progress=stop, progress_interval=0.000001, batch=1)
@@ -0,0 +1,103 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_TRUNCATE
+import unittest
+
+
+class TestMemBackend(unittest.TestCase):
+    def open(self, datastore='scratch', key_type='s', val_type='O', flags=HE_O_CREATE, **kwargs):
+        return Heliumdb(url='mem://test',
+                        datastore=datastore,
+                        key_type=key_type,
+                        val_type=val_type,
+                        flags=flags,
+                        **kwargs)
+
+    def test_dict_api(self):
+        hdb = self.open()
+        for i in range(20):
+            hdb['k%02d' % i] = {'n': i}
+        del hdb['k05']
+
+        self.assertEqual(len(hdb), 19)
+        self.assertEqual(hdb['k03'], {'n': 3})
+        self.assertEqual(hdb.get('k05', None), None)
+        self.assertTrue('k04' in hdb)
+        self.assertFalse('k05' in hdb)
+        self.assertRaises(HeliumdbException, hdb.__getitem__, 'k05')
+        self.assertEqual(hdb.pop('k19'), {'n': 19})
+
+        keys = ['k%02d' % i for i in range(19) if i != 5]
+        self.assertEqual(hdb.keys(), keys)
+        self.assertEqual([k for k, _ in hdb.items()], keys)
+        self.assertEqual([k for k, _ in hdb.range('k10', 'k13')], ['k10', 'k11', 'k12'])
+        self.assertEqual([k for k, _ in hdb.range(reverse=True)], keys[::-1])
+        self.assertEqual(hdb.count_prefix('k1'), 9)
+
+        stats = hdb.stats()
+        self.assertEqual(stats['valid_items'], 18)
+        self.assertTrue(stats['utilized'] > 0)
+
+        hdb.commit()
+        hdb.cleanup()
+        self.assertEqual(len(hdb), 0)
+        self.assertEqual(hdb.stats()['utilized'], 0)
+
+    def test_shared_until_closed(self):
+        a = self.open()
+        b = self.open(flags=0)
+        other = self.open(datastore='other')
+
+        a['x'] = 1
+        self.assertEqual(b['x'], 1)
+        self.assertFalse('x' in other)
+
+        c = self.open(flags=HE_O_CREATE | HE_O_TRUNCATE)
+        self.assertEqual(len(a), 0)
+
+        # the store goes away with its last handle
+        del a, b, c
+        self.assertRaises(HeliumdbException, self.open, flags=0)
+        other.cleanup()
+
+    def test_typed_and_parallel(self):
+        hdb = self.open(datastore='ints', key_type='I', val_type='i')
+        hdb.put_many((i, i * 2) for i in range(500))
+
+        self.assertEqual(hdb.aggregate('sum', threads=4), sum(i * 2 for i in range(500)))
+        self.assertEqual(hdb.parallel_scan(threads=4), [(i, i * 2) for i in range(500)])
+        self.assertEqual([k for k, v in hdb.scan_where('>=', 990)], [495, 496, 497, 498, 499])
+
+        dst = self.open(datastore='ints-copy', key_type='I', val_type='i')
+        report = hdb.copy_to(dst, threads=4)
+        self.assertEqual(report['records'], 500)
+        self.assertEqual(dst[250], 500)
+        hdb.cleanup()
+        dst.cleanup()
+
+    def test_pop_large(self):
+        hdb = self.open(datastore='large', val_type='s')
+        v = 'x' * 200000
+        hdb['big'] = v
+        self.assertEqual(hdb.pop('big'), v)
+        self.assertFalse('big' in hdb)
+        self.assertEqual(hdb.stats()['utilized'], 0)
+
+        with hdb.transaction() as txn:
+            hdb['big'] = v + 'y'
+            self.assertEqual(txn.pop('big'), v + 'y')
+        self.assertFalse('big' in hdb)
+
+    def test_write_buffer(self):
+        hdb = self.open(datastore='buffered', key_type='i', val_type='s', write_buffer=64)
+        for i in range(100):
+            hdb[i] = str(i)
+        hdb.flush()
+        self.assertEqual(len(hdb), 100)
+        self.assertEqual(hdb[42], '42')
+        hdb.cleanup()
+
+
+if __name__ == '__main__':
+    unittest.main()
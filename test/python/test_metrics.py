@@ -0,0 +1,75 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestMetrics(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-metrics')
+        self.url = "he://.//tmp/test-metrics"
+        self.hdb = Heliumdb(url=self.url,
+                            datastore='metrics',
+                            key_type='i',
+                            val_type='s',
+                            flags=HE_O_CREATE | HE_O_VOLUME_CREATE,
+                            metrics=True)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-metrics'):
+            os.remove('/tmp/test-metrics')
+
+    def test_phases(self):
+        for i in range(10):
+            self.hdb[i] = 'v%d' % i
+        for i in range(10):
+            self.assertEqual(self.hdb[i], 'v%d' % i)
+        self.assertTrue(3 in self.hdb)
+        self.assertEqual(list(self.hdb.items()), [(i, 'v%d' % i) for i in range(10)])
+        del self.hdb[0]
+        self.hdb.commit()
+
+        m = self.hdb.metrics()
+        self.assertEqual(m['put']['total']['count'], 10)
+        self.assertEqual(m['get']['total']['count'], 10)
+        self.assertEqual(m['exists']['total']['count'], 1)
+        self.assertEqual(m['delete']['total']['count'], 1)
+        self.assertEqual(m['commit']['total']['count'], 1)
+        # ten items and the end of iteration
+        self.assertEqual(m['iter_next']['total']['count'], 11)
+
+        get = m['get']
+        for phase in ('serialize', 'store', 'gil', 'deserialize', 'total'):
+            self.assertEqual(get[phase]['count'], 10)
+        total = get['total']
+        self.assertTrue(total['p50_ns'] <= total['p99_ns'] <= total['max_ns'])
+        self.assertTrue(0 < total['mean_ns'] <= total['max_ns'])
+
+    def test_prometheus(self):
+        self.hdb[1] = 'one'
+        self.hdb.get(1)
+        text = self.hdb.metrics_prometheus()
+        self.assertIn('# TYPE heliumdb_op_latency_seconds summary', text)
+        self.assertIn('heliumdb_op_latency_seconds_count{op="get",phase="total"} 1', text)
+        self.assertIn('heliumdb_op_latency_seconds{op="put",phase="total",quantile="0.99"}', text)
+
+    def test_reset(self):
+        self.hdb[1] = 'one'
+        self.hdb.reset_metrics()
+        self.assertEqual(self.hdb.metrics()['put'], {})
+        self.assertNotIn('op="put"', self.hdb.metrics_prometheus())
+
+    def test_disabled(self):
+        hdb = Heliumdb(url=self.url,
+                       datastore='metrics',
+                       key_type='i',
+                       val_type='s')
+        self.assertRaises(HeliumdbException, hdb.metrics)
+        self.assertRaises(HeliumdbException, hdb.metrics_prometheus)
+
+
+if __name__ == '__main__':
+    unittest.main()
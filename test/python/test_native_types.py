@@ -0,0 +1,89 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+import datetime
+
+
+class Shrinks(object):
+    """empties the list holding it when pickled"""
+    def __init__(self, owner):
+        self.owner = owner
+
+    def __reduce__(self):
+        del self.owner[:]
+        return (int, (0,))
+
+
+class TestNative(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-native')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.hdb = Heliumdb(url="he://.//tmp/test-native",
+                            datastore='helium',
+                            key_type='N',
+                            val_type='N',
+                            flags=flags)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-native'):
+            os.remove('/tmp/test-native')
+
+    def test_primitives(self):
+        values = [None, True, False, 0, -1, 2 ** 63, -(2 ** 100), 1.5,
+                  'str', u'été', b'\x00bytes']
+        for i, v in enumerate(values):
+            self.hdb[i] = v
+
+        for i, v in enumerate(values):
+            self.assertEqual(self.hdb[i], v)
+            self.assertEqual(type(self.hdb[i]), type(v))
+
+    def test_containers(self):
+        v = {'a': (1, 2.5, [None, b'x']), 'b': {'c': [True, 'd']}, 3: ()}
+        self.hdb[('k', 1)] = v
+        self.assertEqual(self.hdb[('k', 1)], v)
+
+    def test_pickle_fallback(self):
+        v = {'when': datetime.date(2019, 7, 26), 'set': {1, 2}}
+        self.hdb['x'] = v
+        self.assertEqual(self.hdb['x'], v)
+
+    def test_lone_surrogate(self):
+        v = ['ok', 'bad \udc80', {'k': '\ud800'}]
+        self.hdb['s'] = v
+        self.assertEqual(self.hdb['s'], v)
+
+    def test_iter_items(self):
+        exp = {1: 'a', 'two': [2]}
+        self.hdb.update(exp)
+
+        res = {}
+        for k, v in self.hdb.items():
+            res[k] = v
+        self.assertEqual(res, exp)
+
+    def test_deep_nesting(self):
+        v = []
+        for _ in range(100):
+            v = [v]
+        self.hdb['deep'] = v
+        self.assertEqual(self.hdb['deep'], v)
+
+        # corrupt data nesting far deeper than encode ever writes
+        raw = Heliumdb(url="he://.//tmp/test-native",
+                       datastore='helium',
+                       key_type='N',
+                       val_type='b')
+        raw['bad'] = b'\x09\x01' * 100000 + b'\x00'
+        self.assertRaises(HeliumdbException, self.hdb.__getitem__, 'bad')
+
+    def test_mutated_while_encoding(self):
+        v = [1, 2]
+        v.append(Shrinks(v))
+        v.append(3)
+        with self.assertRaises(HeliumdbException):
+            self.hdb['x'] = v
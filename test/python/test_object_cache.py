@@ -0,0 +1,62 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestObjectCache(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-object-cache')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.url = "he://.//tmp/test-object-cache"
+        self.hdb = Heliumdb(url=self.url,
+                            datastore='helium',
+                            key_type='s',
+                            val_type='O',
+                            object_cache=4096,
+                            flags=flags)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-object-cache'):
+            os.remove('/tmp/test-object-cache')
+
+    def test_hits(self):
+        self.hdb['a'] = {'x': 1}
+        first = self.hdb['a']
+        self.assertIs(self.hdb['a'], first)
+        self.assertIs(self.hdb.get('a'), first)
+
+        stats = self.hdb.stats()
+        self.assertEqual(stats['object_cache_hits'], 2)
+        self.assertEqual(stats['object_cache_misses'], 1)
+        self.assertEqual(stats['object_cache_items'], 1)
+
+    def test_invalidation(self):
+        self.hdb['a'] = 1
+        self.assertEqual(self.hdb['a'], 1)
+        self.hdb['a'] = 2
+        self.assertEqual(self.hdb['a'], 2)
+
+        self.assertEqual(self.hdb.pop('a'), 2)
+        self.assertIsNone(self.hdb.get('a', None))
+
+        self.hdb['b'] = 3
+        self.assertEqual(self.hdb['b'], 3)
+        self.hdb.update({'b': 4})
+        self.assertEqual(self.hdb['b'], 4)
+
+        self.hdb.cleanup()
+        self.assertEqual(self.hdb.stats()['object_cache_items'], 0)
+
+    def test_eviction(self):
+        for i in range(200):
+            self.hdb['k%d' % i] = 'v' * 100
+            self.hdb['k%d' % i]
+
+        stats = self.hdb.stats()
+        self.assertGreater(stats['object_cache_evictions'], 0)
+        self.assertLessEqual(stats['object_cache_bytes'], 4096)
+        self.assertEqual(self.hdb['k0'], 'v' * 100)
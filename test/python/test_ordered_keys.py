@@ -0,0 +1,77 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestOrdered(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-ordered')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.url = "he://.//tmp/test-ordered"
+        self.hdb = Heliumdb(url=self.url,
+                            datastore='helium',
+                            key_type='I',
+                            val_type='i',
+                            flags=flags)
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-ordered'):
+            os.remove('/tmp/test-ordered')
+
+    def test_int_order(self):
+        keys = [5, -3, 0, 2 ** 40, -(2 ** 40), 17]
+        for k in keys:
+            self.hdb[k] = k
+
+        self.assertEqual(list(self.hdb), sorted(keys))
+        self.assertEqual(self.hdb[-3], -3)
+
+    def test_float_order(self):
+        hdb = Heliumdb(url=self.url, datastore='floats',
+                       key_type='F', val_type='f', flags=HE_O_CREATE)
+        keys = [1.5, -0.25, 0.0, -1e10, 3e-5, float('inf'), float('-inf')]
+        for k in keys:
+            hdb[k] = k
+
+        self.assertEqual(list(hdb), sorted(keys))
+        hdb.cleanup()
+
+    def test_range(self):
+        for k in range(-10, 10):
+            self.hdb[k] = k * 2
+
+        self.assertEqual([k for k, _ in self.hdb.range(-2, 3)],
+                         [-2, -1, 0, 1, 2])
+        self.assertEqual([v for _, v in self.hdb.range(7)], [14, 16, 18])
+        self.assertEqual([k for k, _ in self.hdb.range(stop=-8)], [-10, -9])
+
+    def test_range_reverse(self):
+        for k in range(-10, 10):
+            self.hdb[k] = k * 2
+
+        self.assertEqual(list(self.hdb.range(-2, 3, reverse=True)),
+                         [(2, 4), (1, 2), (0, 0), (-1, -2), (-2, -4)])
+        self.assertEqual([k for k, _ in self.hdb.range(7, reverse=True)],
+                         [9, 8, 7])
+
+    def test_seek(self):
+        for k in range(0, 100, 10):
+            self.hdb[k] = k
+
+        itr = self.hdb.range()
+        itr.seek(35)
+        self.assertEqual(next(itr), (40, 40))
+
+        itr = self.hdb.range(reverse=True)
+        itr.seek(35)
+        self.assertEqual(next(itr), (30, 30))
+        itr.seek(70)
+        self.assertEqual(next(itr), (70, 70))
+
+        itr = iter(self.hdb)
+        itr.seek(90)
+        self.assertEqual(list(itr), [90])
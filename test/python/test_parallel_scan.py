@@ -0,0 +1,75 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+from array import array
+import unittest
+import os
+
+
+class TestParallelScan(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-parallel-scan')
+        self.url = "he://.//tmp/test-parallel-scan"
+
+    def open(self, datastore, key_type, val_type):
+        return Heliumdb(url=self.url,
+                        datastore=datastore,
+                        key_type=key_type,
+                        val_type=val_type,
+                        flags=HE_O_CREATE | HE_O_VOLUME_CREATE)
+
+    def tearDown(self):
+        self.open('ints', 'I', 'f').cleanup()
+        self.open('strs', 's', 'O').cleanup()
+        if os.path.exists('/tmp/test-parallel-scan'):
+            os.remove('/tmp/test-parallel-scan')
+
+    def test_list(self):
+        hdb = self.open('strs', 's', 'O')
+        expected = [('k%04d' % i, {'n': i}) for i in range(600)]
+        for k, v in expected:
+            hdb[k] = v
+
+        for threads in (1, 4):
+            self.assertEqual(hdb.parallel_scan(threads=threads, batch=7), expected)
+        self.assertEqual(hdb.parallel_scan(prefix='k01'), expected[100:200])
+        self.assertEqual(hdb.parallel_scan(prefix='x'), [])
+
+    def test_arrays(self):
+        hdb = self.open('ints', 'I', 'f')
+        hdb.put_many([(i - 300, i / 2.0) for i in range(600)])
+
+        keys, vals = hdb.parallel_scan(threads=4, out='arrays', batch=50)
+        self.assertEqual(keys, array('q', range(-300, 300)))
+        self.assertEqual(vals, array('d', [i / 2.0 for i in range(600)]))
+
+        strs = self.open('strs', 's', 'O')
+        strs['a'] = 1
+        self.assertEqual(strs.parallel_scan(out='arrays'), (['a'], [1]))
+
+    def test_callback(self):
+        hdb = self.open('ints', 'I', 'f')
+        hdb.put_many([(i, 1.0) for i in range(1000)])
+
+        batches = []
+        report = hdb.parallel_scan(threads=3, callback=batches.append, batch=100)
+        self.assertEqual(report['records'], 1000)
+        self.assertTrue(all(len(b) <= 100 for b in batches))
+        self.assertEqual(sorted(k for b in batches for k, _ in b), list(range(1000)))
+
+        def fail(batch):
+            raise ValueError('stop')
+        with self.assertRaises(ValueError):
+            hdb.parallel_scan(threads=3, callback=fail, batch=10)
+
+    def test_errors(self):
+        hdb = self.open('ints', 'I', 'f')
+        with self.assertRaises(HeliumdbException):
+            hdb.parallel_scan(out='dict')
+        with self.assertRaises(HeliumdbException):
+            hdb.parallel_scan(threads=0)
+
+
+if __name__ == '__main__':
+    unittest.main()
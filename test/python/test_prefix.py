@@ -0,0 +1,44 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestPrefix(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-prefix')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.hdb = Heliumdb(url="he://.//tmp/test-prefix",
+                            datastore='helium',
+                            key_type='s',
+                            val_type='s',
+                            flags=flags)
+        for k in ['user:1:a', 'user:1:b', 'user:12:a', 'user:2:a', 'users', 'a']:
+            self.hdb[k] = k.upper()
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-prefix'):
+            os.remove('/tmp/test-prefix')
+
+    def test_iter_prefix(self):
+        self.assertEqual(list(self.hdb.iter_prefix('user:1:')),
+                         ['user:1:a', 'user:1:b'])
+        self.assertEqual(list(self.hdb.iter_prefix('zzz')), [])
+
+    def test_items_prefix(self):
+        self.assertEqual(list(self.hdb.items_prefix('user:2')),
+                         [('user:2:a', 'USER:2:A')])
+
+    def test_count_prefix(self):
+        self.assertEqual(self.hdb.count_prefix('user:1'), 3)
+        self.assertEqual(self.hdb.count_prefix('user'), 5)
+        self.assertEqual(self.hdb.count_prefix(''), 6)
+
+    def test_prefix_key_type(self):
+        hdb = Heliumdb(url="he://.//tmp/test-prefix", datastore='ints',
+                       key_type='i', val_type='i', flags=HE_O_CREATE)
+        with self.assertRaises(HeliumdbException):
+            hdb.count_prefix(1)
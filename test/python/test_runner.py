@@ -2,6 +2,25 @@ import unittest
 import sys
 from test_basic import TestBasic
 from test_int_types import TestInt
+from test_batch import TestBatch
+from test_native_types import TestNative
+from test_ordered_keys import TestOrdered
+from test_prefix import TestPrefix
+from test_bytes_types import TestBytes
+from test_arrays import TestArrays
+from test_io import TestIo
+from test_copy import TestCopy
+from test_async import TestAsync
+from test_write_buffer import TestWriteBuffer
+from test_object_cache import TestObjectCache
+from test_bloom import TestBloom
+from test_chunked_iter import TestChunkedIter
+from test_scan_where import TestScanWhere
+from test_aggregate import TestAggregate
+from test_parallel_scan import TestParallelScan
+from test_metrics import TestMetrics
+from test_mem_backend import TestMemBackend
+from test_transaction import TestTransaction
 
 if len(sys.argv) > 1:
     sys.path.insert(0, sys.argv[1])
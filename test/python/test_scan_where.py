@@ -0,0 +1,76 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+
+
+class TestScanWhere(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-scan-where')
+        self.url = "he://.//tmp/test-scan-where"
+
+    def open(self, datastore, val_type):
+        return Heliumdb(url=self.url,
+                        datastore=datastore,
+                        key_type='I',
+                        val_type=val_type,
+                        flags=HE_O_CREATE | HE_O_VOLUME_CREATE)
+
+    def tearDown(self):
+        for name, val_type in (('ints', 'i'), ('floats', 'f'), ('strs', 's')):
+            self.open(name, val_type).cleanup()
+        if os.path.exists('/tmp/test-scan-where'):
+            os.remove('/tmp/test-scan-where')
+
+    def test_ints(self):
+        hdb = self.open('ints', 'i')
+        hdb.put_many([(i, i - 50) for i in range(100)])
+
+        self.assertEqual(list(hdb.scan_where('<', -48)), [(0, -50), (1, -49)])
+        self.assertEqual(list(hdb.scan_where('>=', 48, keys_only=True)), [98, 99])
+        self.assertEqual(list(hdb.scan_where('==', 0, keys_only=True)), [50])
+        self.assertEqual(len(list(hdb.scan_where('!=', 0))), 99)
+        self.assertEqual(list(hdb.scan_where('between', (10, 12), keys_only=True, chunk=2)),
+                         [60, 61, 62])
+
+    def test_floats(self):
+        hdb = self.open('floats', 'f')
+        hdb.put_many([(i, i / 4.0) for i in range(20)])
+        hdb[20] = float('nan')
+
+        self.assertEqual(list(hdb.scan_where('>', 4.5, keys_only=True)), [19])
+        self.assertEqual(list(hdb.scan_where('<=', 0, keys_only=True)), [0])
+        self.assertEqual(list(hdb.scan_where('between', (1, 1.5), keys_only=True)),
+                         [4, 5, 6])
+        self.assertIn(20, list(hdb.scan_where('!=', 1.0, keys_only=True)))
+
+    def test_strings(self):
+        hdb = self.open('strs', 's')
+        hdb[1] = 'stale:alpha'
+        hdb[2] = 'fresh:beta'
+        hdb[3] = 'stale:gamma'
+        hdb[4] = 'café'
+
+        self.assertEqual(list(hdb.scan_where('prefix', 'stale:', keys_only=True)), [1, 3])
+        self.assertEqual(list(hdb.scan_where('contains', 'bet')), [(2, 'fresh:beta')])
+        self.assertEqual(list(hdb.scan_where('contains', 'é', keys_only=True)), [4])
+        self.assertEqual(list(hdb.scan_where('<', 'g', keys_only=True)), [2, 4])
+        self.assertEqual(list(hdb.scan_where('between', ('fresh', 'stale:b'),
+                                             keys_only=True, prefetch=True)), [1, 2])
+
+    def test_errors(self):
+        ints = self.open('ints', 'i')
+        with self.assertRaises(HeliumdbException):
+            ints.scan_where('prefix', 'a')
+        with self.assertRaises(HeliumdbException):
+            ints.scan_where('<', 'a')
+        with self.assertRaises(HeliumdbException):
+            ints.scan_where('between', 1)
+        with self.assertRaises(HeliumdbException):
+            ints.scan_where('~', 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,194 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_TRUNCATE
+import os
+import unittest
+
+
+class TestTransaction(unittest.TestCase):
+    def setUp(self):
+        self.hdb = Heliumdb(url='mem://txn',
+                            datastore='test_txn',
+                            key_type='s',
+                            val_type='O',
+                            flags=HE_O_CREATE | HE_O_TRUNCATE)
+        for i in range(10):
+            self.hdb['k%02d' % i] = i
+
+    def test_commit_on_exit(self):
+        with self.hdb.transaction() as txn:
+            txn['k03'] = 'three'
+            txn['new'] = 1
+            del txn['k04']
+
+            # staged writes are seen through the transaction only
+            self.assertEqual(txn['k03'], 'three')
+            self.assertTrue('new' in txn)
+            self.assertFalse('k04' in txn)
+            self.assertEqual(len(txn), 10)
+            self.assertEqual(self.hdb['k03'], 3)
+            self.assertFalse('new' in self.hdb)
+            self.assertTrue('k04' in self.hdb)
+
+        self.assertEqual(self.hdb['k03'], 'three')
+        self.assertEqual(self.hdb['new'], 1)
+        self.assertFalse('k04' in self.hdb)
+        self.assertEqual(len(self.hdb), 10)
+
+    def test_discard_on_error(self):
+        def fail():
+            with self.hdb.transaction() as txn:
+                txn['k01'] = 'one'
+                txn['new'] = 1
+                raise ValueError('abort')
+
+        self.assertRaises(ValueError, fail)
+        self.assertEqual(self.hdb['k01'], 1)
+        self.assertFalse('new' in self.hdb)
+
+    def test_explicit_end(self):
+        txn = self.hdb.transaction()
+        txn['a'] = 1
+        txn.discard()
+        self.assertFalse('a' in self.hdb)
+
+        txn = self.hdb.transaction()
+        txn['a'] = 2
+        txn.commit()
+        self.assertEqual(self.hdb['a'], 2)
+
+        # single use once ended
+        self.assertRaises(HeliumdbException, txn.__getitem__, 'a')
+        self.assertRaises(HeliumdbException, txn.__setitem__, 'b', 1)
+        self.assertRaises(HeliumdbException, txn.commit)
+        self.assertRaises(HeliumdbException, txn.discard)
+        self.assertRaises(HeliumdbException, txn.stats)
+        self.assertRaises(HeliumdbException, self.hdb.discard)
+
+    def test_no_nesting(self):
+        with self.hdb.transaction() as txn:
+            self.assertRaises(HeliumdbException, txn.transaction)
+
+    def test_merged_iteration(self):
+        with self.hdb.transaction() as txn:
+            txn['k015'] = 'staged'
+            txn['k05'] = 'updated'
+            del txn['k00']
+            del txn['k09']
+            txn['z'] = 'last'
+
+            keys = ['k01', 'k015', 'k02', 'k03', 'k04', 'k05', 'k06', 'k07', 'k08', 'z']
+            self.assertEqual(txn.keys(), keys)
+            self.assertEqual([k for k, _ in txn.range(reverse=True)], keys[::-1])
+            self.assertEqual(dict(txn.range('k01', 'k03')), {'k01': 1, 'k015': 'staged', 'k02': 2})
+            self.assertEqual(txn.count_prefix('k0'), 9)
+            self.assertEqual(txn.stats()['valid_items'], 10)
+
+            txn.cleanup()
+            self.assertEqual(len(txn), 0)
+            self.assertEqual(len(self.hdb), 10)
+
+        self.assertEqual(len(self.hdb), 0)
+
+    def test_cleanup_then_discard(self):
+        hdb = Heliumdb(url='mem://txn',
+                       datastore='test_txn_bloom',
+                       key_type='s',
+                       val_type='i',
+                       flags=HE_O_CREATE | HE_O_TRUNCATE,
+                       bloom_filter=100)
+        for i in range(10):
+            hdb[str(i)] = i
+
+        txn = hdb.transaction()
+        txn.cleanup()
+        self.assertFalse('3' in txn)
+        txn.discard()
+
+        # the shared bloom filter still knows the parent's keys
+        self.assertEqual(len(hdb), 10)
+        self.assertEqual(hdb.get('3'), 3)
+        self.assertTrue('3' in hdb)
+
+        with hdb.transaction() as txn:
+            txn.cleanup()
+            txn['new'] = 1
+        self.assertEqual(len(hdb), 1)
+        self.assertEqual(hdb['new'], 1)
+
+    def test_batched_writes(self):
+        with self.hdb.transaction() as txn:
+            txn.put_many([('b%04d' % i, i) for i in range(500)])
+            self.assertEqual(txn['b0499'], 499)
+            self.assertFalse('b0499' in self.hdb)
+
+        self.assertEqual(len(self.hdb), 510)
+        self.assertEqual(self.hdb.get_many(['b0000', 'b0250']), [0, 250])
+
+    def test_copy_and_import_into(self):
+        src = Heliumdb(url='mem://txn',
+                       datastore='test_txn_src',
+                       key_type='s',
+                       val_type='O',
+                       flags=HE_O_CREATE | HE_O_TRUNCATE)
+        src.put_many(('c%04d' % i, i) for i in range(1000))
+        path = '/tmp/test-txn.data'
+        extra = Heliumdb(url='mem://txn',
+                         datastore='test_txn_extra',
+                         key_type='s',
+                         val_type='O',
+                         flags=HE_O_CREATE | HE_O_TRUNCATE)
+        extra.put_many(('i%03d' % i, i) for i in range(100))
+        extra.export_file(path, format='binary')
+
+        try:
+            # periodic commits would publish part of the transaction
+            txn = self.hdb.transaction()
+            src.copy_to(txn, commit_every=10)
+            txn.import_file(path, format='binary', threads=2, commit_every=10)
+            self.assertEqual(len(txn), 1110)
+            txn.discard()
+            self.assertEqual(len(self.hdb), 10)
+
+            with self.hdb.transaction() as txn:
+                src.copy_to(txn, commit_every=10)
+                txn.import_file(path, format='binary', threads=2, commit_every=10)
+                self.assertEqual(len(self.hdb), 10)
+            self.assertEqual(len(self.hdb), 1110)
+            self.assertEqual(self.hdb['c0999'], 999)
+            self.assertEqual(self.hdb['i042'], 42)
+        finally:
+            os.remove(path)
+            src.cleanup()
+            extra.cleanup()
+
+    def test_open_iterator(self):
+        txn = self.hdb.transaction()
+        txn['new'] = 1
+        it = iter(txn)
+        next(it)
+
+        # the cursor still reads the transaction
+        self.assertRaises(HeliumdbException, txn.commit)
+        self.assertRaises(HeliumdbException, txn.discard)
+        self.assertEqual(txn['new'], 1)
+        self.assertEqual(len(list(it)), 10)
+
+        # exhausted iterators release their cursor
+        txn['other'] = 2
+        it = iter(txn)
+        next(it)
+        del it
+        txn.commit()
+        self.assertEqual(self.hdb['new'], 1)
+        self.assertEqual(self.hdb['other'], 2)
+
+    def test_plain_handle_context(self):
+        with self.hdb as hdb:
+            hdb['x'] = 1
+        self.assertEqual(self.hdb['x'], 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,71 @@
+#
+# Copyright 2014-2018 Neueda Ltd.
+#
+from heliumdb import Heliumdb, HeliumdbException, HE_O_CREATE, HE_O_VOLUME_CREATE
+import unittest
+import os
+import time
+
+
+class TestWriteBuffer(unittest.TestCase):
+    def setUp(self):
+        os.system('truncate -s 2g /tmp/test-write-buffer')
+        flags = HE_O_CREATE | HE_O_VOLUME_CREATE
+        self.url = "he://.//tmp/test-write-buffer"
+        self.hdb = Heliumdb(url=self.url,
+                            datastore='helium',
+                            key_type='i',
+                            val_type='O',
+                            write_buffer=64,
+                            flush_interval=10.0,
+                            flags=flags)
+        self.direct = Heliumdb(url=self.url, datastore='helium',
+                               key_type='i', val_type='O')
+
+    def tearDown(self):
+        self.hdb.cleanup()
+        if os.path.exists('/tmp/test-write-buffer'):
+            os.remove('/tmp/test-write-buffer')
+
+    def test_read_your_writes(self):
+        self.hdb[1] = 'a'
+        self.hdb[1] = 'b'
+        self.assertEqual(self.hdb[1], 'b')
+        self.assertEqual(self.hdb.get(1), 'b')
+        self.assertTrue(self.hdb.contains(1))
+        # not applied until the buffer fills or the interval elapses
+        self.assertFalse(self.direct.contains(1))
+
+        del self.hdb[1]
+        self.assertFalse(self.hdb.contains(1))
+        self.assertEqual(self.hdb.get(1, 'gone'), 'gone')
+        self.assertRaises(HeliumdbException, self.hdb.__delitem__, 1)
+
+    def test_flush(self):
+        for i in range(1000):
+            self.hdb[i] = i
+        self.hdb.flush()
+
+        self.assertEqual(self.direct[999], 999)
+        self.assertEqual(len(self.direct), 1000)
+        stats = self.hdb.stats()
+        self.assertEqual(stats['write_buffer_flushed_items'], 1000)
+        self.assertEqual(stats['write_buffer_pending'], 0)
+
+    def test_size_threshold(self):
+        for i in range(100):
+            self.hdb[i] = i
+
+        # the flusher drains a full buffer without waiting for the interval
+        for _ in range(100):
+            if self.direct.contains(0):
+                break
+            time.sleep(0.01)
+        self.assertEqual(self.direct[0], 0)
+
+    def test_direct_reads_flush(self):
+        self.hdb[3] = 'x'
+        self.hdb[4] = 'y'
+        self.assertEqual(list(self.hdb.items()), [(3, 'x'), (4, 'y')])
+        self.assertEqual(self.hdb.pop(3), 'x')
+        self.assertEqual(len(self.hdb), 1)